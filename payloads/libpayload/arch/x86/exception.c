@@ -32,6 +32,7 @@
 #include <libpayload.h>
 #include <stdint.h>
 #include <arch/apic.h>
+#include <arch/cpuid.h>
 
 #define IF_FLAG				(1 << 9)
 
@@ -39,6 +40,14 @@ u32 exception_stack[0x400] __attribute__((aligned(8)));
 
 static interrupt_handler handlers[256];
 
+/*
+ * FPU/SSE state of the interrupted code. memcpy() and memset() may use SSE
+ * registers, so handlers calling them must not clobber the state of an
+ * interrupted copy. Interrupts don't nest, so one save area is enough.
+ */
+static u8 fpu_state[512] __attribute__((aligned(16)));
+static int save_fpu_state;
+
 static const char *names[EXC_COUNT] = {
 	[EXC_DE]  = "Divide by Zero",
 	[EXC_DB]  = "Debug",
@@ -170,7 +179,11 @@ void exception_dispatch(void)
 	u8 vec = exception_state->vector;
 
 	if (handlers[vec]) {
+		if (save_fpu_state)
+			asm volatile ("fxsave %0" : "=m" (fpu_state));
 		handlers[vec](vec);
+		if (save_fpu_state)
+			asm volatile ("fxrstor %0" : : "m" (fpu_state));
 		goto success;
 	} else if (vec >= EXC_COUNT
 		   && CONFIG(LP_IGNORE_UNKNOWN_INTERRUPTS)) {
@@ -198,6 +211,15 @@ success:
 
 void exception_init(void)
 {
+	u32 eax, ebx, ecx, edx;
+
+	/* head.S enables FXSAVE/FXRSTOR (CR4.OSFXSR) along with SSE. */
+	cpuid(0, eax, ebx, ecx, edx);
+	if (eax >= 1) {
+		cpuid(1, eax, ebx, ecx, edx);
+		save_fpu_state = !!(edx & (1 << 25));
+	}
+
 	exception_stack_end = exception_stack + ARRAY_SIZE(exception_stack);
 	exception_init_asm();
 }
@@ -30,6 +30,7 @@
 #include <exception.h>
 #include <libpayload.h>
 #include <arch/apic.h>
+#include <arch/string.h>
 
 unsigned long loader_eax;  /**< The value of EAX passed from the loader */
 unsigned long loader_ebx;  /**< The value of EBX passed from the loader */
@@ -48,6 +49,9 @@ int start_main(void)
 {
 	extern int main(int argc, char **argv);
 
+	if (CONFIG(LP_GPL))
+		x86_string_init();
+
 	/* Gather system information. */
 	lib_get_sysinfo();
 
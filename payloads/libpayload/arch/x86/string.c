@@ -17,12 +17,98 @@
 /* From glibc-2.14, sysdeps/i386/memset.c */
 
 #include <stdint.h>
+#include <arch/cpuid.h>
+#include <arch/string.h>
 
 #include "string.h"
 
 typedef uint32_t op_t;
 
-void *memset(void *dstpp, int c, size_t len)
+/* For unaligned word accesses in the small paths. */
+typedef uint32_t __attribute__((aligned(1), may_alias)) unaligned_u32;
+
+/*
+ * Size dispatch for memcpy() and memset(). Operations below SMALL_THRESHOLD
+ * bytes use a few overlapping general purpose register moves, because the
+ * startup cost of REP MOVS/STOS dominates at these sizes. From there on,
+ * 16-byte SSE2 loops are faster than REP MOVSL/STOSL, and from
+ * ERMS_THRESHOLD bytes on the microcoded REP MOVSB/STOSB of CPUs with
+ * Enhanced REP MOVSB/STOSB beats both. Operations larger than nt_threshold
+ * (half of the last level cache) would only evict useful data, so they use
+ * non-temporal stores instead. The exception handler preserves the SSE
+ * registers, so the SSE2 paths are safe to interrupt.
+ *
+ * Without SSE2 everything from SMALL_THRESHOLD up to ERMS_THRESHOLD (or
+ * beyond, without ERMS) uses the original REP MOVSL/STOSL versions.
+ */
+#define SMALL_THRESHOLD		16
+#define ERMS_THRESHOLD		2048
+
+/*
+ * libpayload itself is built without SSE code generation, and the compiler
+ * refuses XMM clobbers then. It will not keep anything in them either.
+ */
+#ifdef __SSE__
+#define XMM_CLOBBERS , "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5"
+#else
+#define XMM_CLOBBERS
+#endif
+
+static struct {
+	int sse2;
+	int erms;
+	size_t nt_threshold;
+} string_features = {
+	.nt_threshold = ~(size_t)0,
+};
+
+static size_t last_level_cache_size(void)
+{
+	uint32_t eax, ebx, ecx, edx, max_leaf, i;
+	size_t cache, size = 0;
+
+	cpuid(0, max_leaf, ebx, ecx, edx);
+	if (max_leaf < 4)
+		return 0;
+
+	/* Deterministic cache parameters, one sub-leaf per cache. */
+	for (i = 0; i < 16; i++) {
+		cpuid_count(4, i, eax, ebx, ecx, edx);
+		if (!(eax & 0x1f))
+			break;
+		cache = (size_t)((ebx >> 22) + 1) * (((ebx >> 12) & 0x3ff) + 1) *
+			((ebx & 0xfff) + 1) * (ecx + 1);
+		if (cache > size)
+			size = cache;
+	}
+	return size;
+}
+
+void x86_string_init(void)
+{
+	uint32_t eax, ebx, ecx, edx, max_leaf;
+	size_t llc;
+
+	cpuid(0, max_leaf, ebx, ecx, edx);
+	if (max_leaf < 1)
+		return;
+
+	/* head.S sets CR4.OSFXSR whenever the CPU has SSE. */
+	cpuid(1, eax, ebx, ecx, edx);
+	string_features.sse2 = !!(edx & (1 << 26));
+
+	if (max_leaf >= 7) {
+		cpuid_count(7, 0, eax, ebx, ecx, edx);
+		string_features.erms = !!(ebx & (1 << 9));
+	}
+
+	if (string_features.sse2) {
+		llc = last_level_cache_size();
+		string_features.nt_threshold = llc ? llc / 2 : 1024 * 1024;
+	}
+}
+
+static void *memset_rep(void *dstpp, int c, size_t len)
 {
 	int d0;
 	unsigned long int dstp = (unsigned long int) dstpp;
@@ -78,18 +164,313 @@ void *memset(void *dstpp, int c, size_t len)
 	return dstpp;
 }
 
-void *memcpy(void *dest, const void *src, size_t n)
+static void *memset_erms(void *dest, int c, size_t n)
+{
+	unsigned long d0, d1;
+
+	asm volatile(
+		"rep ; stosb\n\t"
+		: "=&c" (d0), "=&D" (d1)
+		: "0" (n), "1" (dest), "a" (c)
+		: "memory"
+	);
+
+	return dest;
+}
+
+/* n must be below SMALL_THRESHOLD. */
+static void *memset_small(void *dest, int c, size_t n)
+{
+	uint8_t *d = dest;
+	op_t x = (unsigned char)c * 0x01010101;
+
+	if (n >= 8) {
+		*(unaligned_u32 *)d = x;
+		*(unaligned_u32 *)(d + 4) = x;
+		*(unaligned_u32 *)(d + n - 8) = x;
+		*(unaligned_u32 *)(d + n - 4) = x;
+	} else if (n >= 4) {
+		*(unaligned_u32 *)d = x;
+		*(unaligned_u32 *)(d + n - 4) = x;
+	} else if (n) {
+		d[0] = c;
+		d[n / 2] = c;
+		d[n - 1] = c;
+	}
+
+	return dest;
+}
+
+/*
+ * n must be at least SMALL_THRESHOLD. The unaligned first and last 16 bytes
+ * are written with overlapping unaligned stores, everything in between with
+ * aligned ones.
+ */
+static void *memset_sse2(void *dest, int c, size_t n, int nt)
+{
+	uint8_t *d = dest;
+	uint8_t *aligned = (uint8_t *)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+	size_t rest = n - (aligned - d);
+	op_t x = (unsigned char)c * 0x01010101;
+
+	if (nt)
+		asm volatile(
+			"movd %[x], %%xmm0\n\t"
+			"pshufd $0, %%xmm0, %%xmm0\n\t"
+			"movdqu %%xmm0, (%[d0])\n\t"
+			"movdqu %%xmm0, -16(%[d], %[rest])\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jb 2f\n\t"
+			"1:\n\t"
+			"movntdq %%xmm0,   (%[d])\n\t"
+			"movntdq %%xmm0, 16(%[d])\n\t"
+			"movntdq %%xmm0, 32(%[d])\n\t"
+			"movntdq %%xmm0, 48(%[d])\n\t"
+			"add $64, %[d]\n\t"
+			"sub $64, %[rest]\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jae 1b\n\t"
+			"sfence\n\t"
+			"2:\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jb 4f\n\t"
+			"3:\n\t"
+			"movdqa %%xmm0, (%[d])\n\t"
+			"add $16, %[d]\n\t"
+			"sub $16, %[rest]\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jae 3b\n\t"
+			"4:\n\t"
+			: [d] "+r" (aligned), [rest] "+r" (rest)
+			: [d0] "r" (d), [x] "r" (x)
+			: "cc", "memory" XMM_CLOBBERS
+		);
+	else
+		asm volatile(
+			"movd %[x], %%xmm0\n\t"
+			"pshufd $0, %%xmm0, %%xmm0\n\t"
+			"movdqu %%xmm0, (%[d0])\n\t"
+			"movdqu %%xmm0, -16(%[d], %[rest])\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jb 2f\n\t"
+			"1:\n\t"
+			"movdqa %%xmm0,   (%[d])\n\t"
+			"movdqa %%xmm0, 16(%[d])\n\t"
+			"movdqa %%xmm0, 32(%[d])\n\t"
+			"movdqa %%xmm0, 48(%[d])\n\t"
+			"add $64, %[d]\n\t"
+			"sub $64, %[rest]\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jae 1b\n\t"
+			"2:\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jb 4f\n\t"
+			"3:\n\t"
+			"movdqa %%xmm0, (%[d])\n\t"
+			"add $16, %[d]\n\t"
+			"sub $16, %[rest]\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jae 3b\n\t"
+			"4:\n\t"
+			: [d] "+r" (aligned), [rest] "+r" (rest)
+			: [d0] "r" (d), [x] "r" (x)
+			: "cc", "memory" XMM_CLOBBERS
+		);
+
+	return dest;
+}
+
+void *memset(void *dstpp, int c, size_t len)
+{
+	if (len < SMALL_THRESHOLD)
+		return memset_small(dstpp, c, len);
+	if (string_features.sse2 && len >= string_features.nt_threshold)
+		return memset_sse2(dstpp, c, len, 1);
+	if (string_features.erms && len >= ERMS_THRESHOLD)
+		return memset_erms(dstpp, c, len);
+	if (string_features.sse2)
+		return memset_sse2(dstpp, c, len, 0);
+	return memset_rep(dstpp, c, len);
+}
+
+static void *memcpy_rep(void *dest, const void *src, size_t n)
 {
 	unsigned long d0, d1, d2;
 
 	asm volatile(
 		"rep ; movsl\n\t"
-		"movl %4,%%ecx\n\t"
+		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
+		: "0" (n >> 2), "1" (dest), "2" (src)
+		: "memory"
+	);
+	asm volatile(
+		"rep ; movsb\n\t"
+		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
+		: "0" (n & 3), "1" (d1), "2" (d2)
+		: "memory"
+	);
+
+	return dest;
+}
+
+static void *memcpy_erms(void *dest, const void *src, size_t n)
+{
+	unsigned long d0, d1, d2;
+
+	asm volatile(
 		"rep ; movsb\n\t"
 		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
-		: "0" (n >> 2), "g" (n & 3), "1" (dest), "2" (src)
+		: "0" (n), "1" (dest), "2" (src)
 		: "memory"
 	);
 
 	return dest;
 }
+
+/*
+ * n must be below SMALL_THRESHOLD. All loads happen before the first store,
+ * so overlapping buffers are fine for memmove().
+ */
+static void *memcpy_small(void *dest, const void *src, size_t n)
+{
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+	uint32_t a, b, c, e;
+
+	if (n >= 8) {
+		a = *(const unaligned_u32 *)s;
+		b = *(const unaligned_u32 *)(s + 4);
+		c = *(const unaligned_u32 *)(s + n - 8);
+		e = *(const unaligned_u32 *)(s + n - 4);
+		*(unaligned_u32 *)d = a;
+		*(unaligned_u32 *)(d + 4) = b;
+		*(unaligned_u32 *)(d + n - 8) = c;
+		*(unaligned_u32 *)(d + n - 4) = e;
+	} else if (n >= 4) {
+		a = *(const unaligned_u32 *)s;
+		e = *(const unaligned_u32 *)(s + n - 4);
+		*(unaligned_u32 *)d = a;
+		*(unaligned_u32 *)(d + n - 4) = e;
+	} else if (n) {
+		a = s[0];
+		b = s[n / 2];
+		e = s[n - 1];
+		d[0] = a;
+		d[n / 2] = b;
+		d[n - 1] = e;
+	}
+
+	return dest;
+}
+
+/*
+ * n must be at least SMALL_THRESHOLD. The unaligned first and last 16 bytes
+ * are loaded up front and stored last with overlapping unaligned stores,
+ * everything in between is copied to 16-byte aligned destinations. Each
+ * block is loaded completely before it is stored, so this is still safe for
+ * memmove() with dest below src.
+ */
+static void *memcpy_sse2(void *dest, const void *src, size_t n, int nt)
+{
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+	uint8_t *aligned = (uint8_t *)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+	const uint8_t *s_aligned = s + (aligned - d);
+	size_t rest = n - (aligned - d);
+
+	if (nt)
+		asm volatile(
+			"movdqu (%[s0]), %%xmm4\n\t"
+			"movdqu -16(%[s], %[rest]), %%xmm5\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jb 2f\n\t"
+			"1:\n\t"
+			"prefetchnta 256(%[s])\n\t"
+			"movdqu   (%[s]), %%xmm0\n\t"
+			"movdqu 16(%[s]), %%xmm1\n\t"
+			"movdqu 32(%[s]), %%xmm2\n\t"
+			"movdqu 48(%[s]), %%xmm3\n\t"
+			"movntdq %%xmm0,   (%[d])\n\t"
+			"movntdq %%xmm1, 16(%[d])\n\t"
+			"movntdq %%xmm2, 32(%[d])\n\t"
+			"movntdq %%xmm3, 48(%[d])\n\t"
+			"add $64, %[s]\n\t"
+			"add $64, %[d]\n\t"
+			"sub $64, %[rest]\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jae 1b\n\t"
+			"sfence\n\t"
+			"2:\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jb 4f\n\t"
+			"3:\n\t"
+			"movdqu (%[s]), %%xmm0\n\t"
+			"movdqa %%xmm0, (%[d])\n\t"
+			"add $16, %[s]\n\t"
+			"add $16, %[d]\n\t"
+			"sub $16, %[rest]\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jae 3b\n\t"
+			"4:\n\t"
+			"movdqu %%xmm4, (%[d0])\n\t"
+			"movdqu %%xmm5, -16(%[d], %[rest])\n\t"
+			: [d] "+r" (aligned), [s] "+r" (s_aligned),
+			  [rest] "+r" (rest)
+			: [d0] "r" (d), [s0] "r" (s)
+			: "cc", "memory" XMM_CLOBBERS
+		);
+	else
+		asm volatile(
+			"movdqu (%[s0]), %%xmm4\n\t"
+			"movdqu -16(%[s], %[rest]), %%xmm5\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jb 2f\n\t"
+			"1:\n\t"
+			"movdqu   (%[s]), %%xmm0\n\t"
+			"movdqu 16(%[s]), %%xmm1\n\t"
+			"movdqu 32(%[s]), %%xmm2\n\t"
+			"movdqu 48(%[s]), %%xmm3\n\t"
+			"movdqa %%xmm0,   (%[d])\n\t"
+			"movdqa %%xmm1, 16(%[d])\n\t"
+			"movdqa %%xmm2, 32(%[d])\n\t"
+			"movdqa %%xmm3, 48(%[d])\n\t"
+			"add $64, %[s]\n\t"
+			"add $64, %[d]\n\t"
+			"sub $64, %[rest]\n\t"
+			"cmp $64, %[rest]\n\t"
+			"jae 1b\n\t"
+			"2:\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jb 4f\n\t"
+			"3:\n\t"
+			"movdqu (%[s]), %%xmm0\n\t"
+			"movdqa %%xmm0, (%[d])\n\t"
+			"add $16, %[s]\n\t"
+			"add $16, %[d]\n\t"
+			"sub $16, %[rest]\n\t"
+			"cmp $16, %[rest]\n\t"
+			"jae 3b\n\t"
+			"4:\n\t"
+			"movdqu %%xmm4, (%[d0])\n\t"
+			"movdqu %%xmm5, -16(%[d], %[rest])\n\t"
+			: [d] "+r" (aligned), [s] "+r" (s_aligned),
+			  [rest] "+r" (rest)
+			: [d0] "r" (d), [s0] "r" (s)
+			: "cc", "memory" XMM_CLOBBERS
+		);
+
+	return dest;
+}
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	if (n < SMALL_THRESHOLD)
+		return memcpy_small(dest, src, n);
+	if (string_features.sse2 && n >= string_features.nt_threshold)
+		return memcpy_sse2(dest, src, n, 1);
+	if (string_features.erms && n >= ERMS_THRESHOLD)
+		return memcpy_erms(dest, src, n);
+	if (string_features.sse2)
+		return memcpy_sse2(dest, src, n, 0);
+	return memcpy_rep(dest, src, n);
+}
@@ -55,6 +55,16 @@ struct bitmap_header_v3 {
 	uint32_t colors_important;
 } __packed;
 
+/* Values for bitmap_header_v3.compression */
+#define BITMAP_COMPRESSION_NONE	0	/* BI_RGB */
+#define BITMAP_COMPRESSION_RLE8	1	/* BI_RLE8 */
+/*
+ * Not part of the BMP format: the pixel array is an LZ4 frame (independent
+ * blocks, preferably 64KB) of the uncompressed, 4-byte padded rows. The value
+ * is the FourCC 'LZ4 '.
+ */
+#define BITMAP_COMPRESSION_LZ4	0x20345a4c
+
 struct bitmap_palette_element_v3 {
 	uint8_t blue;
 	uint8_t green;
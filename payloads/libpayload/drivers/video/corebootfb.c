@@ -33,6 +33,7 @@
 #include <pci.h>
 #include <video_console.h>
 #include "font.h"
+#include "shadowfb.h"
 
 struct video_console coreboot_video_console;
 
@@ -91,6 +92,8 @@ static void corebootfb_scroll_up(void)
 		memset(dst, 0, FI->x_resolution * (FI->bits_per_pixel >> 3));
 		dst += FI->bytes_per_line;
 	}
+	shadowfb_damage(0, 0, FI->x_resolution, FI->y_resolution);
+	shadowfb_flush();
 
 	/* And update the char buffer */
 	dst = (unsigned char *) CHARS;
@@ -114,6 +117,8 @@ static void corebootfb_clear(void)
 		memset(ptr, 0, FI->x_resolution * (FI->bits_per_pixel >> 3));
 		ptr += FI->bytes_per_line;
 	}
+	shadowfb_damage(0, 0, FI->x_resolution, FI->y_resolution);
+	shadowfb_flush();
 
 	/* And update the char buffer */
 	for(row = 0; row < coreboot_video_console.rows; row++)
@@ -177,6 +182,11 @@ static void corebootfb_putchar(u8 row, u8 col, unsigned int ch)
 
 		dst += FI->bytes_per_line;
 	}
+
+	/* Glyph pixels are drawn at offsets 1 to font_width. */
+	shadowfb_damage(col * font_width, row * font_height, font_width + 1,
+			font_height);
+	shadowfb_flush();
 }
 
 static void corebootfb_putc(u8 row, u8 col, unsigned int ch)
@@ -238,6 +248,9 @@ static int corebootfb_init(void)
 	if (fbaddr == 0)
 		return -1;
 
+	/* Draw to the cached shadow copy if there is one. */
+	fbaddr = virt_to_phys(shadowfb_init(FI, FB));
+
 	font_init(FI->x_resolution);
 
 	coreboot_video_console.columns = FI->x_resolution / font_width;
@@ -30,7 +30,9 @@
 #include <libpayload.h>
 #include <cbfs.h>
 #include <sysinfo.h>
+#include <lz4.h>
 #include "bitmap.h"
+#include "shadowfb.h"
 
 /*
  * 'canvas' is the drawing area located in the center of the screen. It's a
@@ -151,6 +153,7 @@ static int cbgfx_init(void)
 	fbaddr = phys_to_virt((uint8_t *)(uintptr_t)(fbinfo->physical_address));
 	if (!fbaddr)
 		return CBGFX_ERROR_FRAMEBUFFER_ADDR;
+	fbaddr = shadowfb_init(fbinfo, fbaddr);
 
 	screen.size.width = fbinfo->x_resolution;
 	screen.size.height = fbinfo->y_resolution;
@@ -208,6 +211,9 @@ int draw_box(const struct rect *box, const struct rgb_color *rgb)
 		for (p.x = top_left.x; p.x < t.x; p.x++)
 			set_pixel(&p, color);
 
+	shadowfb_damage(top_left.x, top_left.y, size.x, size.y);
+	shadowfb_flush();
+
 	return CBGFX_SUCCESS;
 }
 
@@ -248,22 +254,458 @@ int clear_screen(const struct rgb_color *rgb)
 				set_pixel(&p, color);
 	}
 
+	shadowfb_damage(0, 0, screen.size.width, screen.size.height);
+	shadowfb_flush();
+
 	return CBGFX_SUCCESS;
 }
 
+void cbgfx_begin_frame(void)
+{
+	shadowfb_batch_begin();
+}
+
+void cbgfx_present_frame(void)
+{
+	shadowfb_batch_end();
+}
+
 /*
  * Bi-linear Interpolation
  *
  * It estimates the value of a middle point (tx, ty) using the values from four
- * adjacent points (q00, q01, q10, q11).
+ * adjacent points (q00, q01, q10, q11). To keep the inner loops cheap, the
+ * weights tx and ty are precomputed as fixed-point fractions of BLI_ONE and
+ * the work is split into a horizontal pass over each source row (which can be
+ * reused by all destination rows sampling it) and a vertical pass per
+ * destination row.
  */
-static uint32_t bli(uint32_t q00, uint32_t q10, uint32_t q01, uint32_t q11,
-		    struct fraction *tx, struct fraction *ty)
+#define BLI_SHIFT	8
+#define BLI_ONE		(1 << BLI_SHIFT)
+
+/* A horizontally interpolated pixel. Channels are scaled by BLI_ONE. */
+struct bli_pixel {
+	uint16_t red;
+	uint16_t green;
+	uint16_t blue;
+};
+
+/*
+ * Per-bitmap lookup tables so that the per-pixel divisions in the scaling
+ * math are done once per column rather than once per pixel.
+ */
+struct bitmap_scaler {
+	int32_t *x0;		/* left source column of each destination column */
+	int32_t *x1;		/* right source column */
+	uint16_t *wx;		/* weight of x1, 0 to BLI_ONE */
+	struct bli_pixel *rows[2];	/* interpolated source rows y0 and y1 */
+	int32_t cached[2];	/* source rows currently held in rows[] */
+	uint8_t *line;		/* one destination row in framebuffer format */
+	int direct;		/* unscaled, so no interpolation needed */
+	uint32_t colors[256];	/* palette converted to framebuffer format */
+};
+
+static void free_bitmap_scaler(struct bitmap_scaler *sc)
+{
+	free(sc->x0);
+	free(sc->x1);
+	free(sc->wx);
+	free(sc->rows[0]);
+	free(sc->rows[1]);
+	free(sc->line);
+}
+
+static int init_bitmap_scaler(struct bitmap_scaler *sc,
+			      const struct scale *scale,
+			      const struct vector *dim,
+			      const struct vector *dim_org,
+			      const struct bitmap_header_v3 *header,
+			      const struct bitmap_palette_element_v3 *pal,
+			      uint8_t invert)
+{
+	const int32_t width = dim->width;
+	int32_t i;
+
+	memset(sc, 0, sizeof(*sc));
+	sc->cached[0] = sc->cached[1] = -1;
+	sc->direct = scale->x.n == scale->x.d && scale->y.n == scale->y.d;
+
+	sc->line = malloc(width * sizeof(uint32_t));
+	if (!sc->line)
+		goto oom;
+
+	/* Unscaled images are a straight palette lookup. */
+	if (sc->direct) {
+		const int32_t ncolors = MIN(header->colors_used,
+					    ARRAY_SIZE(sc->colors));
+
+		for (i = 0; i < ncolors; i++) {
+			const struct rgb_color rgb = {
+				.red = pal[i].red,
+				.green = pal[i].green,
+				.blue = pal[i].blue,
+			};
+			sc->colors[i] = calculate_color(&rgb, invert);
+		}
+		return CBGFX_SUCCESS;
+	}
+
+	sc->x0 = malloc(width * sizeof(*sc->x0));
+	sc->x1 = malloc(width * sizeof(*sc->x1));
+	sc->wx = malloc(width * sizeof(*sc->wx));
+	sc->rows[0] = malloc(width * sizeof(*sc->rows[0]));
+	sc->rows[1] = malloc(width * sizeof(*sc->rows[1]));
+	if (!sc->x0 || !sc->x1 || !sc->wx || !sc->rows[0] || !sc->rows[1])
+		goto oom;
+
+	for (i = 0; i < width; i++) {
+		sc->x0[i] = i * scale->x.d / scale->x.n;
+		sc->x1[i] = sc->x0[i];
+		if (sc->x1[i] + 1 < dim_org->width)
+			sc->x1[i]++;
+		sc->wx[i] = (i * scale->x.d) % scale->x.n * BLI_ONE /
+			    scale->x.n;
+	}
+
+	return CBGFX_SUCCESS;
+
+oom:
+	LOG("Out of memory\n");
+	free_bitmap_scaler(sc);
+	return CBGFX_ERROR_MEMORY;
+}
+
+/*
+ * Sequential reader for the rows of a pixel array. Rows are numbered in storage
+ * order and must be requested in non-decreasing order, which is how
+ * draw_bitmap_v3() walks them. That way compressed pixel arrays are decoded
+ * one row at a time straight from the bitmap data, without ever holding the
+ * whole decompressed image in memory.
+ */
+struct bitmap_pixels {
+	const uint8_t *data;	/* (remaining) pixel array */
+	const uint8_t *end;
+	uint32_t compression;
+	int32_t width;
+	int32_t stride;
+	int32_t next;		/* next row to be decoded */
+	const uint8_t *row;	/* last decoded row */
+	uint8_t *buf;		/* decode buffer for one row */
+
+	/* BITMAP_COMPRESSION_RLE8 */
+	int32_t rle_skip;	/* rows left blank by a delta escape */
+	int32_t rle_x;		/* column the next row starts at */
+	int rle_done;		/* end of bitmap seen */
+
+#if CONFIG(LP_LZ4)
+	/* BITMAP_COMPRESSION_LZ4 */
+	struct lz4_stream lz4;
+	uint8_t *block;		/* one decompressed LZ4 block */
+	size_t block_len;
+	size_t block_pos;
+#endif
+};
+
+static void free_bitmap_pixels(struct bitmap_pixels *px)
 {
-	uint32_t r0 = (tx->n * q10 + (tx->d - tx->n) * q00) / tx->d;
-	uint32_t r1 = (tx->n * q11 + (tx->d - tx->n) * q01) / tx->d;
-	uint32_t p = (ty->n * r1 + (ty->d - ty->n) * r0) / ty->d;
-	return p;
+	free(px->buf);
+#if CONFIG(LP_LZ4)
+	free(px->block);
+#endif
+}
+
+static int init_bitmap_pixels(struct bitmap_pixels *px,
+			      const struct bitmap_header_v3 *header,
+			      const uint8_t *pixel_array,
+			      const struct vector *dim_org)
+{
+	memset(px, 0, sizeof(*px));
+	px->data = pixel_array;
+	px->end = pixel_array + header->size;
+	px->compression = header->compression;
+	px->width = dim_org->width;
+	px->stride = ROUNDUP(dim_org->width * header->bits_per_pixel / 8, 4);
+
+	switch (px->compression) {
+	case BITMAP_COMPRESSION_NONE:
+		return CBGFX_SUCCESS;
+	case BITMAP_COMPRESSION_RLE8:
+		/* Rows are decoded one byte per pixel into a stride sized buffer. */
+		if (header->bits_per_pixel != 8) {
+			LOG("RLE8 bitmap with %d bits per pixel\n",
+			    header->bits_per_pixel);
+			return CBGFX_ERROR_BITMAP_FORMAT;
+		}
+		break;
+#if CONFIG(LP_LZ4)
+	case BITMAP_COMPRESSION_LZ4:
+		if (ulz4f_stream_init(&px->lz4, px->data, header->size)) {
+			LOG("Invalid LZ4 frame\n");
+			return CBGFX_ERROR_BITMAP_DATA;
+		}
+		px->block = malloc(px->lz4.max_block_size);
+		if (!px->block)
+			goto oom;
+		break;
+#endif
+	default:
+		LOG("Unsupported bitmap compression: %#x\n", px->compression);
+		return CBGFX_ERROR_BITMAP_FORMAT;
+	}
+
+	px->buf = malloc(px->stride);
+	if (!px->buf)
+		goto oom;
+
+	return CBGFX_SUCCESS;
+
+oom:
+	LOG("Out of memory\n");
+	free_bitmap_pixels(px);
+	return CBGFX_ERROR_MEMORY;
+}
+
+/* Decode the next row of a BI_RLE8 pixel array. */
+static int decode_rle8_row(struct bitmap_pixels *px)
+{
+	const uint8_t *in = px->data;
+	uint8_t *row = px->buf;
+	int32_t x = px->rle_x;
+	uint8_t count, value;
+
+	/* Pixels not covered by the encoding are left at color 0. */
+	memset(row, 0, px->width);
+	px->row = row;
+
+	if (px->rle_done)
+		return CBGFX_SUCCESS;
+	if (px->rle_skip) {
+		px->rle_skip--;
+		return CBGFX_SUCCESS;
+	}
+	px->rle_x = 0;
+
+	while (1) {
+		if (in + 2 > px->end)
+			goto overrun;
+		count = in[0];
+		value = in[1];
+		in += 2;
+
+		/* Encoded mode: a run of count pixels of color value. */
+		if (count) {
+			if (x < px->width)
+				memset(row + x, value, MIN(count, px->width - x));
+			x += count;
+			continue;
+		}
+
+		/* Escapes */
+		if (value == 0)		/* end of line */
+			break;
+		if (value == 1) {	/* end of bitmap */
+			px->rle_done = 1;
+			break;
+		}
+		if (value == 2) {	/* delta */
+			if (in + 2 > px->end)
+				goto overrun;
+			x += in[0];
+			in += 2;
+			if (in[-1]) {
+				px->rle_skip = in[-1] - 1;
+				px->rle_x = x;
+				break;
+			}
+			continue;
+		}
+
+		/* Absolute mode: value literal pixels, padded to 16 bits. */
+		if (in + value + (value & 1) > px->end)
+			goto overrun;
+		if (x < px->width)
+			memcpy(row + x, in, MIN(value, px->width - x));
+		x += value;
+		in += value + (value & 1);
+	}
+
+	px->data = in;
+	return CBGFX_SUCCESS;
+
+overrun:
+	LOG("RLE8 pixel data exceeds pixel array boundary\n");
+	return CBGFX_ERROR_BITMAP_DATA;
+}
+
+#if CONFIG(LP_LZ4)
+/* Fetch the next row from an LZ4 frame of uncompressed rows. */
+static int decode_lz4_row(struct bitmap_pixels *px)
+{
+	size_t done = 0;
+	size_t chunk;
+	int ret;
+
+	while (done < px->stride) {
+		if (px->block_pos == px->block_len) {
+			ret = ulz4f_stream_next(&px->lz4, px->block,
+						px->lz4.max_block_size);
+			if (ret <= 0) {
+				LOG("Invalid or truncated LZ4 pixel data\n");
+				return CBGFX_ERROR_BITMAP_DATA;
+			}
+			px->block_len = ret;
+			px->block_pos = 0;
+		}
+
+		/* Rows that don't straddle blocks are used in place. */
+		if (!done && px->block_len - px->block_pos >= px->stride) {
+			px->row = px->block + px->block_pos;
+			px->block_pos += px->stride;
+			return CBGFX_SUCCESS;
+		}
+
+		chunk = MIN(px->stride - done, px->block_len - px->block_pos);
+		memcpy(px->buf + done, px->block + px->block_pos, chunk);
+		px->block_pos += chunk;
+		done += chunk;
+	}
+
+	px->row = px->buf;
+	return CBGFX_SUCCESS;
+}
+#endif
+
+static int get_bitmap_row(struct bitmap_pixels *px, int32_t y,
+			  const uint8_t **row)
+{
+	int rv;
+
+	if (px->compression == BITMAP_COMPRESSION_NONE) {
+		*row = px->data + y * px->stride;
+		return CBGFX_SUCCESS;
+	}
+
+	if (y < px->next - 1) {
+		LOG("Compressed bitmap rows must be read in order\n");
+		return CBGFX_ERROR_UNKNOWN;
+	}
+
+	while (px->next <= y) {
+#if CONFIG(LP_LZ4)
+		if (px->compression == BITMAP_COMPRESSION_LZ4)
+			rv = decode_lz4_row(px);
+		else
+#endif
+			rv = decode_rle8_row(px);
+		if (rv)
+			return rv;
+		px->next++;
+	}
+
+	*row = px->row;
+	return CBGFX_SUCCESS;
+}
+
+/* Horizontal pass of the bilinear interpolation over one source row. */
+static int interpolate_row(struct bli_pixel *out, const uint8_t *data,
+			   const struct bitmap_scaler *sc, int32_t width,
+			   const struct bitmap_header_v3 *header,
+			   const struct bitmap_palette_element_v3 *pal)
+{
+	int32_t x;
+
+	for (x = 0; x < width; x++) {
+		const uint8_t c0 = data[sc->x0[x]];
+		const uint8_t c1 = data[sc->x1[x]];
+		const uint32_t w1 = sc->wx[x];
+		const uint32_t w0 = BLI_ONE - w1;
+
+		if (c0 >= header->colors_used || c1 >= header->colors_used) {
+			LOG("Color index exceeds palette boundary\n");
+			return CBGFX_ERROR_BITMAP_DATA;
+		}
+		out[x].red = pal[c0].red * w0 + pal[c1].red * w1;
+		out[x].green = pal[c0].green * w0 + pal[c1].green * w1;
+		out[x].blue = pal[c0].blue * w0 + pal[c1].blue * w1;
+	}
+
+	return CBGFX_SUCCESS;
+}
+
+/*
+ * Make sc->rows[0] and sc->rows[1] hold source rows y0 and y1. When scaling
+ * up, consecutive destination rows sample the same source rows, so most calls
+ * are no-ops and the rest usually only need to compute one new row.
+ */
+static int load_rows(struct bitmap_scaler *sc, int32_t y0, int32_t y1,
+		     struct bitmap_pixels *px,
+		     int32_t width, const struct bitmap_header_v3 *header,
+		     const struct bitmap_palette_element_v3 *pal)
+{
+	const uint8_t *data;
+	int rv;
+	int i;
+
+	if (sc->cached[0] != y0 && sc->cached[1] == y0) {
+		struct bli_pixel *tmp = sc->rows[0];
+		sc->rows[0] = sc->rows[1];
+		sc->rows[1] = tmp;
+		sc->cached[0] = y0;
+		sc->cached[1] = -1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		const int32_t y = i ? y1 : y0;
+
+		if (sc->cached[i] == y)
+			continue;
+		if (i && y1 == y0) {
+			memcpy(sc->rows[1], sc->rows[0],
+			       width * sizeof(*sc->rows[1]));
+		} else {
+			rv = get_bitmap_row(px, y, &data);
+			if (rv)
+				return rv;
+			rv = interpolate_row(sc->rows[i], data, sc, width,
+					     header, pal);
+			if (rv)
+				return rv;
+		}
+		sc->cached[i] = y;
+	}
+
+	return CBGFX_SUCCESS;
+}
+
+/* Store a framebuffer-format color as the x-th pixel of a row buffer. */
+static inline void put_pixel(uint8_t *line, int32_t x, uint32_t color)
+{
+	const int bpp = fbinfo->bits_per_pixel;
+	int i;
+
+	switch (bpp) {
+	case 32:
+		((uint32_t *)line)[x] = color;
+		break;
+	case 16:
+		((uint16_t *)line)[x] = color;
+		break;
+	default:
+		for (i = 0; i < bpp / 8; i++)
+			line[x * bpp / 8 + i] = color >> (i * 8);
+		break;
+	}
+}
+
+/* Copy a composed row to the framebuffer with a single wide copy. */
+static inline void write_line(const struct vector *start, const uint8_t *line,
+			      int32_t width)
+{
+	const int bpp = fbinfo->bits_per_pixel;
+	const int bpl = fbinfo->bytes_per_line;
+
+	memcpy(fbaddr + start->y * bpl + start->x * bpp / 8, line,
+	       width * bpp / 8);
 }
 
 static int draw_bitmap_v3(const struct vector *top_left,
@@ -276,13 +718,12 @@ static int draw_bitmap_v3(const struct vector *top_left,
 			  uint8_t invert)
 {
 	const int bpp = header->bits_per_pixel;
+	struct bitmap_scaler sc;
+	struct bitmap_pixels px;
 	int32_t dir;
 	struct vector p;
+	int rv;
 
-	if (header->compression) {
-		LOG("Compressed bitmaps are not supported\n");
-		return CBGFX_ERROR_BITMAP_FORMAT;
-	}
 	if (bpp >= 16) {
 		LOG("Non-palette bitmaps are not supported\n");
 		return CBGFX_ERROR_BITMAP_FORMAT;
@@ -296,7 +737,16 @@ static int draw_bitmap_v3(const struct vector *top_left,
 		return CBGFX_ERROR_SCALE_OUT_OF_RANGE;
 	}
 
-	const int32_t y_stride = ROUNDUP(dim_org->width * bpp / 8, 4);
+	rv = init_bitmap_pixels(&px, header, pixel_array, dim_org);
+	if (rv)
+		return rv;
+
+	rv = init_bitmap_scaler(&sc, scale, dim, dim_org, header, pal, invert);
+	if (rv) {
+		free_bitmap_pixels(&px);
+		return rv;
+	}
+
 	/*
 	 * header->height can be positive or negative.
 	 *
@@ -313,6 +763,7 @@ static int draw_bitmap_v3(const struct vector *top_left,
 		p.y += dim->height - 1;
 		dir = -1;
 	}
+	p.x = top_left->x;
 	/*
 	 * Plot pixels scaled by the bilinear interpolation. We scan over the
 	 * image on canvas (using d) and find the corresponding pixel in the
@@ -322,54 +773,64 @@ static int draw_bitmap_v3(const struct vector *top_left,
 	 * corner of the pixel array because that's how scale->x and scale->y
 	 * have been set. Since the pixel array size is already validated in
 	 * parse_bitmap_header_v3, s0 is guranteed not to exceed pixel array
-	 * boundary.
+	 * boundary. Compressed pixel arrays are bounds checked while decoding.
 	 */
 	struct vector s0, s1, d;
-	struct fraction tx, ty;
 	for (d.y = 0; d.y < dim->height; d.y++, p.y += dir) {
+		if (sc.direct) {
+			const uint8_t *data;
+
+			rv = get_bitmap_row(&px, d.y, &data);
+			if (rv)
+				goto out;
+
+			for (d.x = 0; d.x < dim->width; d.x++) {
+				if (data[d.x] >= header->colors_used) {
+					LOG("Color index exceeds palette boundary\n");
+					rv = CBGFX_ERROR_BITMAP_DATA;
+					goto out;
+				}
+				put_pixel(sc.line, d.x, sc.colors[data[d.x]]);
+			}
+			write_line(&p, sc.line, dim->width);
+			continue;
+		}
+
 		s0.y = d.y * scale->y.d / scale->y.n;
 		s1.y = s0.y;
 		if (s1.y + 1 < dim_org->height)
 			s1.y++;
-		ty.d = scale->y.n;
-		ty.n = (d.y * scale->y.d) % scale->y.n;
-		const uint8_t *data0 = pixel_array + s0.y * y_stride;
-		const uint8_t *data1 = pixel_array + s1.y * y_stride;
-		p.x = top_left->x;
-		for (d.x = 0; d.x < dim->width; d.x++, p.x++) {
-			s0.x = d.x * scale->x.d / scale->x.n;
-			s1.x = s0.x;
-			if (s1.x + 1 < dim_org->width)
-				s1.x++;
-			tx.d = scale->x.n;
-			tx.n = (d.x * scale->x.d) % scale->x.n;
-			uint8_t c00 = data0[s0.x];
-			uint8_t c10 = data0[s1.x];
-			uint8_t c01 = data1[s0.x];
-			uint8_t c11 = data1[s1.x];
-			if (c00 >= header->colors_used
-					|| c10 >= header->colors_used
-					|| c01 >= header->colors_used
-					|| c11 >= header->colors_used) {
-				LOG("Color index exceeds palette boundary\n");
-				return CBGFX_ERROR_BITMAP_DATA;
-			}
+		const uint32_t w1 = (d.y * scale->y.d) % scale->y.n * BLI_ONE /
+				    scale->y.n;
+		const uint32_t w0 = BLI_ONE - w1;
+
+		rv = load_rows(&sc, s0.y, s1.y, &px, dim->width, header, pal);
+		if (rv)
+			goto out;
+
+		const struct bli_pixel *r0 = sc.rows[0];
+		const struct bli_pixel *r1 = sc.rows[1];
+		for (d.x = 0; d.x < dim->width; d.x++) {
 			const struct rgb_color rgb = {
-				.red = bli(pal[c00].red, pal[c10].red,
-					   pal[c01].red, pal[c11].red,
-					   &tx, &ty),
-				.green = bli(pal[c00].green, pal[c10].green,
-					     pal[c01].green, pal[c11].green,
-					     &tx, &ty),
-				.blue = bli(pal[c00].blue, pal[c10].blue,
-					    pal[c01].blue, pal[c11].blue,
-					    &tx, &ty),
+				.red = (r0[d.x].red * w0 + r1[d.x].red * w1)
+					>> (2 * BLI_SHIFT),
+				.green = (r0[d.x].green * w0 +
+					  r1[d.x].green * w1)
+					>> (2 * BLI_SHIFT),
+				.blue = (r0[d.x].blue * w0 + r1[d.x].blue * w1)
+					>> (2 * BLI_SHIFT),
 			};
-			set_pixel(&p, calculate_color(&rgb, invert));
+			put_pixel(sc.line, d.x, calculate_color(&rgb, invert));
 		}
+		write_line(&p, sc.line, dim->width);
 	}
 
-	return CBGFX_SUCCESS;
+out:
+	shadowfb_damage(top_left->x, top_left->y, dim->width, dim->height);
+	shadowfb_flush();
+	free_bitmap_scaler(&sc);
+	free_bitmap_pixels(&px);
+	return rv;
 }
 
 static int get_bitmap_file_header(const void *bitmap, size_t size,
@@ -453,7 +914,8 @@ static int parse_bitmap_header_v3(
 			palette_offset);
 
 	size_t pixel_size = header->size;
-	if (pixel_size != dim_org->height *
+	if (header->compression == BITMAP_COMPRESSION_NONE &&
+	    pixel_size != dim_org->height *
 		ROUNDUP(dim_org->width * header->bits_per_pixel / 8, 4)) {
 		LOG("Bitmap pixel array size does not match expected size\n");
 		return CBGFX_ERROR_BITMAP_DATA;
@@ -0,0 +1,200 @@
+/*
+ * This file is part of the libpayload project.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Shadow framebuffer
+ *
+ * The linear framebuffer is usually mapped uncached or write-combining, so
+ * reading it back (e.g. when scrolling the console) or writing it a few bytes
+ * at a time is slow. With a shadow framebuffer all drawing goes to a copy in
+ * cached RAM and only the damaged part of every scanline is copied to the
+ * real framebuffer when the drawing call (or batch of calls) completes.
+ */
+
+#include <libpayload.h>
+#include <coreboot_tables.h>
+#if CONFIG(LP_ARCH_X86)
+#include <arch/cpuid.h>
+#endif
+#include "shadowfb.h"
+
+static uint8_t *real_fb;
+static uint8_t *shadow;
+static int initialized;
+
+static int32_t width;
+static int32_t height;
+static int32_t bytes_per_line;
+static int32_t bytes_per_pixel;
+
+/* Damaged span [x0, x1) of every scanline and the range of damaged lines. */
+static int32_t *span_x0;
+static int32_t *span_x1;
+static int32_t dirty_y0;
+static int32_t dirty_y1;
+
+static int batch_depth;
+static int use_movnti;
+
+static void reset_damage(void)
+{
+	int32_t y;
+
+	for (y = dirty_y0; y < dirty_y1; y++) {
+		span_x0[y] = width;
+		span_x1[y] = 0;
+	}
+	dirty_y0 = height;
+	dirty_y1 = 0;
+}
+
+void *shadowfb_init(const struct cb_framebuffer *fbinfo, void *fb)
+{
+	size_t size;
+
+	if (initialized)
+		return shadow ? shadow : fb;
+	initialized = 1;
+
+	width = fbinfo->x_resolution;
+	height = fbinfo->y_resolution;
+	bytes_per_line = fbinfo->bytes_per_line;
+	bytes_per_pixel = fbinfo->bits_per_pixel / 8;
+	size = bytes_per_line * height;
+
+	shadow = malloc(size);
+	span_x0 = malloc(height * sizeof(*span_x0));
+	span_x1 = malloc(height * sizeof(*span_x1));
+	if (!shadow || !span_x0 || !span_x1) {
+		printf("shadowfb: can't allocate %zu bytes, drawing directly\n",
+		       size);
+		free(shadow);
+		free(span_x0);
+		free(span_x1);
+		shadow = NULL;
+		return fb;
+	}
+
+	real_fb = fb;
+	/* Keep whatever is on screen already (e.g. a boot splash). */
+	memcpy(shadow, real_fb, size);
+
+	dirty_y0 = 0;
+	dirty_y1 = height;
+	reset_damage();
+
+#if CONFIG(LP_ARCH_X86)
+	/* MOVNTI only needs SSE2 support, not SSE register state. */
+	u32 eax, ebx, ecx, edx;
+	cpuid(1, eax, ebx, ecx, edx);
+	use_movnti = !!(edx & (1 << 26));
+#endif
+
+	return shadow;
+}
+
+void shadowfb_damage(int x, int y, int w, int h)
+{
+	int32_t x1, y1;
+
+	if (!shadow)
+		return;
+
+	x1 = MIN(x + w, width);
+	y1 = MIN(y + h, height);
+	x = MAX(x, 0);
+	y = MAX(y, 0);
+	if (x >= x1 || y >= y1)
+		return;
+
+	dirty_y0 = MIN(dirty_y0, y);
+	dirty_y1 = MAX(dirty_y1, y1);
+	for (; y < y1; y++) {
+		span_x0[y] = MIN(span_x0[y], x);
+		span_x1[y] = MAX(span_x1[y], x1);
+	}
+}
+
+/*
+ * Copy a span to the framebuffer without pulling it into the cache. Streaming
+ * stores are combined into full bus bursts and don't evict the shadow copy.
+ */
+static void copy_span(uint8_t *dst, const uint8_t *src, size_t len)
+{
+#if CONFIG(LP_ARCH_X86)
+	if (use_movnti && !((uintptr_t)dst & 3) && !((uintptr_t)src & 3)) {
+		size_t words = len / 4;
+
+		while (words--) {
+			asm volatile ("movnti %1, %0"
+				      : "=m" (*(u32 *)dst)
+				      : "r" (*(const u32 *)src));
+			dst += 4;
+			src += 4;
+		}
+		len &= 3;
+	}
+#endif
+	memcpy(dst, src, len);
+}
+
+void shadowfb_flush(void)
+{
+	int32_t y;
+
+	if (!shadow || batch_depth || dirty_y0 >= dirty_y1)
+		return;
+
+	for (y = dirty_y0; y < dirty_y1; y++) {
+		const size_t offset = y * bytes_per_line +
+				      span_x0[y] * bytes_per_pixel;
+
+		if (span_x0[y] >= span_x1[y])
+			continue;
+		copy_span(real_fb + offset, shadow + offset,
+			  (span_x1[y] - span_x0[y]) * bytes_per_pixel);
+	}
+
+#if CONFIG(LP_ARCH_X86)
+	if (use_movnti)
+		asm volatile ("sfence" ::: "memory");
+#endif
+
+	reset_damage();
+}
+
+void shadowfb_batch_begin(void)
+{
+	batch_depth++;
+}
+
+void shadowfb_batch_end(void)
+{
+	if (batch_depth > 0)
+		batch_depth--;
+	shadowfb_flush();
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the libpayload project.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __SHADOWFB_H__
+#define __SHADOWFB_H__
+
+#include <libpayload.h>
+#include <coreboot_tables.h>
+
+#if CONFIG(LP_FRAMEBUFFER_SHADOW)
+
+/*
+ * Set up the shadow framebuffer for the framebuffer at fb and return the
+ * address drivers should draw to. This is the cached shadow copy or, if it
+ * can't be allocated, fb itself. Safe to call from several drivers.
+ */
+void *shadowfb_init(const struct cb_framebuffer *fbinfo, void *fb);
+
+/* Record that the given pixel rectangle of the shadow copy was modified. */
+void shadowfb_damage(int x, int y, int width, int height);
+
+/* Copy all damaged pixels to the real framebuffer, unless in a batch. */
+void shadowfb_flush(void);
+
+/* Defer flushes until the matching shadowfb_batch_end(). Batches nest. */
+void shadowfb_batch_begin(void);
+void shadowfb_batch_end(void);
+
+#else
+
+static inline void *shadowfb_init(const struct cb_framebuffer *fbinfo,
+				  void *fb)
+{
+	return fb;
+}
+static inline void shadowfb_damage(int x, int y, int width, int height) {}
+static inline void shadowfb_flush(void) {}
+static inline void shadowfb_batch_begin(void) {}
+static inline void shadowfb_batch_end(void) {}
+
+#endif
+
+#endif /* __SHADOWFB_H__ */
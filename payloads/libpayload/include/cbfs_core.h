@@ -275,6 +275,19 @@ struct cbfs_handle {
  * Caller is responsible to free() returned handle after use. */
 struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name);
 
+/* Looks up |count| files by name and maps their raw (still compressed)
+ * contents, going over the media once in ascending offset order. maps[i] is
+ * set to NULL for files that are missing or cannot be mapped, and sizes[i]
+ * (if |sizes| is not NULL) to the mapped length. Mappings are released with
+ * media->unmap(). Returns the number of files mapped. */
+size_t cbfs_map_files(struct cbfs_media *media, const char *const names[],
+		      void *maps[], size_t sizes[], size_t count);
+
+/* Lookups are served from a directory cache that is built on first use of a
+ * media. Call this when the CBFS behind |media| (or CBFS_DEFAULT_MEDIA) has
+ * changed so that the next lookup reads the directory again. */
+void cbfs_invalidate_cache(struct cbfs_media *media);
+
 /* Given a cbfs_handle and an attribute tag, return a mapping for the first
  * instance of the attribute or NULL if none found. */
 void *cbfs_get_attr(struct cbfs_handle *handle, uint32_t tag);
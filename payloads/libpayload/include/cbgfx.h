@@ -43,6 +43,8 @@
 #define CBGFX_ERROR_BOUNDARY		3
 /* invalid parameter */
 #define CBGFX_ERROR_INVALID_PARAMETER	4
+/* failed to allocate memory */
+#define CBGFX_ERROR_MEMORY		5
 /* bitmap error: signature mismatch */
 #define CBGFX_ERROR_BITMAP_SIGNATURE	0x10
 /* bitmap error: unsupported format */
@@ -124,6 +126,18 @@ int clear_canvas(const struct rgb_color *rgb);
  */
 int clear_screen(const struct rgb_color *rgb);
 
+/**
+ * Batch drawing calls into one frame
+ *
+ * With CONFIG_LP_FRAMEBUFFER_SHADOW, drawing calls made between
+ * cbgfx_begin_frame() and cbgfx_present_frame() only update the cached shadow
+ * framebuffer. cbgfx_present_frame() then copies everything that changed to
+ * the screen at once. Calls nest. Without a shadow framebuffer, drawing goes
+ * straight to the screen and these are no-ops.
+ */
+void cbgfx_begin_frame(void);
+void cbgfx_present_frame(void);
+
 /**
  * Draw a bitmap image using position and size relative to the canvas
  *
@@ -144,6 +158,11 @@ int clear_screen(const struct rgb_color *rgb);
  * 'Pivot' is a point of the image based on which the image is positioned.
  * For example, if a pivot is set to PIVOT_H_CENTER|PIVOT_V_CENTER, the image is
  * positioned so that pos_rel matches the center of the image.
+ *
+ * Only 8bpp palettized bitmaps are supported. The pixel array may be stored
+ * uncompressed, BI_RLE8-compressed or, with CONFIG_LP_LZ4, as an LZ4 frame
+ * (see BITMAP_COMPRESSION_LZ4). Compressed pixel arrays are decoded row by
+ * row while drawing.
  */
 int draw_bitmap(const void *bitmap, size_t size,
 		const struct scale *pos_rel, const struct scale *dim_rel,
@@ -47,4 +47,22 @@ size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn);
 /* Same as ulz4fn() but does not perform any bounds checks. */
 size_t ulz4f(const void *src, void *dst);
 
+/* State for decompressing an LZ4F image one block at a time. */
+struct lz4_stream {
+	const void *src;
+	const void *in;
+	size_t srcn;
+	size_t max_block_size;	/* largest block the frame may contain */
+	int has_block_checksum;
+};
+
+/* Parses the LZ4F frame header at src, which is srcn bytes long, and prepares
+ * stream for ulz4f_stream_next(). Returns 0 on success or -1 on error. */
+int ulz4f_stream_init(struct lz4_stream *stream, const void *src, size_t srcn);
+
+/* Decompresses the next block of the frame to dst, writing at most dstn bytes.
+ * A dst of stream->max_block_size bytes can hold any block. Returns the amount
+ * of decompressed bytes, 0 at the end of the frame, or -1 on error. */
+int ulz4f_stream_next(struct lz4_stream *stream, void *dst, size_t dstn);
+
 #endif /* __LZ4_H_ */
@@ -33,4 +33,9 @@
 #define cpuid(fn, eax, ebx, ecx, edx) \
 	asm("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "0"(fn))
 
+/* For leaves that take a sub-leaf index in ECX. */
+#define cpuid_count(fn, index, eax, ebx, ecx, edx) \
+	asm("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) \
+		    : "0"(fn), "2"(index))
+
 #endif
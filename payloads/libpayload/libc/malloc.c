@@ -29,12 +29,18 @@
  */
 
 /*
- * This is a classically weak malloc() implementation. We have a relatively
- * small and static heap, so we take the easy route with an O(N) loop
- * through the tree for every malloc() and free(). Obviously, this doesn't
- * scale past a few hundred KB (if that).
+ * This is a segregated-fit allocator. Every block starts with a header word
+ * holding its size and state; free blocks also repeat that word in their
+ * last bytes (a boundary tag), so both neighbours of a block can be reached
+ * in constant time and free() coalesces without walking the heap.
  *
- * We're also susceptible to the usual buffer overrun poisoning, though the
+ * Free blocks are threaded onto doubly linked lists, one per size class.
+ * Sizes below SMALL_LIMIT get one exact-size list each; larger blocks are
+ * binned by power of two, and each of those bins is kept sorted by size so
+ * that its first fitting entry is also the best fit. A bitmap of non-empty
+ * bins lets alloc() skip straight to a list that can satisfy the request.
+ *
+ * We're still susceptible to the usual buffer overrun poisoning, though the
  * risk is within acceptable ranges for this implementation (don't overrun
  * your buffers, kids!).
  */
@@ -43,10 +49,49 @@
 #include <libpayload.h>
 #include <stdint.h>
 
+typedef u64 hdrtype_t;
+#define HDRSIZE (sizeof(hdrtype_t))
+
+#define SIZE_BITS ((HDRSIZE << 3) - 8)
+#define MAGIC     (((hdrtype_t)0x2a) << (SIZE_BITS + 2))
+#define FLAG_PREV_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 1))
+#define FLAG_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 0))
+#define MAX_SIZE  ((((hdrtype_t)0x01) << SIZE_BITS) - 1)
+
+#define SIZE(_h) ((_h) & MAX_SIZE)
+
+#define _HEADER(_s, _f) ((hdrtype_t) (MAGIC | (_f) | ((_s) & MAX_SIZE)))
+
+#define FREE_BLOCK(_s) _HEADER(_s, FLAG_FREE)
+#define USED_BLOCK(_s) _HEADER(_s, 0)
+
+#define IS_FREE(_h) (((_h) & (MAGIC | FLAG_FREE)) == (MAGIC | FLAG_FREE))
+#define HAS_MAGIC(_h) (((_h) & MAGIC) == MAGIC)
+
+/* Free list linkage, stored in the payload area of a free block. */
+struct free_block {
+	struct free_block *next;
+	struct free_block *prev;
+};
+
+#define BLOCK_HEADER(_b) ((hdrtype_t *)((void *)(_b) - HDRSIZE))
+#define BLOCK_LINKS(_h) ((struct free_block *)((void *)(_h) + HDRSIZE))
+
+/* Smallest payload that can hold the list linkage plus the boundary tag. */
+#define MIN_BLOCK_SIZE ALIGN_UP(sizeof(struct free_block) + HDRSIZE, HDRSIZE)
+
+#define SMALL_LIMIT	256
+#define NUM_SMALL_BINS	(SMALL_LIMIT / HDRSIZE)
+#define NUM_LARGE_BINS	32
+#define NUM_BINS	(NUM_SMALL_BINS + NUM_LARGE_BINS)
+
 struct memory_type {
 	void *start;
 	void *end;
 	struct align_region_t* align_regions;
+	int initialized;
+	u32 bin_map[(NUM_BINS + 31) / 32];
+	struct free_block *bins[NUM_BINS];
 #if CONFIG(LP_DEBUG_MALLOC)
 	int magic_initialized;
 	size_t minimal_free;
@@ -56,33 +101,16 @@ struct memory_type {
 
 extern char _heap, _eheap;	/* Defined in the ldscript. */
 
-static struct memory_type default_type =
-	{ (void *)&_heap, (void *)&_eheap, NULL
+static struct memory_type default_type = {
+	.start = (void *)&_heap,
+	.end = (void *)&_eheap,
 #if CONFIG(LP_DEBUG_MALLOC)
-	, 0, 0, "HEAP"
+	.name = "HEAP",
 #endif
-	};
+};
 static struct memory_type *const heap = &default_type;
 static struct memory_type *dma = &default_type;
 
-typedef u64 hdrtype_t;
-#define HDRSIZE (sizeof(hdrtype_t))
-
-#define SIZE_BITS ((HDRSIZE << 3) - 7)
-#define MAGIC     (((hdrtype_t)0x2a) << (SIZE_BITS + 1))
-#define FLAG_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 0))
-#define MAX_SIZE  ((((hdrtype_t)0x01) << SIZE_BITS) - 1)
-
-#define SIZE(_h) ((_h) & MAX_SIZE)
-
-#define _HEADER(_s, _f) ((hdrtype_t) (MAGIC | (_f) | ((_s) & MAX_SIZE)))
-
-#define FREE_BLOCK(_s) _HEADER(_s, FLAG_FREE)
-#define USED_BLOCK(_s) _HEADER(_s, 0)
-
-#define IS_FREE(_h) (((_h) & (MAGIC | FLAG_FREE)) == (MAGIC | FLAG_FREE))
-#define HAS_MAGIC(_h) (((_h) & MAGIC) == MAGIC)
-
 static int free_aligned(void* addr, struct memory_type *type);
 void print_malloc_map(void);
 
@@ -100,13 +128,11 @@ void init_dma_memory(void *start, u32 size)
 	*(hdrtype_t *)start = 0;
 
 	dma = malloc(sizeof(*dma));
+	memset(dma, 0, sizeof(*dma));
 	dma->start = start;
 	dma->end = start + size;
-	dma->align_regions = NULL;
 
 #if CONFIG(LP_DEBUG_MALLOC)
-	dma->minimal_free = 0;
-	dma->magic_initialized = 0;
 	dma->name = "DMA";
 
 	printf("Initialized cache-coherent DMA memory at [%p:%p]\n", start, start + size);
@@ -124,110 +150,226 @@ int dma_coherent(void *ptr)
 	return !dma_initialized() || (dma->start <= ptr && dma->end > ptr);
 }
 
-static void *alloc(int len, struct memory_type *type)
+static void malloc_panic(hdrtype_t header)
 {
-	hdrtype_t header;
-	hdrtype_t volatile *ptr = (hdrtype_t volatile *)type->start;
+	printf("memory allocator panic. (%s%s%s)\n",
+	       !HAS_MAGIC(header) ? " no magic " : "",
+	       SIZE(header) == 0 ? " size=0 " : "",
+	       !(header & FLAG_FREE) ? " not free " : "");
+	halt();
+}
 
-	/* Align the size. */
-	len = ALIGN_UP(len, HDRSIZE);
+static int bin_index(size_t size)
+{
+	int i;
 
-	if (!len || len > MAX_SIZE)
-		return (void *)NULL;
+	if (size < SMALL_LIMIT)
+		return size / HDRSIZE;
 
-	/* Make sure the region is setup correctly. */
-	if (!HAS_MAGIC(*ptr)) {
-		size_t size = (type->end - type->start) - HDRSIZE;
-		*ptr = FREE_BLOCK(size);
-#if CONFIG(LP_DEBUG_MALLOC)
-		type->magic_initialized = 1;
-		type->minimal_free = size;
-#endif
+	i = log2(size) - log2(SMALL_LIMIT);
+	return NUM_SMALL_BINS + MIN(i, NUM_LARGE_BINS - 1);
+}
+
+static void bin_insert(struct memory_type *type, hdrtype_t *hdr)
+{
+	size_t size = SIZE(*hdr);
+	int i = bin_index(size);
+	struct free_block *blk = BLOCK_LINKS(hdr);
+	struct free_block **link = &type->bins[i];
+	struct free_block *prev = NULL;
+
+	/* Large bins are kept sorted so that the first fit is the best fit. */
+	if (i >= NUM_SMALL_BINS) {
+		while (*link && SIZE(*BLOCK_HEADER(*link)) < size) {
+			prev = *link;
+			link = &prev->next;
+		}
 	}
 
-	/* Find some free space. */
-	do {
-		header = *ptr;
-		int size = SIZE(header);
+	blk->next = *link;
+	blk->prev = prev;
+	if (blk->next)
+		blk->next->prev = blk;
+	*link = blk;
 
-		if (!HAS_MAGIC(header) || size == 0) {
-			printf("memory allocator panic. (%s%s)\n",
-			       !HAS_MAGIC(header) ? " no magic " : "",
-				   size == 0 ? " size=0 " : "");
-			halt();
-		}
+	type->bin_map[i / 32] |= 1U << (i % 32);
+}
 
-		if (header & FLAG_FREE) {
-			if (len <= size) {
-				hdrtype_t volatile *nptr = (hdrtype_t volatile *)((uintptr_t)ptr + HDRSIZE + len);
-				int nsize = size - (HDRSIZE + len);
-
-				/* If there is still room in this block,
-				 * then mark it as such otherwise account
-				 * the whole space for that block.
-				 */
-
-				if (nsize > 0) {
-					/* Mark the block as used. */
-					*ptr = USED_BLOCK(len);
-
-					/* Create a new free block. */
-					*nptr = FREE_BLOCK(nsize);
-				} else {
-					/* Mark the block as used. */
-					*ptr = USED_BLOCK(size);
-				}
+static void bin_remove(struct memory_type *type, hdrtype_t *hdr)
+{
+	int i = bin_index(SIZE(*hdr));
+	struct free_block *blk = BLOCK_LINKS(hdr);
+
+	if (blk->prev)
+		blk->prev->next = blk->next;
+	else
+		type->bins[i] = blk->next;
+	if (blk->next)
+		blk->next->prev = blk->prev;
+
+	if (!type->bins[i])
+		type->bin_map[i / 32] &= ~(1U << (i % 32));
+}
 
-				return (void *)((uintptr_t)ptr + HDRSIZE);
-			}
-		}
+/*
+ * Turn the block at hdr into a free block of the given size and file it. The
+ * caller guarantees that neither neighbour is free, so the block never needs
+ * FLAG_PREV_FREE itself.
+ */
+static void set_free(struct memory_type *type, hdrtype_t *hdr, size_t size)
+{
+	hdrtype_t *next = (void *)hdr + HDRSIZE + size;
+
+	*hdr = FREE_BLOCK(size);
+	*(next - 1) = *hdr;
+	if ((void *)next < type->end)
+		*next |= FLAG_PREV_FREE;
+
+	bin_insert(type, hdr);
+}
+
+/* Return a block to the free lists, merging it with free neighbours. */
+static void release(struct memory_type *type, hdrtype_t *hdr, size_t size)
+{
+	hdrtype_t *next = (void *)hdr + HDRSIZE + size;
+
+	if ((void *)next < type->end && IS_FREE(*next)) {
+		bin_remove(type, next);
+		size += HDRSIZE + SIZE(*next);
+		*next = 0;
+	}
 
-		ptr = (hdrtype_t volatile *)((uintptr_t)ptr + HDRSIZE + size);
+	if (*hdr & FLAG_PREV_FREE) {
+		hdrtype_t tag = *(hdr - 1);
+		hdrtype_t *prev = (void *)hdr - HDRSIZE - SIZE(tag);
 
-	} while (ptr < (hdrtype_t *) type->end);
+		if (!IS_FREE(tag) || *prev != tag)
+			malloc_panic(tag);
 
-	/* Nothing available. */
-	return (void *)NULL;
+		bin_remove(type, prev);
+		size += HDRSIZE + SIZE(tag);
+		*hdr = 0;
+		hdr = prev;
+	}
+
+	set_free(type, hdr, size);
 }
 
-static void _consolidate(struct memory_type *type)
+/*
+ * Mark the (unlinked) block at hdr as used with room for len bytes, handing
+ * back any tail that is large enough to form a block of its own.
+ */
+static void carve(struct memory_type *type, hdrtype_t *hdr, size_t len)
 {
-	void *ptr = type->start;
+	size_t size = SIZE(*hdr);
+	hdrtype_t prev_free = *hdr & FLAG_PREV_FREE;
 
-	while (ptr < type->end) {
-		void *nptr;
-		hdrtype_t hdr = *((hdrtype_t *) ptr);
-		unsigned int size = 0;
+	if (size >= len + HDRSIZE + MIN_BLOCK_SIZE) {
+		hdrtype_t *tail = (void *)hdr + HDRSIZE + len;
+		size_t tsize = size - len - HDRSIZE;
+
+		*hdr = USED_BLOCK(len) | prev_free;
+		*tail = USED_BLOCK(tsize);
+		release(type, tail, tsize);
+	} else {
+		hdrtype_t *next = (void *)hdr + HDRSIZE + size;
 
-		if (!IS_FREE(hdr)) {
-			ptr += HDRSIZE + SIZE(hdr);
+		*hdr = USED_BLOCK(size) | prev_free;
+		if ((void *)next < type->end)
+			*next &= ~FLAG_PREV_FREE;
+	}
+}
+
+static hdrtype_t *find_fit(struct memory_type *type, size_t len)
+{
+	const int first = bin_index(len);
+	int i = first;
+
+	while (i < NUM_BINS) {
+		u32 map = type->bin_map[i / 32] >> (i % 32);
+		struct free_block *blk;
+
+		if (!map) {
+			i = ALIGN_UP(i + 1, 32);
 			continue;
 		}
+		i += __ffs(map);
+
+		/*
+		 * Only the bin that len itself maps to can hold blocks that
+		 * are too small, and only if it is a (sorted) large bin.
+		 */
+		blk = type->bins[i];
+		if (i == first && i >= NUM_SMALL_BINS) {
+			while (blk && SIZE(*BLOCK_HEADER(blk)) < len)
+				blk = blk->next;
+			if (!blk) {
+				i++;
+				continue;
+			}
+		}
 
-		size = SIZE(hdr);
-		nptr = ptr + HDRSIZE + SIZE(hdr);
+		if (!IS_FREE(*BLOCK_HEADER(blk)) || SIZE(*BLOCK_HEADER(blk)) == 0)
+			malloc_panic(*BLOCK_HEADER(blk));
 
-		while (nptr < type->end) {
-			hdrtype_t nhdr = *((hdrtype_t *) nptr);
+		return BLOCK_HEADER(blk);
+	}
 
-			if (!(IS_FREE(nhdr)))
-				break;
+	return NULL;
+}
 
-			size += SIZE(nhdr) + HDRSIZE;
+static void init_type(struct memory_type *type)
+{
+	hdrtype_t *hdr = type->start;
+	size_t size;
 
-			*((hdrtype_t *) nptr) = 0;
+	type->end = type->start +
+		ALIGN_DOWN((size_t)(type->end - type->start), HDRSIZE);
+	size = (type->end - type->start) - HDRSIZE;
 
-			nptr += (HDRSIZE + SIZE(nhdr));
-		}
+	memset(type->bin_map, 0, sizeof(type->bin_map));
+	memset(type->bins, 0, sizeof(type->bins));
 
-		*((hdrtype_t *) ptr) = FREE_BLOCK(size);
-		ptr = nptr;
-	}
+	*hdr = USED_BLOCK(size);
+	set_free(type, hdr, size);
+	type->initialized = 1;
+#if CONFIG(LP_DEBUG_MALLOC)
+	type->magic_initialized = 1;
+	type->minimal_free = size;
+#endif
+}
+
+static void *alloc(int len, struct memory_type *type)
+{
+	hdrtype_t *hdr;
+
+	/* Align the size. */
+	len = ALIGN_UP(len, HDRSIZE);
+
+	if (!len || len > MAX_SIZE)
+		return (void *)NULL;
+
+	/* Every block must be able to hold the free list linkage later. */
+	if (len < MIN_BLOCK_SIZE)
+		len = MIN_BLOCK_SIZE;
+
+	/* Make sure the region is setup correctly. */
+	if (!type->initialized)
+		init_type(type);
+
+	hdr = find_fit(type, len);
+	if (!hdr)
+		return (void *)NULL;
+
+	bin_remove(type, hdr);
+	carve(type, hdr, len);
+
+	return (void *)hdr + HDRSIZE;
 }
 
 void free(void *ptr)
 {
-	hdrtype_t hdr;
+	hdrtype_t *hdr;
 	struct memory_type *type = heap;
 
 	/* Sanity check. */
@@ -239,19 +381,17 @@ void free(void *ptr)
 
 	if (free_aligned(ptr, type)) return;
 
-	ptr -= HDRSIZE;
-	hdr = *((hdrtype_t *) ptr);
+	hdr = ptr - HDRSIZE;
 
 	/* Not our header (we're probably poisoned). */
-	if (!HAS_MAGIC(hdr))
+	if (!HAS_MAGIC(*hdr))
 		return;
 
 	/* Double free. */
-	if (hdr & FLAG_FREE)
+	if (*hdr & FLAG_FREE)
 		return;
 
-	*((hdrtype_t *) ptr) = FREE_BLOCK(SIZE(hdr));
-	_consolidate(type);
+	release(type, hdr, SIZE(*hdr));
 }
 
 void *malloc(size_t size)
@@ -277,41 +417,54 @@ void *calloc(size_t nmemb, size_t size)
 
 void *realloc(void *ptr, size_t size)
 {
-	void *ret, *pptr;
-	unsigned int osize;
+	void *ret;
+	hdrtype_t *hdr, *next;
+	size_t osize, len;
 	struct memory_type *type = heap;
 
 	if (ptr == NULL)
 		return alloc(size, type);
 
-	pptr = ptr - HDRSIZE;
+	hdr = ptr - HDRSIZE;
 
-	if (!HAS_MAGIC(*((hdrtype_t *) pptr)))
+	if (!HAS_MAGIC(*hdr))
 		return NULL;
 
 	if (ptr < type->start || ptr >= type->end)
 		type = dma;
 
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+
 	/* Get the original size of the block. */
-	osize = SIZE(*((hdrtype_t *) pptr));
+	osize = SIZE(*hdr);
+	len = MAX(ALIGN_UP(size, HDRSIZE), MIN_BLOCK_SIZE);
+
+	/* Grow in place if the following block is free and big enough. */
+	next = ptr + osize;
+	if (len > osize && (void *)next < type->end && IS_FREE(*next) &&
+	    osize + HDRSIZE + SIZE(*next) >= len) {
+		bin_remove(type, next);
+		*hdr = USED_BLOCK(osize + HDRSIZE + SIZE(*next)) |
+		       (*hdr & FLAG_PREV_FREE);
+		*next = 0;
+	}
 
-	/*
-	 * Free the memory to update the tables - this won't touch the actual
-	 * memory, so we can still use it for the copy after we have
-	 * reallocated the new space.
-	 */
-	free(ptr);
-	ret = alloc(size, type);
+	/* Shrinking (or successful growth) keeps the data where it is. */
+	if (len <= SIZE(*hdr)) {
+		carve(type, hdr, len);
+		return ptr;
+	}
 
-	/*
-	 * if ret == NULL, then doh - failure.
-	 * if ret == ptr then woo-hoo! no copy needed.
-	 */
-	if (ret == NULL || ret == ptr)
-		return ret;
+	ret = alloc(size, type);
+	if (ret == NULL)
+		return NULL;
 
 	/* Copy the memory to the new location. */
-	memcpy(ret, ptr, osize > size ? size : osize);
+	memcpy(ret, ptr, osize);
+	free(ptr);
 
 	return ret;
 }
@@ -561,7 +714,10 @@ again:
 			break;
 		}
 
-		/* FIXME: Verify the size of the block. */
+		if ((hdr & FLAG_FREE) &&
+		    *(hdrtype_t *)(ptr + SIZE(hdr)) != hdr)
+			printf("%s %x: Boundary tag mismatch\n", type->name,
+			       (unsigned int)(ptr - type->start));
 
 		printf("%s %x: %s (%llx bytes)\n", type->name,
 		       (unsigned int)(ptr - type->start),
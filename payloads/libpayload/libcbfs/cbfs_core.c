@@ -136,36 +136,69 @@ static int get_cbfs_range(uint32_t *offset, uint32_t *cbfs_end,
 	return 0;
 }
 
-/* public API starts here*/
-struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
+/*
+ * Directory cache. The first lookup on a media walks the whole CBFS once and
+ * records every file header in a small hash table, so later lookups on the
+ * same media do not have to read through the directory again. A cache is
+ * identified by the media implementation (its read callback and context), so
+ * copies of a cbfs_media struct share one cache. It is rebuilt whenever the
+ * CBFS range reported for the media changes, and can be dropped explicitly
+ * with cbfs_invalidate_cache().
+ */
+struct cbfs_dir_entry {
+	uint32_t hash;
+	uint32_t name;			/* offset into names[] */
+	uint32_t media_offset;
+	uint32_t type;
+	uint32_t attribute_offset;
+	uint32_t content_offset;
+	uint32_t content_size;
+};
+
+struct cbfs_dir_cache {
+	struct cbfs_dir_cache *next;
+	int is_default;
+	void *context;
+	size_t (*read)(struct cbfs_media *media, void *dest, size_t offset,
+		       size_t count);
+	uint32_t begin, end;
+	size_t count, alloc;
+	struct cbfs_dir_entry *entries;
+	char *names;
+	size_t names_len, names_alloc;
+	uint32_t mask;
+	uint32_t *slots;		/* entry index + 1, 0 = empty */
+};
+
+static struct cbfs_dir_cache *dir_caches;
+
+/* FNV-1a */
+static uint32_t cbfs_name_hash(const char *name)
 {
-	const char *vardata;
-	uint32_t offset, cbfs_end, vardata_len;
-	struct cbfs_file file;
-	struct cbfs_handle *handle = malloc(sizeof(*handle));
-
-	if (!handle)
-		return NULL;
+	uint32_t hash = 2166136261u;
 
-	if (get_cbfs_range(&offset, &cbfs_end, media)) {
-		ERROR("Failed to find cbfs range\n");
-		free(handle);
-		return NULL;
-	}
-
-	if (media == CBFS_DEFAULT_MEDIA) {
-		media = &handle->media;
-		if (init_default_cbfs_media(media) != 0) {
-			ERROR("Failed to initialize default media.\n");
-			free(handle);
-			return NULL;
-		}
-	} else {
-		memcpy(&handle->media, media, sizeof(*media));
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
 	}
+	return hash;
+}
 
-	DEBUG("CBFS location: 0x%x~0x%x\n", offset, cbfs_end);
-	DEBUG("Looking for '%s' starting from 0x%x.\n", name, offset);
+/*
+ * Walks all file headers between offset and cbfs_end, calling fn() with the
+ * file name for each of them. Stops early and returns the value of fn() as
+ * soon as that is non-zero, otherwise returns 0 at the end of the CBFS.
+ */
+static int cbfs_walk(struct cbfs_media *media, uint32_t offset,
+		     uint32_t cbfs_end,
+		     int (*fn)(void *arg, const char *name,
+			       const struct cbfs_file *file, uint32_t offset),
+		     void *arg)
+{
+	const char *vardata;
+	uint32_t vardata_len;
+	struct cbfs_file file;
+	int ret = 0;
 
 	media->open(media);
 	while (offset < cbfs_end &&
@@ -191,24 +224,14 @@ struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
 				media, offset + sizeof(file), vardata_len);
 		if (vardata == CBFS_MEDIA_INVALID_MAP_ADDRESS) {
 			ERROR("ERROR: Failed to get filename: 0x%x.\n", offset);
-		} else if (strcmp(vardata, name) == 0) {
-			int file_offset = ntohl(file.offset),
-			    file_len = ntohl(file.len);
-			DEBUG("Found file (offset=0x%x, len=%d).\n",
-			    offset + file_offset, file_len);
+		} else if (strnlen(vardata, vardata_len) == vardata_len) {
+			ERROR("ERROR: Unterminated filename: 0x%x.\n", offset);
 			media->unmap(media, vardata);
-			media->close(media);
-			handle->type = ntohl(file.type);
-			handle->media_offset = offset;
-			handle->content_offset = file_offset;
-			handle->content_size = file_len;
-			handle->attribute_offset =
-				ntohl(file.attributes_offset);
-			return handle;
 		} else {
-			DEBUG(" (unmatched file @0x%x: %s)\n", offset,
-			      vardata);
+			ret = fn(arg, vardata, &file, offset);
 			media->unmap(media, vardata);
+			if (ret)
+				break;
 		}
 
 		// Move to next file.
@@ -217,11 +240,338 @@ struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
 			offset += CBFS_ALIGNMENT - (offset % CBFS_ALIGNMENT);
 	}
 	media->close(media);
-	LOG("WARNING: '%s' not found.\n", name);
-	free(handle);
+	return ret;
+}
+
+static void cbfs_fill_entry(struct cbfs_dir_entry *entry,
+			    const struct cbfs_file *file, uint32_t offset)
+{
+	entry->media_offset = offset;
+	entry->type = ntohl(file->type);
+	entry->attribute_offset = ntohl(file->attributes_offset);
+	entry->content_offset = ntohl(file->offset);
+	entry->content_size = ntohl(file->len);
+}
+
+struct cbfs_scan_arg {
+	const char *name;
+	struct cbfs_dir_entry *entry;
+};
+
+static int cbfs_scan_one(void *arg, const char *name,
+			 const struct cbfs_file *file, uint32_t offset)
+{
+	struct cbfs_scan_arg *scan = arg;
+
+	if (strcmp(name, scan->name) != 0) {
+		DEBUG(" (unmatched file @0x%x: %s)\n", offset, name);
+		return 0;
+	}
+	cbfs_fill_entry(scan->entry, file, offset);
+	return 1;
+}
+
+static int cbfs_cache_add(void *arg, const char *name,
+			  const struct cbfs_file *file, uint32_t offset)
+{
+	struct cbfs_dir_cache *dir = arg;
+	struct cbfs_dir_entry *entry;
+	size_t len = strlen(name) + 1;
+
+	if (dir->count == dir->alloc) {
+		size_t alloc = dir->alloc ? dir->alloc * 2 : 32;
+		entry = realloc(dir->entries, alloc * sizeof(*entry));
+		if (!entry)
+			return -1;
+		dir->entries = entry;
+		dir->alloc = alloc;
+	}
+	if (dir->names_len + len > dir->names_alloc) {
+		size_t alloc = MAX(dir->names_alloc * 2, dir->names_len + len);
+		char *names = realloc(dir->names, alloc);
+		if (!names)
+			return -1;
+		dir->names = names;
+		dir->names_alloc = alloc;
+	}
+
+	entry = &dir->entries[dir->count++];
+	entry->hash = cbfs_name_hash(name);
+	entry->name = dir->names_len;
+	memcpy(dir->names + dir->names_len, name, len);
+	dir->names_len += len;
+	cbfs_fill_entry(entry, file, offset);
+	return 0;
+}
+
+static const struct cbfs_dir_entry *cbfs_cache_find(
+		const struct cbfs_dir_cache *dir, const char *name)
+{
+	uint32_t hash = cbfs_name_hash(name);
+	uint32_t i;
+
+	for (i = hash & dir->mask; dir->slots[i]; i = (i + 1) & dir->mask) {
+		const struct cbfs_dir_entry *entry =
+			&dir->entries[dir->slots[i] - 1];
+		if (entry->hash == hash &&
+		    strcmp(dir->names + entry->name, name) == 0)
+			return entry;
+	}
 	return NULL;
 }
 
+static int cbfs_cache_index(struct cbfs_dir_cache *dir)
+{
+	size_t size = 16;
+	size_t n;
+
+	while (size < dir->count * 2)
+		size *= 2;
+	dir->slots = calloc(size, sizeof(*dir->slots));
+	if (!dir->slots)
+		return -1;
+	dir->mask = size - 1;
+
+	/* Like the linear search, let the first file of a given name win. */
+	for (n = 0; n < dir->count; n++) {
+		const char *name = dir->names + dir->entries[n].name;
+		uint32_t i = dir->entries[n].hash & dir->mask;
+
+		if (cbfs_cache_find(dir, name))
+			continue;
+		while (dir->slots[i])
+			i = (i + 1) & dir->mask;
+		dir->slots[i] = n + 1;
+	}
+	return 0;
+}
+
+static void cbfs_cache_free(struct cbfs_dir_cache *dir)
+{
+	free(dir->entries);
+	free(dir->names);
+	free(dir->slots);
+	free(dir);
+}
+
+static int cbfs_cache_match(const struct cbfs_dir_cache *dir,
+			    const struct cbfs_media *media)
+{
+	if (media == CBFS_DEFAULT_MEDIA)
+		return dir->is_default;
+	return !dir->is_default && dir->read == media->read &&
+		dir->context == media->context;
+}
+
+void cbfs_invalidate_cache(struct cbfs_media *media)
+{
+	struct cbfs_dir_cache **link = &dir_caches;
+
+	while (*link) {
+		struct cbfs_dir_cache *dir = *link;
+		if (cbfs_cache_match(dir, media)) {
+			*link = dir->next;
+			cbfs_cache_free(dir);
+		} else {
+			link = &dir->next;
+		}
+	}
+}
+
+/*
+ * Returns the directory cache for |key| (the media as passed in by the
+ * caller, possibly CBFS_DEFAULT_MEDIA), building it through |media| if
+ * necessary. Returns NULL if the cache cannot be built, in which case the
+ * caller has to fall back to searching the media directly.
+ */
+static struct cbfs_dir_cache *cbfs_get_cache(struct cbfs_media *key,
+					     struct cbfs_media *media,
+					     uint32_t offset, uint32_t cbfs_end)
+{
+	struct cbfs_dir_cache *dir;
+
+	for (dir = dir_caches; dir; dir = dir->next) {
+		if (!cbfs_cache_match(dir, key))
+			continue;
+		if (dir->begin == offset && dir->end == cbfs_end)
+			return dir;
+		DEBUG("CBFS range changed, dropping directory cache.\n");
+		cbfs_invalidate_cache(key);
+		break;
+	}
+
+	dir = calloc(1, sizeof(*dir));
+	if (!dir)
+		return NULL;
+	if (key == CBFS_DEFAULT_MEDIA) {
+		dir->is_default = 1;
+	} else {
+		dir->read = key->read;
+		dir->context = key->context;
+	}
+	dir->begin = offset;
+	dir->end = cbfs_end;
+
+	DEBUG("Building CBFS directory cache for 0x%x~0x%x.\n",
+	      offset, cbfs_end);
+	if (cbfs_walk(media, offset, cbfs_end, cbfs_cache_add, dir) ||
+	    cbfs_cache_index(dir)) {
+		ERROR("Failed to build CBFS directory cache.\n");
+		cbfs_cache_free(dir);
+		return NULL;
+	}
+
+	dir->next = dir_caches;
+	dir_caches = dir;
+	return dir;
+}
+
+/*
+ * Sets up |media| for accessing |orig| (initializing the default media if
+ * necessary) and looks up the CBFS range on it.
+ */
+static int cbfs_open_range(struct cbfs_media *orig, struct cbfs_media *media,
+			   uint32_t *offset, uint32_t *cbfs_end)
+{
+	if (get_cbfs_range(offset, cbfs_end, orig)) {
+		ERROR("Failed to find cbfs range\n");
+		return -1;
+	}
+
+	if (orig == CBFS_DEFAULT_MEDIA) {
+		if (init_default_cbfs_media(media) != 0) {
+			ERROR("Failed to initialize default media.\n");
+			return -1;
+		}
+	} else {
+		memcpy(media, orig, sizeof(*media));
+	}
+
+	DEBUG("CBFS location: 0x%x~0x%x\n", *offset, *cbfs_end);
+	return 0;
+}
+
+/* Finds |name| through the directory cache, or by walking the media. */
+static int cbfs_lookup(struct cbfs_dir_cache *dir, struct cbfs_media *media,
+		       uint32_t offset, uint32_t cbfs_end, const char *name,
+		       struct cbfs_dir_entry *entry)
+{
+	struct cbfs_scan_arg scan = { .name = name, .entry = entry };
+	const struct cbfs_dir_entry *cached;
+
+	if (dir) {
+		cached = cbfs_cache_find(dir, name);
+		if (!cached)
+			return -1;
+		*entry = *cached;
+		return 0;
+	}
+
+	DEBUG("Looking for '%s' starting from 0x%x.\n", name, offset);
+	if (cbfs_walk(media, offset, cbfs_end, cbfs_scan_one, &scan) <= 0)
+		return -1;
+	return 0;
+}
+
+/* public API starts here*/
+struct cbfs_handle *cbfs_get_handle(struct cbfs_media *media, const char *name)
+{
+	uint32_t offset, cbfs_end;
+	struct cbfs_dir_cache *dir;
+	struct cbfs_dir_entry entry;
+	struct cbfs_handle *handle = malloc(sizeof(*handle));
+
+	if (!handle)
+		return NULL;
+
+	if (cbfs_open_range(media, &handle->media, &offset, &cbfs_end)) {
+		free(handle);
+		return NULL;
+	}
+
+	dir = cbfs_get_cache(media, &handle->media, offset, cbfs_end);
+	if (cbfs_lookup(dir, &handle->media, offset, cbfs_end, name, &entry)) {
+		LOG("WARNING: '%s' not found.\n", name);
+		free(handle);
+		return NULL;
+	}
+
+	DEBUG("Found file (offset=0x%x, len=%d).\n",
+	      entry.media_offset + entry.content_offset, entry.content_size);
+	handle->type = entry.type;
+	handle->media_offset = entry.media_offset;
+	handle->content_offset = entry.content_offset;
+	handle->content_size = entry.content_size;
+	handle->attribute_offset = entry.attribute_offset;
+	return handle;
+}
+
+size_t cbfs_map_files(struct cbfs_media *media, const char *const names[],
+		      void *maps[], size_t sizes[], size_t count)
+{
+	struct cbfs_media m;
+	struct cbfs_dir_cache *dir;
+	struct cbfs_dir_entry *entries;
+	uint32_t offset, cbfs_end;
+	size_t i, mapped = 0;
+
+	for (i = 0; i < count; i++) {
+		maps[i] = NULL;
+		if (sizes)
+			sizes[i] = 0;
+	}
+
+	if (cbfs_open_range(media, &m, &offset, &cbfs_end))
+		return 0;
+
+	entries = malloc(count * sizeof(*entries));
+	if (!entries)
+		return 0;
+
+	dir = cbfs_get_cache(media, &m, offset, cbfs_end);
+	for (i = 0; i < count; i++) {
+		if (cbfs_lookup(dir, &m, offset, cbfs_end, names[i],
+				&entries[i])) {
+			LOG("WARNING: '%s' not found.\n", names[i]);
+			entries[i].content_size = 0;
+			entries[i].media_offset = UINT32_MAX;
+		}
+	}
+
+	/* Map the files in media order so streaming media only seek forward. */
+	m.open(&m);
+	for (;;) {
+		size_t next = count;
+
+		for (i = 0; i < count; i++) {
+			if (maps[i] || entries[i].media_offset == UINT32_MAX)
+				continue;
+			if (next == count || entries[i].media_offset <
+			    entries[next].media_offset)
+				next = i;
+		}
+		if (next == count)
+			break;
+
+		maps[next] = m.map(&m, entries[next].media_offset +
+				   entries[next].content_offset,
+				   entries[next].content_size);
+		if (maps[next] == CBFS_MEDIA_INVALID_MAP_ADDRESS) {
+			ERROR("Failed to map '%s'.\n", names[next]);
+			maps[next] = NULL;
+			entries[next].media_offset = UINT32_MAX;
+			continue;
+		}
+		if (sizes)
+			sizes[next] = entries[next].content_size;
+		mapped++;
+	}
+	m.close(&m);
+
+	free(entries);
+	return mapped;
+}
+
 void *cbfs_get_contents(struct cbfs_handle *handle, size_t *size, size_t limit)
 {
 	struct cbfs_media *m = &handle->media;
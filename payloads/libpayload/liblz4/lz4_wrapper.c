@@ -112,70 +112,90 @@ struct lz4_block_header {
 	/* + uint32_t block_checksum iff has_block_checksum is set */
 } __packed;
 
+int ulz4f_stream_init(struct lz4_stream *stream, const void *src, size_t srcn)
+{
+	/* With in-place decompression the header may become invalid later. */
+	const struct lz4_frame_header *h = src;
+
+	if (srcn < sizeof(*h) + sizeof(uint64_t) + sizeof(uint8_t))
+		return -1;	/* input overrun */
+
+	/* We assume there's always only a single, standard frame. */
+	if (le32toh(h->magic) != LZ4F_MAGICNUMBER || h->version != 1)
+		return -1;	/* unknown format */
+	if (h->reserved0 || h->reserved1 || h->reserved2)
+		return -1;	/* reserved must be zero */
+	if (!h->independent_blocks)
+		return -1;	/* we don't support block dependency */
+	if (h->max_block_size < 4)
+		return -1;	/* invalid block size */
+
+	stream->src = src;
+	stream->srcn = srcn;
+	stream->has_block_checksum = h->has_block_checksum;
+	stream->max_block_size = 64 * KiB << (2 * (h->max_block_size - 4));
+
+	stream->in = src + sizeof(*h);
+	if (h->has_content_size)
+		stream->in += sizeof(uint64_t);
+	stream->in += sizeof(uint8_t);
+
+	return 0;
+}
+
+int ulz4f_stream_next(struct lz4_stream *stream, void *dst, size_t dstn)
+{
+	const void *in = stream->in;
+	int ret;
+
+	if ((size_t)(in - stream->src) + sizeof(struct lz4_block_header) >
+	    stream->srcn)
+		return -1;		/* input overrun */
+
+	struct lz4_block_header b = { .raw = le32toh(*(uint32_t *)in) };
+	in += sizeof(struct lz4_block_header);
+
+	if ((size_t)(in - stream->src) + b.size > stream->srcn)
+		return -1;		/* input overrun */
+
+	if (!b.size)
+		return 0;		/* end of frame */
+
+	if (b.not_compressed) {
+		if (b.size > dstn)
+			return -1;	/* output overrun */
+		memcpy(dst, in, b.size);
+		ret = b.size;
+	} else {
+		/* constant folding essential, do not touch params! */
+		ret = LZ4_decompress_generic(in, dst, b.size,
+				dstn, endOnInputSize,
+				full, 0, noDict, dst, NULL, 0);
+		if (ret < 0)
+			return -1;	/* decompression error */
+	}
+
+	in += b.size;
+	if (stream->has_block_checksum)
+		in += sizeof(uint32_t);
+	stream->in = in;
+
+	return ret;
+}
+
 size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn)
 {
-	const void *in = src;
+	struct lz4_stream stream;
 	void *out = dst;
-	size_t out_size = 0;
-	int has_block_checksum;
-
-	{ /* With in-place decompression the header may become invalid later. */
-		const struct lz4_frame_header *h = in;
-
-		if (srcn < sizeof(*h) + sizeof(uint64_t) + sizeof(uint8_t))
-			return 0;	/* input overrun */
-
-		/* We assume there's always only a single, standard frame. */
-		if (le32toh(h->magic) != LZ4F_MAGICNUMBER || h->version != 1)
-			return 0;	/* unknown format */
-		if (h->reserved0 || h->reserved1 || h->reserved2)
-			return 0;	/* reserved must be zero */
-		if (!h->independent_blocks)
-			return 0;	/* we don't support block dependency */
-		has_block_checksum = h->has_block_checksum;
-
-		in += sizeof(*h);
-		if (h->has_content_size)
-			in += sizeof(uint64_t);
-		in += sizeof(uint8_t);
-	}
+	int ret;
 
-	while (1) {
-		struct lz4_block_header b = { .raw = le32toh(*(uint32_t *)in) };
-		in += sizeof(struct lz4_block_header);
-
-		if ((size_t)(in - src) + b.size > srcn)
-			break;			/* input overrun */
-
-		if (!b.size) {
-			out_size = out - dst;
-			break;			/* decompression successful */
-		}
-
-		if (b.not_compressed) {
-			size_t size = MIN((uint32_t)b.size, dst + dstn - out);
-			memcpy(out, in, size);
-			if (size < b.size)
-				break;		/* output overrun */
-			else
-				out += size;
-		} else {
-			/* constant folding essential, do not touch params! */
-			int ret = LZ4_decompress_generic(in, out, b.size,
-					dst + dstn - out, endOnInputSize,
-					full, 0, noDict, out, NULL, 0);
-			if (ret < 0)
-				break;		/* decompression error */
-			else
-				out += ret;
-		}
-
-		in += b.size;
-		if (has_block_checksum)
-			in += sizeof(uint32_t);
-	}
+	if (ulz4f_stream_init(&stream, src, srcn))
+		return 0;
+
+	while ((ret = ulz4f_stream_next(&stream, out, dst + dstn - out)) > 0)
+		out += ret;
 
-	return out_size;
+	return ret < 0 ? 0 : out - dst;
 }
 
 size_t ulz4f(const void *src, void *dst)
@@ -0,0 +1,64 @@
+/*
+ * Minimal stand-in for <libpayload.h> that lets single libpayload source
+ * files be compiled into host-side test programs. The public entry points
+ * are renamed so they don't clash with the host C library.
+ */
+
+#ifndef _HOST_LIBPAYLOAD_H
+#define _HOST_LIBPAYLOAD_H
+
+#define malloc		lp_malloc
+#define free		lp_free
+#define calloc		lp_calloc
+#define realloc		lp_realloc
+#define memalign	lp_memalign
+#define dma_malloc	lp_dma_malloc
+#define dma_memalign	lp_dma_memalign
+#define log2		lp_log2
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+
+#define CONFIG(option) 0
+
+#define ALIGN(x,a)		__ALIGN_MASK(x,(typeof(x))(a)-1UL)
+#define __ALIGN_MASK(x,mask)	(((x)+(mask))&~(mask))
+#define ALIGN_UP(x,a)		ALIGN((x),(a))
+#define ALIGN_DOWN(x,a)		((x) & ~((typeof(x))(a)-1UL))
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static inline int clz(u32 x)
+{
+	return x ? __builtin_clz(x) : (int)sizeof(x) * 8;
+}
+static inline int log2(u32 x) { return (int)sizeof(x) * 8 - clz(x) - 1; }
+static inline int __ffs(u32 x) { return log2(x & (u32)(-(s32)x)); }
+
+static inline void halt(void)
+{
+	abort();
+}
+
+void *malloc(size_t size);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+void *memalign(size_t align, size_t size);
+void *dma_malloc(size_t size);
+void *dma_memalign(size_t align, size_t size);
+void init_dma_memory(void *start, u32 size);
+int dma_initialized(void);
+int dma_coherent(void *ptr);
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * Host-side allocation trace benchmark for libpayload's malloc.
+ *
+ * Replays an allocation trace against libc/malloc.c (built for the host with
+ * the shim in host/) and checks that no live block gets clobbered. A trace is
+ * a text file with one operation per line:
+ *
+ *	a <slot> <size>		allocate into slot
+ *	r <slot> <size>		realloc slot
+ *	m <slot> <align> <size>	memalign into slot
+ *	f <slot>		free slot
+ *
+ * Without a trace file a synthetic one is generated that mimics payload
+ * behaviour: mostly small, short-lived objects (USB transfer descriptors,
+ * filesystem nodes) mixed with a few large, long-lived buffers.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HEAP_SIZE	(64 * 1024 * 1024)
+#define MAX_SLOTS	4096
+#define SYNTH_OPS	200000
+
+/* The ldscript provides _heap/_eheap in a real payload. */
+asm(".bss\n"
+    ".balign 64\n"
+    ".globl _heap\n"
+    "_heap:\n"
+    ".skip 67108864\n"
+    ".globl _eheap\n"
+    "_eheap:\n"
+    ".text\n");
+
+void *lp_malloc(size_t size);
+void *lp_realloc(void *ptr, size_t size);
+void *lp_memalign(size_t align, size_t size);
+void lp_free(void *ptr);
+
+struct op {
+	char type;
+	int slot;
+	size_t align;
+	size_t size;
+};
+
+struct slot {
+	unsigned char *ptr;
+	size_t size;
+};
+
+static struct op *ops;
+static size_t num_ops;
+static struct slot slots[MAX_SLOTS];
+
+static void fail(const char *str)
+{
+	fprintf(stderr, "%s", str);
+	exit(1);
+}
+
+static void add_op(char type, int slot, size_t align, size_t size)
+{
+	static size_t capacity;
+
+	if (num_ops == capacity) {
+		capacity = capacity ? capacity * 2 : 1024;
+		ops = realloc(ops, capacity * sizeof(*ops));
+		if (!ops)
+			fail("could not grow trace\n");
+	}
+	ops[num_ops++] = (struct op){ type, slot, align, size };
+}
+
+static void read_trace(const char *name)
+{
+	FILE *f = fopen(name, "r");
+	char line[128];
+	size_t a, b;
+	int slot;
+	char type;
+
+	if (!f)
+		fail("could not open trace file\n");
+
+	while (fgets(line, sizeof(line), f)) {
+		a = b = 0;
+		if (sscanf(line, " %c %d %zu %zu", &type, &slot, &a, &b) < 2)
+			continue;
+		if (slot < 0 || slot >= MAX_SLOTS)
+			fail("slot out of range\n");
+		if (type == 'm')
+			add_op(type, slot, a, b);
+		else
+			add_op(type, slot, 0, a);
+	}
+	fclose(f);
+}
+
+static size_t synth_size(void)
+{
+	int r = rand() % 100;
+
+	if (r < 70)
+		return 8 + rand() % 120;
+	if (r < 95)
+		return 128 + rand() % 1920;
+	return 4096 + rand() % (256 * 1024);
+}
+
+static void synth_trace(void)
+{
+	char live[MAX_SLOTS] = { 0 };
+	int i, slot;
+
+	srand(1);
+	for (i = 0; i < SYNTH_OPS; i++) {
+		slot = rand() % MAX_SLOTS;
+		if (!live[slot]) {
+			if (rand() % 16 == 0) {
+				add_op('m', slot, 64 << (rand() % 4), synth_size());
+				live[slot] = 2;
+			} else {
+				add_op('a', slot, 0, synth_size());
+				live[slot] = 1;
+			}
+		} else if (live[slot] == 1 && rand() % 8 == 0) {
+			/* memalign()ed blocks can't be realloc()ed. */
+			add_op('r', slot, 0, synth_size());
+		} else {
+			add_op('f', slot, 0, 0);
+			live[slot] = 0;
+		}
+	}
+}
+
+static void check(struct slot *s, int slot)
+{
+	size_t i;
+
+	for (i = 0; i < s->size; i++)
+		if (s->ptr[i] != (unsigned char)slot)
+			fail("heap corruption detected\n");
+}
+
+static double replay(void *(*do_alloc)(size_t), void *(*do_realloc)(void *, size_t),
+		     void *(*do_memalign)(size_t, size_t), void (*do_free)(void *),
+		     int verify, size_t *failed)
+{
+	struct timespec t0, t1;
+	struct slot *s;
+	size_t i;
+
+	*failed = 0;
+	memset(slots, 0, sizeof(slots));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (i = 0; i < num_ops; i++) {
+		s = &slots[ops[i].slot];
+		if (verify && s->ptr)
+			check(s, ops[i].slot);
+
+		switch (ops[i].type) {
+		case 'a':
+		case 'm':
+			do_free(s->ptr);
+			s->ptr = ops[i].type == 'a' ? do_alloc(ops[i].size) :
+				do_memalign(ops[i].align, ops[i].size);
+			if (s->ptr && ops[i].type == 'm' &&
+			    (uintptr_t)s->ptr % ops[i].align)
+				fail("memalign returned a misaligned block\n");
+			break;
+		case 'r':
+			s->ptr = do_realloc(s->ptr, ops[i].size);
+			if (verify && s->ptr && ops[i].size > s->size)
+				memset(s->ptr + s->size, ops[i].slot,
+				       ops[i].size - s->size);
+			break;
+		case 'f':
+			do_free(s->ptr);
+			s->ptr = NULL;
+			break;
+		}
+
+		if (ops[i].type != 'f' && !s->ptr) {
+			(*failed)++;
+			s->size = 0;
+			continue;
+		}
+		s->size = s->ptr ? ops[i].size : 0;
+		if (verify && ops[i].type != 'r' && ops[i].type != 'f')
+			memset(s->ptr, ops[i].slot, s->size);
+	}
+
+	for (i = 0; i < MAX_SLOTS; i++) {
+		if (verify && slots[i].ptr)
+			check(&slots[i], i);
+		do_free(slots[i].ptr);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static void *host_memalign(size_t align, size_t size)
+{
+	void *ptr;
+
+	return posix_memalign(&ptr, align, size) ? NULL : ptr;
+}
+
+int main(int argc, char **argv)
+{
+	size_t failed;
+	double t;
+
+	if (argc > 1)
+		read_trace(argv[1]);
+	else
+		synth_trace();
+
+	printf("%zu operations, %d slots, %d KiB heap\n", num_ops, MAX_SLOTS,
+	       HEAP_SIZE / 1024);
+
+	replay(lp_malloc, lp_realloc, lp_memalign, lp_free, 1, &failed);
+	printf("libpayload: integrity ok, %zu failed allocations\n", failed);
+
+	t = replay(lp_malloc, lp_realloc, lp_memalign, lp_free, 0, &failed);
+	printf("libpayload: %8.3f ms, %6.1f ns/op\n", t * 1e3,
+	       t * 1e9 / num_ops);
+
+	t = replay(malloc, realloc, host_memalign, free, 0, &failed);
+	printf("host libc:  %8.3f ms, %6.1f ns/op\n", t * 1e3,
+	       t * 1e9 / num_ops);
+
+	return 0;
+}
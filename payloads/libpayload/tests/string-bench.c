@@ -0,0 +1,207 @@
+/*
+ * Host-side benchmark for libpayload's x86 memcpy() and memset().
+ *
+ * Includes arch/x86/string.c with its entry points renamed, checks every
+ * dispatch strategy against the host C library for all small sizes and a
+ * range of alignments, and then reports the throughput of each strategy
+ * across sizes. "auto" is what x86_string_init() picks for the host CPU.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define memcpy lp_memcpy
+#define memset lp_memset
+#include "../arch/x86/string.c"
+#undef memcpy
+#undef memset
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define BUF_SIZE	(64 * 1024 * 1024 + 64)
+#define BYTES_PER_RUN	(256 * 1024 * 1024)
+
+struct variant {
+	const char *name;
+	int sse2;
+	int erms;
+	int nt;
+	int libc;
+};
+
+static struct variant variants[] = {
+	{ "rep", 0, 0, 0, 0 },
+	{ "sse2", 1, 0, 0, 0 },
+	{ "erms", 0, 1, 0, 0 },
+	{ "sse2+nt", 1, 0, 1, 0 },
+	{ "auto", -1, -1, -1, 0 },
+	{ "libc", 0, 0, 0, 1 },
+};
+
+static const size_t sizes[] = {
+	16, 64, 256, 1024, 4096, 16384, 262144, 4 << 20, 32 << 20,
+};
+
+static const struct {
+	size_t dst, src;
+} aligns[] = {
+	{ 0, 0 }, { 0, 3 }, { 5, 9 },
+};
+
+static int cpu_sse2, cpu_erms;
+static size_t cpu_nt_threshold;
+
+static int select_variant(const struct variant *v)
+{
+	if (v->libc)
+		return 0;
+	if (v->sse2 < 0) {
+		string_features.sse2 = cpu_sse2;
+		string_features.erms = cpu_erms;
+		string_features.nt_threshold = cpu_nt_threshold;
+		return 0;
+	}
+	if ((v->sse2 && !cpu_sse2) || (v->erms && !cpu_erms))
+		return -1;
+	string_features.sse2 = v->sse2;
+	string_features.erms = v->erms;
+	/* Force the non-temporal path for everything SSE2 would handle. */
+	string_features.nt_threshold = v->nt ? SMALL_THRESHOLD : ~(size_t)0;
+	return 0;
+}
+
+static void do_memcpy(const struct variant *v, void *d, const void *s,
+		      size_t n)
+{
+	if (v->libc)
+		memcpy(d, s, n);
+	else
+		lp_memcpy(d, s, n);
+}
+
+static void do_memset(const struct variant *v, void *d, int c, size_t n)
+{
+	if (v->libc)
+		memset(d, c, n);
+	else
+		lp_memset(d, c, n);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(const struct variant *v, uint8_t *src, uint8_t *dst,
+		  uint8_t *ref)
+{
+	size_t n, so, doff, i;
+	const size_t region = 4096;
+
+	for (i = 0; i < region + 64; i++)
+		src[i] = rand();
+
+	for (so = 0; so < 16; so++)
+	for (doff = 0; doff < 16; doff++)
+	for (n = 0; n < 1100; n += (n < 300 ? 1 : 37)) {
+		memset(dst, 0xa5, region + 64);
+		memset(ref, 0xa5, region + 64);
+		do_memcpy(v, dst + doff, src + so, n);
+		memcpy(ref + doff, src + so, n);
+		if (memcmp(dst, ref, region + 64)) {
+			printf("%s: memcpy mismatch (dst+%zu, src+%zu, %zu)\n",
+			       v->name, doff, so, n);
+			exit(1);
+		}
+		do_memset(v, dst + doff, (int)so * 17, n);
+		memset(ref + doff, (int)so * 17, n);
+		if (memcmp(dst, ref, region + 64)) {
+			printf("%s: memset mismatch (dst+%zu, %zu)\n",
+			       v->name, doff, n);
+			exit(1);
+		}
+	}
+}
+
+static double bench(const struct variant *v, int is_memset, uint8_t *dst,
+		    uint8_t *src, size_t n)
+{
+	size_t reps = BYTES_PER_RUN / n, i;
+	double start;
+
+	if (reps < 4)
+		reps = 4;
+	/* Warm up (and fault in) the buffers once. */
+	do_memcpy(v, dst, src, n);
+
+	start = now();
+	for (i = 0; i < reps; i++) {
+		if (is_memset)
+			do_memset(v, dst, (int)i, n);
+		else
+			do_memcpy(v, dst, src, n);
+		asm volatile("" : : "r" (dst) : "memory");
+	}
+	return (double)n * reps / (now() - start) / 1e9;
+}
+
+int main(void)
+{
+	uint8_t *src = aligned_alloc(64, BUF_SIZE);
+	uint8_t *dst = aligned_alloc(64, BUF_SIZE);
+	uint8_t *ref = aligned_alloc(64, BUF_SIZE);
+	size_t i, s, a, op;
+
+	if (!src || !dst || !ref) {
+		printf("Out of memory\n");
+		return 1;
+	}
+	memset(src, 0x5a, BUF_SIZE);
+
+	x86_string_init();
+	cpu_sse2 = string_features.sse2;
+	cpu_erms = string_features.erms;
+	cpu_nt_threshold = string_features.nt_threshold;
+	printf("CPU: sse2=%d erms=%d nt_threshold=%zu\n\n", cpu_sse2, cpu_erms,
+	       cpu_nt_threshold);
+
+	for (i = 0; i < ARRAY_SIZE(variants); i++) {
+		if (select_variant(&variants[i]))
+			continue;
+		check(&variants[i], src, dst, ref);
+	}
+	printf("All strategies match the host C library.\n");
+
+	for (op = 0; op < 2; op++) {
+		printf("\n%s throughput (GB/s)\n%-10s %-6s", op ? "memset" :
+		       "memcpy", "size", "align");
+		for (i = 0; i < ARRAY_SIZE(variants); i++)
+			printf(" %8s", variants[i].name);
+		printf("\n");
+
+		for (s = 0; s < ARRAY_SIZE(sizes); s++)
+		for (a = 0; a < ARRAY_SIZE(aligns); a++) {
+			if (op && aligns[a].src)
+				continue;
+			printf("%-10zu %2zu/%-3zu", sizes[s], aligns[a].dst,
+			       aligns[a].src);
+			for (i = 0; i < ARRAY_SIZE(variants); i++) {
+				if (select_variant(&variants[i])) {
+					printf(" %8s", "-");
+					continue;
+				}
+				printf(" %8.2f", bench(&variants[i], op,
+					dst + aligns[a].dst,
+					src + aligns[a].src, sizes[s]));
+			}
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
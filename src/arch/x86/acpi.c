@@ -423,9 +423,53 @@ static void acpi_ssdt_write_cbtable(void)
 	acpigen_pop_len();
 }
 
+/* Return the end of the CBMEM ACPI area if the tables are written there. */
+static unsigned long acpi_tables_end(unsigned long current)
+{
+	const struct cbmem_entry *entry = cbmem_entry_find(CBMEM_ID_ACPI);
+	unsigned long start;
+
+	if (!entry)
+		return 0;
+
+	start = (unsigned long)cbmem_entry_start(entry);
+	if (current < start || current >= start + cbmem_entry_size(entry))
+		return 0;
+
+	return start + cbmem_entry_size(entry);
+}
+
+/* Let the devices generate the SSDT contents from current up to end. */
+static unsigned long acpi_fill_ssdt(unsigned long current, unsigned long end)
+{
+	unsigned long start = current;
+	struct device *dev;
+
+	acpigen_set_current((char *) current);
+	if (end)
+		acpigen_set_limit((char *) end);
+
+	/* Write object to declare coreboot tables */
+	acpi_ssdt_write_cbtable();
+
+	for (dev = all_devices; dev; dev = dev->next)
+		if (dev->ops && dev->ops->acpi_fill_ssdt_generator)
+			dev->ops->acpi_fill_ssdt_generator(dev);
+	current = (unsigned long) acpigen_get_current();
+
+	if (acpigen_overflow())
+		printk(BIOS_ERR, "ERROR: SSDT is incomplete, increase ACPI size\n");
+	else if (CONFIG(ACPI_SSDT_CACHE) && end)
+		acpi_ssdt_cache_save((void *) start, current - start);
+
+	return current;
+}
+
 void acpi_create_ssdt_generator(acpi_header_t *ssdt, const char *oem_table_id)
 {
 	unsigned long current = (unsigned long)ssdt + sizeof(acpi_header_t);
+	unsigned long end = acpi_tables_end(current);
+	size_t size;
 
 	memset((void *)ssdt, 0, sizeof(acpi_header_t));
 
@@ -438,18 +482,12 @@ void acpi_create_ssdt_generator(acpi_header_t *ssdt, const char *oem_table_id)
 	ssdt->asl_compiler_revision = asl_revision;
 	ssdt->length = sizeof(acpi_header_t);
 
-	acpigen_set_current((char *) current);
-
-	/* Write object to declare coreboot tables */
-	acpi_ssdt_write_cbtable();
-
-	{
-		struct device *dev;
-		for (dev = all_devices; dev; dev = dev->next)
-			if (dev->ops && dev->ops->acpi_fill_ssdt_generator)
-				dev->ops->acpi_fill_ssdt_generator(dev);
-		current = (unsigned long) acpigen_get_current();
-	}
+	/* The cache is only used when the end of the ACPI area is known. */
+	if (CONFIG(ACPI_SSDT_CACHE) && end &&
+	    acpi_ssdt_cache_load((void *) current, end - current, &size) == 0)
+		current += size;
+	else
+		current = acpi_fill_ssdt(current, end);
 
 	/* (Re)calculate length and checksum. */
 	ssdt->length = current - (unsigned long)ssdt;
@@ -0,0 +1,278 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * The SSDT contents generated by the devices are kept in a region file in
+ * flash, like the MRC cache. They are reused as long as the key matches, a
+ * hash of everything the generators are expected to look at: the firmware
+ * build, all devices with their IDs and resources (which covers the CPUs and
+ * the memory map), the CMOS options and VPD that drivers may consult, and the
+ * addresses the AML refers to.
+ *
+ * The region is neither verified nor measured, so the cache can't be used
+ * together with vboot (see the Kconfig option).
+ */
+
+#include <arch/acpi.h>
+#include <bootstate.h>
+#include <cbmem.h>
+#include <console/console.h>
+#include <device/device.h>
+#include <device/resource.h>
+#include <fmap.h>
+#include <ip_checksum.h>
+#include <pc80/mc146818rtc.h>
+#include <region_file.h>
+#include <security/vboot/vboot_common.h>
+#include <string.h>
+#include <version.h>
+
+/* There's no way around this include guard. option_table.h is autogenerated */
+#if CONFIG(USE_OPTION_TABLE)
+#include "option_table.h"
+#endif
+
+#define ACPI_CACHE_REGION	"RW_ACPI_CACHE"
+
+#define ACPI_CACHE_SIGNATURE	(('A'<<0)|('C'<<8)|('P'<<16)|('C'<<24))
+
+struct acpi_cache_metadata {
+	uint32_t signature;
+	uint32_t data_size;
+	uint64_t key;
+	uint16_t data_checksum;
+	uint16_t header_checksum;
+	uint32_t reserved;
+} __packed;
+
+/* 64-bit FNV-1a */
+#define KEY_OFFSET_BASIS	0xcbf29ce484222325ULL
+#define KEY_PRIME		0x100000001b3ULL
+
+static uint64_t cache_key;
+static int cache_key_valid;
+
+static uint64_t key_add(uint64_t key, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	while (size--) {
+		key ^= *p++;
+		key *= KEY_PRIME;
+	}
+
+	return key;
+}
+
+static uint64_t key_add_u64(uint64_t key, uint64_t val)
+{
+	return key_add(key, &val, sizeof(val));
+}
+
+static uint64_t key_add_str(uint64_t key, const char *str)
+{
+	return key_add(key, str, strlen(str) + 1);
+}
+
+/* Options the generators read with get_option(). */
+static uint64_t key_add_options(uint64_t key)
+{
+#if CONFIG(USE_OPTION_TABLE) && defined(LB_CKS_RANGE_START)
+	int i;
+
+	for (i = LB_CKS_RANGE_START; i <= LB_CKS_RANGE_END; i++)
+		key = key_add_u64(key, cmos_read(i));
+#endif
+	return key;
+}
+
+/* The RO and RW VPD contents, as copied to cbmem for vpd_find(). */
+static uint64_t key_add_vpd(uint64_t key)
+{
+	const struct cbmem_entry *vpd;
+
+	if (!CONFIG(VPD))
+		return key;
+
+	vpd = cbmem_entry_find(CBMEM_ID_VPD);
+	if (vpd)
+		key = key_add(key, cbmem_entry_start(vpd),
+			      cbmem_entry_size(vpd));
+
+	return key;
+}
+
+static uint64_t acpi_cache_compute_key(const void *dest)
+{
+	const struct cbmem_entry *cbtable;
+	const struct device *dev;
+	const struct resource *res;
+	uint64_t key = KEY_OFFSET_BASIS;
+
+	key = key_add_str(key, coreboot_version);
+	key = key_add_str(key, coreboot_build);
+
+	key = key_add_u64(key, (uintptr_t)dest);
+	key = key_add_u64(key, (uintptr_t)cbmem_top());
+	cbtable = cbmem_entry_find(CBMEM_ID_CBTABLE);
+	if (cbtable) {
+		key = key_add_u64(key, (uintptr_t)cbmem_entry_start(cbtable));
+		key = key_add_u64(key, cbmem_entry_size(cbtable));
+	}
+
+	key = key_add_options(key);
+	key = key_add_vpd(key);
+
+	for (dev = all_devices; dev; dev = dev->next) {
+		/* The path union may contain stale bytes, hash its name. */
+		key = key_add_str(key, dev_path(dev));
+		key = key_add_u64(key, dev->enabled | dev->hidden << 1);
+		key = key_add_u64(key, dev->vendor);
+		key = key_add_u64(key, dev->device);
+		key = key_add_u64(key, dev->class);
+		key = key_add_u64(key, dev->subsystem_vendor);
+		key = key_add_u64(key, dev->subsystem_device);
+
+		for (res = dev->resource_list; res; res = res->next) {
+			key = key_add_u64(key, res->index);
+			key = key_add_u64(key, res->flags);
+			key = key_add_u64(key, res->base);
+			key = key_add_u64(key, res->size);
+		}
+	}
+
+	return key;
+}
+
+int acpi_ssdt_cache_load(void *dest, size_t max_size, size_t *size)
+{
+	struct region_device backing_rdev;
+	struct region_device rdev;
+	struct region_file cache_file;
+	struct acpi_cache_metadata md;
+	uint16_t checksum;
+
+	/* Always generate the tables, and don't save them, in recovery. */
+	if (vboot_recovery_mode_enabled())
+		return -1;
+
+	cache_key = acpi_cache_compute_key(dest);
+	cache_key_valid = 1;
+
+	if (fmap_locate_area_as_rdev(ACPI_CACHE_REGION, &backing_rdev) < 0) {
+		printk(BIOS_ERR, "ACPI: No '%s' region\n", ACPI_CACHE_REGION);
+		cache_key_valid = 0;
+		return -1;
+	}
+
+	if (region_file_init(&cache_file, &backing_rdev) < 0 ||
+	    region_file_data(&cache_file, &rdev) < 0) {
+		printk(BIOS_DEBUG, "ACPI: No cached SSDT\n");
+		return -1;
+	}
+
+	if (rdev_readat(&rdev, &md, 0, sizeof(md)) != sizeof(md) ||
+	    md.signature != ACPI_CACHE_SIGNATURE) {
+		printk(BIOS_ERR, "ACPI: Invalid SSDT cache header\n");
+		return -1;
+	}
+
+	checksum = md.header_checksum;
+	md.header_checksum = 0;
+	if (compute_ip_checksum(&md, sizeof(md)) != checksum) {
+		printk(BIOS_ERR, "ACPI: SSDT cache header checksum mismatch\n");
+		return -1;
+	}
+
+	if (md.key != cache_key) {
+		printk(BIOS_INFO, "ACPI: Cached SSDT is stale\n");
+		return -1;
+	}
+
+	if (md.data_size > max_size ||
+	    sizeof(md) + md.data_size > region_device_sz(&rdev)) {
+		printk(BIOS_ERR, "ACPI: Cached SSDT doesn't fit\n");
+		return -1;
+	}
+
+	if (rdev_readat(&rdev, dest, sizeof(md), md.data_size) !=
+	    md.data_size) {
+		printk(BIOS_ERR, "ACPI: Couldn't read cached SSDT\n");
+		return -1;
+	}
+
+	if (compute_ip_checksum(dest, md.data_size) != md.data_checksum) {
+		printk(BIOS_ERR, "ACPI: Cached SSDT checksum mismatch\n");
+		return -1;
+	}
+
+	printk(BIOS_DEBUG, "ACPI: Using cached SSDT, %u bytes\n",
+	       md.data_size);
+	*size = md.data_size;
+
+	return 0;
+}
+
+void acpi_ssdt_cache_save(const void *data, size_t size)
+{
+	struct acpi_cache_metadata *md;
+
+	if (!cache_key_valid)
+		return;
+
+	md = cbmem_add(CBMEM_ID_ACPI_CACHE, sizeof(*md) + size);
+	if (md == NULL) {
+		printk(BIOS_ERR, "ACPI: Failed to add SSDT cache to cbmem\n");
+		return;
+	}
+
+	memset(md, 0, sizeof(*md));
+	md->signature = ACPI_CACHE_SIGNATURE;
+	md->data_size = size;
+	md->key = cache_key;
+	md->data_checksum = compute_ip_checksum(data, size);
+	md->header_checksum = compute_ip_checksum(md, sizeof(*md));
+	memcpy(&md[1], data, size);
+}
+
+/* Write the SSDT saved after a miss to flash. */
+static void update_acpi_cache(void *unused)
+{
+	const struct cbmem_entry *to_be_updated;
+	struct region_device rdev;
+	struct region_file cache_file;
+
+	to_be_updated = cbmem_entry_find(CBMEM_ID_ACPI_CACHE);
+	if (to_be_updated == NULL)
+		return;
+
+	if (fmap_locate_area_as_rdev_rw(ACPI_CACHE_REGION, &rdev) < 0) {
+		printk(BIOS_ERR, "ACPI: No '%s' region\n", ACPI_CACHE_REGION);
+		return;
+	}
+
+	if (region_file_init(&cache_file, &rdev) < 0) {
+		printk(BIOS_ERR, "ACPI: Region file invalid in '%s'\n",
+		       ACPI_CACHE_REGION);
+		return;
+	}
+
+	if (region_file_update_data(&cache_file,
+				    cbmem_entry_start(to_be_updated),
+				    cbmem_entry_size(to_be_updated)) < 0)
+		printk(BIOS_ERR, "ACPI: Failed to update SSDT cache\n");
+	else
+		printk(BIOS_DEBUG, "ACPI: Updated SSDT cache\n");
+}
+
+BOOT_STATE_INIT_ENTRY(BS_WRITE_TABLES, BS_ON_EXIT, update_acpi_cache, NULL);
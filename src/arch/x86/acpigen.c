@@ -15,9 +15,6 @@
  * GNU General Public License for more details.
  */
 
-/* How much nesting do we support? */
-#define ACPIGEN_LENSTACK_SIZE 10
-
 /*
  * If you need to change this, change acpigen_write_len_f and
  * acpigen_pop_len
@@ -28,19 +25,70 @@
 #include <lib.h>
 #include <string.h>
 #include <arch/acpigen.h>
+#include <arch/cpu.h>
 #include <assert.h>
 #include <console/console.h>
 #include <device/device.h>
+#include <cpu/x86/mp.h>
+#include <smp/spinlock.h>
+#include <timer.h>
+
+/* Context used by acpigen_set_current(), it has no end. */
+static struct acpigen_ctx default_ctx;
 
-static char *gencurrent;
+/* Context each CPU is generating into, NULL for default_ctx. */
+static struct acpigen_ctx *cpu_ctx[CONFIG_MAX_CPUS];
 
-char *len_stack[ACPIGEN_LENSTACK_SIZE];
-int ltop = 0;
+static inline struct acpigen_ctx *acpigen_ctx(void)
+{
+	struct acpigen_ctx *ctx = cpu_ctx[cpu_info()->index];
+
+	return ctx ? ctx : &default_ctx;
+}
+
+void acpigen_ctx_init(struct acpigen_ctx *ctx, char *buf, size_t size)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->start = buf;
+	ctx->current = buf;
+	if (size > ACPIGEN_CTX_GUARD)
+		ctx->end = buf + size - ACPIGEN_CTX_GUARD;
+	else
+		ctx->end = buf;
+}
+
+void acpigen_ctx_enter(struct acpigen_ctx *ctx)
+{
+	unsigned int index = cpu_info()->index;
+
+	ctx->prev = cpu_ctx[index];
+	cpu_ctx[index] = ctx;
+}
+
+void acpigen_ctx_exit(struct acpigen_ctx *ctx)
+{
+	ASSERT(cpu_ctx[cpu_info()->index] == ctx)
+	cpu_ctx[cpu_info()->index] = ctx->prev;
+
+	/* Unbalanced lengths would be patched after the context is gone. */
+	if (ctx->ltop != 0) {
+		printk(BIOS_ERR, "ACPI: %d unterminated AML lengths\n",
+		       ctx->ltop);
+		ctx->overflow = 1;
+	}
+}
 
 void acpigen_write_len_f(void)
 {
-	ASSERT(ltop < (ACPIGEN_LENSTACK_SIZE - 1))
-	len_stack[ltop++] = gencurrent;
+	struct acpigen_ctx *ctx = acpigen_ctx();
+
+	/* Leave a slot for acpigen_write_resourcetemplate_header(). */
+	ASSERT(ctx->ltop < (ACPIGEN_LENSTACK_SIZE - 1))
+	if (ctx->ltop >= (ACPIGEN_LENSTACK_SIZE - 1)) {
+		ctx->overflow = 1;
+		return;
+	}
+	ctx->len_stack[ctx->ltop++] = ctx->current;
 	acpigen_emit_byte(0);
 	acpigen_emit_byte(0);
 	acpigen_emit_byte(0);
@@ -48,10 +96,16 @@ void acpigen_write_len_f(void)
 
 void acpigen_pop_len(void)
 {
+	struct acpigen_ctx *ctx = acpigen_ctx();
 	int len;
-	ASSERT(ltop > 0)
-	char *p = len_stack[--ltop];
-	len = gencurrent - p;
+
+	ASSERT(ctx->ltop > 0)
+	if (ctx->ltop <= 0) {
+		ctx->overflow = 1;
+		return;
+	}
+	char *p = ctx->len_stack[--ctx->ltop];
+	len = ctx->current - p;
 	ASSERT(len <= ACPIGEN_MAXLEN)
 	/* generate store length for 0xfffff max */
 	p[0] = (0x80 | (len & 0xf));
@@ -62,17 +116,155 @@ void acpigen_pop_len(void)
 
 void acpigen_set_current(char *curr)
 {
-	gencurrent = curr;
+	default_ctx.start = curr;
+	default_ctx.current = curr;
+	default_ctx.end = NULL;
+	default_ctx.overflow = 0;
+}
+
+void acpigen_set_limit(char *end)
+{
+	if (end - default_ctx.current > ACPIGEN_CTX_GUARD)
+		default_ctx.end = end - ACPIGEN_CTX_GUARD;
+	else
+		default_ctx.end = default_ctx.current;
 }
 
 char *acpigen_get_current(void)
 {
-	return gencurrent;
+	return acpigen_ctx()->current;
+}
+
+int acpigen_overflow(void)
+{
+	return acpigen_ctx()->overflow;
 }
 
 void acpigen_emit_byte(unsigned char b)
 {
-	(*gencurrent++) = b;
+	struct acpigen_ctx *ctx = acpigen_ctx();
+
+	if (ctx->end && ctx->current >= ctx->end) {
+		if (!ctx->overflow)
+			printk(BIOS_ERR, "ACPI: AML buffer of %zu bytes "
+			       "overflowed\n", (size_t)(ctx->end - ctx->start));
+		ctx->overflow = 1;
+		return;
+	}
+	(*ctx->current++) = b;
+}
+
+/* State of acpigen_write_parallel(), shared with the APs. */
+static struct {
+	void (*func)(int index, void *arg);
+	void *arg;
+	char *slots;
+	size_t max_len;
+	int nslots;
+	char *out;
+	char *out_end;
+	int committed;
+	int overflow;
+} parallel_job;
+
+DECLARE_SPIN_LOCK(parallel_lock)
+
+static int parallel_committed(void)
+{
+	int committed;
+
+	spin_lock(&parallel_lock);
+	committed = parallel_job.committed;
+	spin_unlock(&parallel_lock);
+
+	return committed;
+}
+
+static void acpigen_parallel_object(void *unused, int index)
+{
+	struct acpigen_ctx ctx;
+	size_t len;
+
+	/* The slot is free once the object that used it before is appended. */
+	while (parallel_committed() <= index - parallel_job.nslots)
+		cpu_relax();
+
+	acpigen_ctx_init(&ctx, parallel_job.slots +
+			 (index % parallel_job.nslots) * parallel_job.max_len,
+			 parallel_job.max_len);
+	acpigen_ctx_enter(&ctx);
+	parallel_job.func(index, parallel_job.arg);
+	acpigen_ctx_exit(&ctx);
+	len = ctx.current - ctx.start;
+
+	/* Append the objects in index order. */
+	while (parallel_committed() != index)
+		cpu_relax();
+
+	if (ctx.overflow || parallel_job.out_end - parallel_job.out < len)
+		parallel_job.overflow = 1;
+	if (!parallel_job.overflow) {
+		memcpy(parallel_job.out, ctx.start, len);
+		parallel_job.out += len;
+	}
+
+	spin_lock(&parallel_lock);
+	parallel_job.committed++;
+	spin_unlock(&parallel_lock);
+}
+
+void acpigen_write_parallel(void (*func)(int index, void *arg), void *arg,
+			    int count, size_t max_len)
+{
+	struct acpigen_ctx *ctx = acpigen_ctx();
+	size_t space;
+	int i, nslots = 0;
+
+	/*
+	 * The objects are generated into slots of max_len bytes at the end of
+	 * the current buffer, which therefore has to have a known end. They
+	 * take at most half of the space that is left, and are reused once
+	 * their objects are appended.
+	 */
+	if (CONFIG(PARALLEL_MP_AP_WORK) && ctx->end && ctx->end > ctx->current) {
+		space = ctx->end - ctx->current;
+		nslots = MIN(space / 2 / max_len, CONFIG_MAX_CPUS);
+		nslots = MIN(nslots, count);
+	}
+
+	if (nslots < 2) {
+		for (i = 0; i < count; i++)
+			func(i, arg);
+		return;
+	}
+
+	spin_lock(&parallel_lock);
+	parallel_job.func = func;
+	parallel_job.arg = arg;
+	parallel_job.slots = ctx->end - nslots * max_len;
+	parallel_job.max_len = max_len;
+	parallel_job.nslots = nslots;
+	parallel_job.out = ctx->current;
+	parallel_job.out_end = parallel_job.slots;
+	parallel_job.committed = 0;
+	parallel_job.overflow = 0;
+	spin_unlock(&parallel_lock);
+
+	/* Objects the APs don't pick up are generated by the BSP. */
+	if (mp_run_work_items(acpigen_parallel_object, NULL, count,
+			      100 * USECS_PER_MSEC) < 0)
+		printk(BIOS_WARNING, "ACPI: Not all APs accepted to generate "
+		       "AML\n");
+
+	if (parallel_job.overflow) {
+		printk(BIOS_WARNING, "ACPI: Object larger than %zu bytes or out "
+		       "of space, generating serially\n", max_len);
+		for (i = 0; i < count; i++)
+			func(i, arg);
+		return;
+	}
+
+	ctx->current = parallel_job.out;
 }
 
 void acpigen_emit_ext_op(uint8_t op)
@@ -953,6 +1145,8 @@ void acpigen_write_io16(u16 min, u16 max, u8 align, u8 len, u8 decode16)
 
 void acpigen_write_resourcetemplate_header(void)
 {
+	struct acpigen_ctx *ctx = acpigen_ctx();
+
 	/*
 	 * A ResourceTemplate() is a Buffer() with a
 	 * (Byte|Word|DWord) containing the length, followed by one or more
@@ -962,7 +1156,8 @@ void acpigen_write_resourcetemplate_header(void)
 	acpigen_emit_byte(BUFFER_OP);
 	acpigen_write_len_f();
 	acpigen_emit_byte(WORD_PREFIX);
-	len_stack[ltop++] = acpigen_get_current();
+	ASSERT(ctx->ltop < (ACPIGEN_LENSTACK_SIZE - 1))
+	ctx->len_stack[ctx->ltop++] = ctx->current;
 	/* Add 2 dummy bytes for the ACPI word (keep aligned with
 	   the calclulation in acpigen_write_resourcetemplate() below). */
 	acpigen_emit_byte(0x00);
@@ -971,7 +1166,8 @@ void acpigen_write_resourcetemplate_header(void)
 
 void acpigen_write_resourcetemplate_footer(void)
 {
-	char *p = len_stack[--ltop];
+	struct acpigen_ctx *ctx = acpigen_ctx();
+	char *p = ctx->len_stack[--ctx->ltop];
 	int len;
 	/*
 	 * end tag (acpi 4.0 Section 6.4.2.8)
@@ -827,6 +827,13 @@ unsigned long acpi_fill_madt(unsigned long current);
 unsigned long acpi_fill_mcfg(unsigned long current);
 unsigned long acpi_fill_ivrs_ioapic(acpi_ivrs_t *ivrs, unsigned long current);
 void acpi_create_ssdt_generator(acpi_header_t *ssdt, const char *oem_table_id);
+/*
+ * Copy the cached SSDT contents for this boot to dest, which has room for
+ * max_size bytes. Returns < 0 on a miss, 0 on a hit with *size filled in.
+ */
+int acpi_ssdt_cache_load(void *dest, size_t max_size, size_t *size);
+/* Save the SSDT contents generated after a miss for the next boot. */
+void acpi_ssdt_cache_save(const void *data, size_t size);
 void acpi_write_bert(acpi_bert_t *bert, uintptr_t region, size_t length);
 void acpi_create_fadt(acpi_fadt_t *fadt, acpi_facs_t *facs, void *dsdt);
 #if CONFIG(COMMON_FADT)
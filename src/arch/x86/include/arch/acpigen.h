@@ -290,12 +290,51 @@ struct cppc_config {
 	acpi_addr_t regs[CPPC_MAX_FIELDS_VER_3];
 };
 
+/* How much nesting do we support? */
+#define ACPIGEN_LENSTACK_SIZE 10
+
+/*
+ * Bytes at the end of a bounded buffer that are never filled with AML. Some
+ * length fields are patched a few bytes past the current position, which
+ * keeps them within the buffer even after an overflow.
+ */
+#define ACPIGEN_CTX_GUARD 8
+
+/* Output buffer and open length fields of the AML being generated. */
+struct acpigen_ctx {
+	char *start;
+	char *current;
+	char *end;			/* NULL for no limit */
+	char *len_stack[ACPIGEN_LENSTACK_SIZE];
+	int ltop;
+	int overflow;			/* AML had to be dropped */
+	struct acpigen_ctx *prev;	/* context of this CPU before enter */
+};
+
+void acpigen_ctx_init(struct acpigen_ctx *ctx, char *buf, size_t size);
+/* Make the calling CPU generate AML into ctx until acpigen_ctx_exit(). */
+void acpigen_ctx_enter(struct acpigen_ctx *ctx);
+void acpigen_ctx_exit(struct acpigen_ctx *ctx);
+/*
+ * Generate count independent AML objects by calling func for each index, and
+ * append them in index order. With PARALLEL_MP_AP_WORK the objects are spread
+ * over all CPUs if the current buffer has a limit and room for two slots of
+ * max_len bytes to generate them in, otherwise they are generated one after
+ * the other.
+ */
+void acpigen_write_parallel(void (*func)(int index, void *arg), void *arg,
+			    int count, size_t max_len);
+
 void acpigen_write_return_integer(uint64_t arg);
 void acpigen_write_return_string(const char *arg);
 void acpigen_write_len_f(void);
 void acpigen_pop_len(void);
 void acpigen_set_current(char *curr);
+/* Limit AML started with acpigen_set_current() to end before end. */
+void acpigen_set_limit(char *end);
 char *acpigen_get_current(void);
+/* Returns 1 if AML was dropped because the buffer was full. */
+int acpigen_overflow(void);
 char *acpigen_write_package(int nr_el);
 void acpigen_write_zero(void);
 void acpigen_write_one(void);
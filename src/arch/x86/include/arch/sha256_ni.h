@@ -0,0 +1,45 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef ARCH_X86_SHA256_NI_H
+#define ARCH_X86_SHA256_NI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * SHA-256 using the x86 SHA extensions. The caller has to make sure the CPU
+ * supports them (CPUID.7.0:EBX[29]) as well as SSSE3 and SSE4.1. This file
+ * has no other dependencies, so that it can be built into host utilities.
+ */
+
+#define SHA256_NI_BLOCK_SIZE	64
+#define SHA256_NI_DIGEST_SIZE	32
+
+struct sha256_ni_ctx {
+	uint32_t state[8];
+	uint8_t block[SHA256_NI_BLOCK_SIZE];
+	size_t block_size;
+	uint64_t total_size;
+};
+
+/* Process a number of full blocks, updating the hash state. */
+void sha256_ni_transform(uint32_t state[8], const void *data, size_t blocks);
+
+void sha256_ni_init(struct sha256_ni_ctx *ctx);
+void sha256_ni_update(struct sha256_ni_ctx *ctx, const void *data,
+		      size_t size);
+void sha256_ni_final(struct sha256_ni_ctx *ctx,
+		     uint8_t digest[SHA256_NI_DIGEST_SIZE]);
+
+#endif /* ARCH_X86_SHA256_NI_H */
@@ -0,0 +1,214 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/sha256_ni.h>
+#include <string.h>
+
+static const uint32_t k256[64] __aligned(16) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint8_t byte_flip_mask[16] __aligned(16) = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+};
+
+static const uint32_t sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/*
+ * Only xmm0-xmm7 exist in 32-bit mode, so the register allocation is:
+ * xmm0 message + constants (implicit operand of sha256rnds2),
+ * xmm1/xmm2 state as ABEF/CDGH, xmm3-xmm6 message schedule, xmm7 scratch.
+ * The state at the start of a block is saved in memory.
+ */
+#define W0	"%%xmm3"
+#define W1	"%%xmm4"
+#define W2	"%%xmm5"
+#define W3	"%%xmm6"
+
+/* Load and byte swap four message words. */
+#define MSG_LOAD(i, w)							\
+	"movdqu " #i "*16(%[data]), %%xmm0\n\t"				\
+	"pshufb %[mask], %%xmm0\n\t"					\
+	"movdqa %%xmm0, " w "\n\t"
+
+#define MSG_COPY(w)							\
+	"movdqa " w ", %%xmm0\n\t"
+
+/* First two rounds of four, using the words in xmm0. */
+#define RNDS_LO(i)							\
+	"paddd " #i "*16(%[k]), %%xmm0\n\t"				\
+	"sha256rnds2 %%xmm0, %%xmm1, %%xmm2\n\t"
+
+#define RNDS_HI								\
+	"pshufd $0x0e, %%xmm0, %%xmm0\n\t"				\
+	"sha256rnds2 %%xmm0, %%xmm2, %%xmm1\n\t"
+
+/* Finish the next words in w_next from w and w_prev. */
+#define SCHED2(w, w_prev, w_next)					\
+	"movdqa " w ", %%xmm7\n\t"					\
+	"palignr $4, " w_prev ", %%xmm7\n\t"				\
+	"paddd %%xmm7, " w_next "\n\t"					\
+	"sha256msg2 " w ", " w_next "\n\t"
+
+#define SCHED1(w, w_prev)						\
+	"sha256msg1 " w ", " w_prev "\n\t"
+
+/* Rounds 16 to 51 all look the same. */
+#define QUAD(i, w, w_prev, w_next)					\
+	MSG_COPY(w) RNDS_LO(i) SCHED2(w, w_prev, w_next) RNDS_HI	\
+	SCHED1(w, w_prev)
+
+/* The xmm registers are only known to the compiler with SSE enabled. */
+__attribute__((target("sse2")))
+void sha256_ni_transform(uint32_t state[8], const void *data, size_t blocks)
+{
+	const uint8_t *end = (const uint8_t *)data + blocks * 64;
+	uint32_t save[8];
+
+	if (!blocks)
+		return;
+
+	asm volatile (
+		/* Rearrange the state from ABCD/EFGH to ABEF/CDGH. */
+		"movdqu (%[state]), %%xmm1\n\t"
+		"movdqu 16(%[state]), %%xmm2\n\t"
+		"pshufd $0xb1, %%xmm1, %%xmm1\n\t"
+		"pshufd $0x1b, %%xmm2, %%xmm2\n\t"
+		"movdqa %%xmm1, %%xmm7\n\t"
+		"palignr $8, %%xmm2, %%xmm1\n\t"
+		"pblendw $0xf0, %%xmm7, %%xmm2\n\t"
+
+		"1:\n\t"
+		"movdqu %%xmm1, (%[save])\n\t"
+		"movdqu %%xmm2, 16(%[save])\n\t"
+
+		MSG_LOAD(0, W0) RNDS_LO(0) RNDS_HI
+		MSG_LOAD(1, W1) RNDS_LO(1) RNDS_HI SCHED1(W1, W0)
+		MSG_LOAD(2, W2) RNDS_LO(2) RNDS_HI SCHED1(W2, W1)
+		MSG_LOAD(3, W3) RNDS_LO(3) SCHED2(W3, W2, W0) RNDS_HI
+		SCHED1(W3, W2)
+		QUAD(4, W0, W3, W1)
+		QUAD(5, W1, W0, W2)
+		QUAD(6, W2, W1, W3)
+		QUAD(7, W3, W2, W0)
+		QUAD(8, W0, W3, W1)
+		QUAD(9, W1, W0, W2)
+		QUAD(10, W2, W1, W3)
+		QUAD(11, W3, W2, W0)
+		QUAD(12, W0, W3, W1)
+		MSG_COPY(W1) RNDS_LO(13) SCHED2(W1, W0, W2) RNDS_HI
+		MSG_COPY(W2) RNDS_LO(14) SCHED2(W2, W1, W3) RNDS_HI
+		MSG_COPY(W3) RNDS_LO(15) RNDS_HI
+
+		"movdqu (%[save]), %%xmm0\n\t"
+		"paddd %%xmm0, %%xmm1\n\t"
+		"movdqu 16(%[save]), %%xmm0\n\t"
+		"paddd %%xmm0, %%xmm2\n\t"
+
+		"add $64, %[data]\n\t"
+		"cmp %[end], %[data]\n\t"
+		"jne 1b\n\t"
+
+		/* And back to ABCD/EFGH. */
+		"pshufd $0x1b, %%xmm1, %%xmm1\n\t"
+		"pshufd $0xb1, %%xmm2, %%xmm2\n\t"
+		"movdqa %%xmm1, %%xmm7\n\t"
+		"pblendw $0xf0, %%xmm2, %%xmm1\n\t"
+		"palignr $8, %%xmm7, %%xmm2\n\t"
+		"movdqu %%xmm1, (%[state])\n\t"
+		"movdqu %%xmm2, 16(%[state])\n\t"
+		: [data] "+r" (data)
+		: [end] "r" (end), [state] "r" (state), [save] "r" (save),
+		  [k] "r" (k256), [mask] "m" (byte_flip_mask)
+		: "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4",
+		  "xmm5", "xmm6", "xmm7");
+}
+
+void sha256_ni_init(struct sha256_ni_ctx *ctx)
+{
+	memcpy(ctx->state, sha256_iv, sizeof(ctx->state));
+	ctx->block_size = 0;
+	ctx->total_size = 0;
+}
+
+void sha256_ni_update(struct sha256_ni_ctx *ctx, const void *data,
+		      size_t size)
+{
+	const uint8_t *p = data;
+	size_t n;
+
+	ctx->total_size += size;
+
+	if (ctx->block_size) {
+		n = SHA256_NI_BLOCK_SIZE - ctx->block_size;
+		if (n > size)
+			n = size;
+		memcpy(&ctx->block[ctx->block_size], p, n);
+		ctx->block_size += n;
+		p += n;
+		size -= n;
+		if (ctx->block_size < SHA256_NI_BLOCK_SIZE)
+			return;
+		sha256_ni_transform(ctx->state, ctx->block, 1);
+		ctx->block_size = 0;
+	}
+
+	n = size / SHA256_NI_BLOCK_SIZE;
+	sha256_ni_transform(ctx->state, p, n);
+	p += n * SHA256_NI_BLOCK_SIZE;
+	size -= n * SHA256_NI_BLOCK_SIZE;
+
+	memcpy(ctx->block, p, size);
+	ctx->block_size = size;
+}
+
+void sha256_ni_final(struct sha256_ni_ctx *ctx,
+		     uint8_t digest[SHA256_NI_DIGEST_SIZE])
+{
+	uint64_t bits = ctx->total_size * 8;
+	size_t i;
+
+	ctx->block[ctx->block_size++] = 0x80;
+	if (ctx->block_size > SHA256_NI_BLOCK_SIZE - sizeof(bits)) {
+		memset(&ctx->block[ctx->block_size], 0,
+		       SHA256_NI_BLOCK_SIZE - ctx->block_size);
+		sha256_ni_transform(ctx->state, ctx->block, 1);
+		ctx->block_size = 0;
+	}
+	memset(&ctx->block[ctx->block_size], 0,
+	       SHA256_NI_BLOCK_SIZE - sizeof(bits) - ctx->block_size);
+	for (i = 0; i < sizeof(bits); i++)
+		ctx->block[SHA256_NI_BLOCK_SIZE - 1 - i] = bits >> (8 * i);
+	sha256_ni_transform(ctx->state, ctx->block, 1);
+
+	for (i = 0; i < SHA256_NI_DIGEST_SIZE; i++)
+		digest[i] = ctx->state[i / 4] >> (24 - 8 * (i % 4));
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <arch/cpu.h>
+#include <arch/early_variables.h>
+#include <arch/sha256_ni.h>
+#include <console/console.h>
+#include <cpu/x86/cr.h>
+#include <vb2_api.h>
+
+#define CPUID_SSSE3		(1 << 9)
+#define CPUID_SSE41		(1 << 19)
+#define CPUID_EXT_FEATURES	7
+#define CPUID_SHA		(1 << 29)
+
+static struct sha256_ni_ctx sha_ctx CAR_GLOBAL;
+
+static int sha_ni_supported(void)
+{
+	/* Some raminit code turns SSE off again while it runs. */
+	if (!(read_cr4() & CR4_OSFXSR))
+		return 0;
+
+	if (cpuid_eax(0) < CPUID_EXT_FEATURES)
+		return 0;
+
+	if ((cpuid_ecx(1) & (CPUID_SSSE3 | CPUID_SSE41)) !=
+	    (CPUID_SSSE3 | CPUID_SSE41))
+		return 0;
+
+	return !!(cpuid_ext(CPUID_EXT_FEATURES, 0).ebx & CPUID_SHA);
+}
+
+int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
+			       uint32_t data_size)
+{
+	if (hash_alg != VB2_HASH_SHA256 || !sha_ni_supported())
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
+	sha256_ni_init(car_get_var_ptr(&sha_ctx));
+
+	printk(BIOS_SPEW, "Using SHA extensions for %u byte SHA256\n",
+	       data_size);
+	return VB2_SUCCESS;
+}
+
+int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size)
+{
+	sha256_ni_update(car_get_var_ptr(&sha_ctx), buf, size);
+
+	return VB2_SUCCESS;
+}
+
+int vb2ex_hwcrypto_digest_finalize(uint8_t *digest, uint32_t digest_size)
+{
+	if (digest_size != SHA256_NI_DIGEST_SIZE)
+		return VB2_ERROR_UNKNOWN;
+
+	sha256_ni_final(car_get_var_ptr(&sha_ctx), digest);
+
+	return VB2_SUCCESS;
+}
@@ -157,6 +157,7 @@ struct cbfs_file_attribute {
 #define CBFS_FILE_ATTR_TAG_HASH 0x68736148
 #define CBFS_FILE_ATTR_TAG_POSITION 0x42435350  /* PSCB */
 #define CBFS_FILE_ATTR_TAG_ALIGNMENT 0x42434c41 /* ALCB */
+#define CBFS_FILE_ATTR_TAG_MICROCODE_INDEX 0x58494355 /* UCIX */
 
 struct cbfs_file_attr_compression {
 	uint32_t tag;
@@ -186,6 +187,24 @@ struct cbfs_file_attr_align {
 	uint32_t alignment;
 } __packed;
 
+/* Index of the updates in a microcode blob, which cbfstool adds to files of
+ * type microcode so that the update for a CPU can be found without walking
+ * the whole blob. Offsets are relative to the start of the file data. */
+struct cbfs_file_attr_microcode_index_entry {
+	uint32_t sig;
+	uint32_t pf;
+	uint32_t rev;
+	uint32_t offset;
+	uint32_t size;
+} __packed;
+
+struct cbfs_file_attr_microcode_index {
+	uint32_t tag;
+	uint32_t len;
+	/* entries fill the rest of len */
+	struct cbfs_file_attr_microcode_index_entry entries[];
+} __packed;
+
 /*
  * ROMCC does not understand uint64_t, so we hide future definitions as they are
  * unlikely to be ever needed from ROMCC
@@ -20,6 +20,15 @@
 
 #define RMODULE_MAGIC 0xf8fe
 #define RMODULE_VERSION_1 1
+/*
+ * Version 2 stores the relocations as a stream instead of an array of
+ * addresses. The addresses are sorted, and each one is encoded as a
+ * ULEB128 value v: the relocation is (v >> 1) bytes after the previous one,
+ * or after address 0 for the first one. If bit 0 of v is set, v is followed
+ * by another ULEB128 value n and n more relocations follow, each one the
+ * size of a pointer after the previous one, as in tables of pointers.
+ */
+#define RMODULE_VERSION_2 2
 
 /* All fields with '_offset' in the name are byte offsets into the flat blob.
  * The linker and the linker script takes are of assigning the values.  */
@@ -56,4 +65,26 @@ struct rmodule_header {
 	uint32_t padding[4];
 } __packed;
 
+/*
+ * Read a ULEB128 value of the version 2 relocation stream. Returns the
+ * number of bytes used, or 0 if the value doesn't end before end.
+ */
+static inline size_t rmodule_read_uleb128(const uint8_t *p, const uint8_t *end,
+					  uint32_t *val)
+{
+	unsigned int shift;
+	size_t n = 0;
+	uint32_t v = 0;
+
+	for (shift = 0; p + n < end && shift < 32; shift += 7) {
+		v |= (uint32_t)(p[n] & 0x7f) << shift;
+		if (!(p[n++] & 0x80)) {
+			*val = v;
+			return n;
+		}
+	}
+
+	return 0;
+}
+
 #endif /* RMODULE_DEFS_H */
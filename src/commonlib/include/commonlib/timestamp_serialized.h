@@ -61,6 +61,8 @@ enum timestamp_id {
 	TS_WRITE_TABLES = 80,
 	TS_FINALIZE_CHIPS = 85,
 	TS_LOAD_PAYLOAD = 90,
+	TS_START_PAYLOAD_SEGMENT = 91,
+	TS_END_PAYLOAD_SEGMENT = 92,
 	TS_ACPI_WAKE_JUMP = 98,
 	TS_SELFBOOT_JUMP = 99,
 	TS_START_POSTCAR = 100,
@@ -182,6 +184,8 @@ static const struct timestamp_id_to_name {
 	{ TS_WRITE_TABLES,	"write tables" },
 	{ TS_FINALIZE_CHIPS,	"finalize chips" },
 	{ TS_LOAD_PAYLOAD,	"load payload" },
+	{ TS_START_PAYLOAD_SEGMENT, "starting to load payload segment" },
+	{ TS_END_PAYLOAD_SEGMENT, "finished loading payload segment" },
 	{ TS_ACPI_WAKE_JUMP,	"ACPI wake jump" },
 	{ TS_SELFBOOT_JUMP,	"selfboot jump" },
 
@@ -21,6 +21,7 @@
 #if !defined(__ROMCC__)
 #include <cbfs.h>
 #include <console/console.h>
+#include <commonlib/endian.h>
 #else
 #include <arch/cbfs.h>
 #endif
@@ -143,14 +144,89 @@ uint32_t get_microcode_checksum(const void *microcode)
 	return ((struct microcode *)microcode)->cksum;
 }
 
-const void *intel_microcode_find(void)
+#if !defined(__ROMCC__)
+/* Map the update the index points to, after checking that it matches. */
+static const struct microcode *map_indexed_update(struct cbfsf *fh,
+	const struct cbfs_file_attr_microcode_index_entry *entry,
+	u32 sig, u32 pf)
+{
+	const struct microcode *m;
+	size_t offset = read_be32(&entry->offset);
+	size_t size = read_be32(&entry->size);
+
+	if (size < sizeof(*m) || offset + size > region_device_sz(&fh->data))
+		return NULL;
+
+	/* Leaked like the mapping of the whole blob was. */
+	m = rdev_mmap(&fh->data, offset, size);
+	if (m == NULL)
+		return NULL;
+
+	if (m->sig != sig || !(m->pf & pf) ||
+	    (m->total_size ? m->total_size : 2048) != size) {
+		rdev_munmap(&fh->data, (void *)m);
+		return NULL;
+	}
+
+	return m;
+}
+
+/*
+ * Look the update up in the index cbfstool adds to the file. Returns < 0 if
+ * there is no usable index, else 0 with *patch set to the update or NULL.
+ */
+static int microcode_index_lookup(struct cbfsf *fh, u32 sig, u32 pf,
+				  const struct microcode **patch)
+{
+	size_t metadata_size = region_device_sz(&fh->metadata);
+	void *metadata = rdev_mmap_full(&fh->metadata);
+	const struct cbfs_file_attr_microcode_index *index;
+	const struct cbfs_file_attr_microcode_index_entry *entry;
+	size_t offs = 0, len, i;
+	int ret = -1;
+
+	if (!metadata)
+		return -1;
+
+	*patch = NULL;
+
+	while ((offs = cbfs_for_each_attr(metadata, metadata_size, offs))) {
+		index = metadata + offs;
+		if (read_be32(&index->tag) != CBFS_FILE_ATTR_TAG_MICROCODE_INDEX)
+			continue;
+
+		len = read_be32(&index->len);
+		if (len < sizeof(*index) || offs + len > metadata_size)
+			break;
+
+		ret = 0;
+		for (i = 0; i < (len - sizeof(*index)) / sizeof(*entry); i++) {
+			entry = &index->entries[i];
+			if (read_be32(&entry->sig) != sig ||
+			    !(read_be32(&entry->pf) & pf))
+				continue;
+
+			*patch = map_indexed_update(fh, entry, sig, pf);
+			if (*patch == NULL) {
+				printk(BIOS_WARNING,
+				       "microcode: Index doesn't match blob\n");
+				ret = -1;
+			}
+			break;
+		}
+		break;
+	}
+
+	rdev_munmap(&fh->metadata, metadata);
+	return ret;
+}
+#endif
+
+static const void *find_update(u32 sig, u32 pf)
 {
 	const struct microcode *ucode_updates;
 	size_t microcode_len;
-	u32 eax;
-	u32 pf, rev, sig, update_size;
-	unsigned int x86_model, x86_family;
-	msr_t msr;
+	u32 update_size;
 
 #ifdef __ROMCC__
 	struct cbfs_file *microcode_file;
@@ -162,35 +238,20 @@ const void *intel_microcode_find(void)
 	ucode_updates = CBFS_SUBHEADER(microcode_file);
 	microcode_len = ntohl(microcode_file->len);
 #else
-	ucode_updates = cbfs_boot_map_with_leak(MICROCODE_CBFS_FILE,
-						CBFS_TYPE_MICROCODE,
-						&microcode_len);
-	if (ucode_updates == NULL)
+	struct cbfsf fh;
+	uint32_t type = CBFS_TYPE_MICROCODE;
+
+	if (cbfs_boot_locate(&fh, MICROCODE_CBFS_FILE, &type))
 		return NULL;
-#endif
 
-	/* CPUID sets MSR 0x8B if a microcode update has been loaded. */
-	msr.lo = 0;
-	msr.hi = 0;
-	wrmsr(IA32_BIOS_SIGN_ID, msr);
-	eax = cpuid_eax(1);
-	msr = rdmsr(IA32_BIOS_SIGN_ID);
-	rev = msr.hi;
-	x86_model = (eax >> 4) & 0x0f;
-	x86_family = (eax >> 8) & 0x0f;
-	sig = eax;
+	/* Only the matching update needs to be read with an index. */
+	if (microcode_index_lookup(&fh, sig, pf, &ucode_updates) == 0)
+		return ucode_updates;
 
-	pf = 0;
-	if ((x86_model >= 5) || (x86_family > 6)) {
-		msr = rdmsr(IA32_PLATFORM_ID);
-		pf = 1 << ((msr.hi >> 18) & 7);
-	}
-#if !defined(__ROMCC__)
-	/* If this code is compiled with ROMCC we're probably in
-	 * the bootblock and don't have console output yet.
-	 */
-	printk(BIOS_DEBUG, "microcode: sig=0x%x pf=0x%x revision=0x%x\n",
-			sig, pf, rev);
+	microcode_len = region_device_sz(&fh.data);
+	ucode_updates = rdev_mmap_full(&fh.data);
+	if (ucode_updates == NULL)
+		return NULL;
 #endif
 
 	while (microcode_len >= sizeof(*ucode_updates)) {
@@ -224,14 +285,72 @@ const void *intel_microcode_find(void)
 	return (void *)0;
 }
 
+#if ENV_RAMSTAGE
+/* The last update found. The CPUs look it up one after another, and it is
+ * the same for all of them unless they differ in signature or platform ID. */
+static struct {
+	int valid;
+	u32 sig;
+	u32 pf;
+	const void *patch;
+} last_found;
+#endif
+
+const void *intel_microcode_find(void)
+{
+	u32 eax;
+	u32 pf, rev, sig;
+	unsigned int x86_model, x86_family;
+	msr_t msr;
+
+	/* CPUID sets MSR 0x8B if a microcode update has been loaded. */
+	msr.lo = 0;
+	msr.hi = 0;
+	wrmsr(IA32_BIOS_SIGN_ID, msr);
+	eax = cpuid_eax(1);
+	msr = rdmsr(IA32_BIOS_SIGN_ID);
+	rev = msr.hi;
+	x86_model = (eax >> 4) & 0x0f;
+	x86_family = (eax >> 8) & 0x0f;
+	sig = eax;
+
+	pf = 0;
+	if ((x86_model >= 5) || (x86_family > 6)) {
+		msr = rdmsr(IA32_PLATFORM_ID);
+		pf = 1 << ((msr.hi >> 18) & 7);
+	}
+#if !defined(__ROMCC__)
+	/* If this code is compiled with ROMCC we're probably in
+	 * the bootblock and don't have console output yet.
+	 */
+	printk(BIOS_DEBUG, "microcode: sig=0x%x pf=0x%x revision=0x%x\n",
+			sig, pf, rev);
+#endif
+
+#if ENV_RAMSTAGE
+	if (!last_found.valid || last_found.sig != sig ||
+	    last_found.pf != pf) {
+		last_found.patch = find_update(sig, pf);
+		last_found.sig = sig;
+		last_found.pf = pf;
+		last_found.valid = 1;
+	}
+	return last_found.patch;
+#else
+	return find_update(sig, pf);
+#endif
+}
+
 void intel_update_microcode_from_cbfs(void)
 {
-	const void *patch = intel_microcode_find();
+	const void *patch;
 
 #if !defined(__ROMCC__) && !defined(__PRE_RAM__)
+	/* Also serializes the lookup, which CPUs share. */
 	spin_lock(&microcode_lock);
 #endif
 
+	patch = intel_microcode_find();
 	intel_microcode_load_unlocked(patch);
 
 #if !defined(__ROMCC__) && !defined(__PRE_RAM__)
@@ -865,6 +865,26 @@ static void store_callback(struct mp_callback **slot, struct mp_callback *val)
 	);
 }
 
+/*
+ * Replace the callback in slot with val if it is still old.
+ * Returns 1 if it was replaced.
+ */
+static int exchange_callback(struct mp_callback **slot,
+			     struct mp_callback *old, struct mp_callback *val)
+{
+	struct mp_callback *prev;
+
+	asm volatile ("lock; cmpxchg %2, %1\n"
+		: "=a" (prev), "+m" (*slot)
+		: "r" (val), "0" (old)
+		: "memory"
+	);
+	return prev == old;
+}
+
+/* An AP copying the callback out of its slot. */
+#define CALLBACK_CLAIMED	((struct mp_callback *)1)
+
 static int run_ap_work(struct mp_callback *val, long expire_us)
 {
 	int i;
@@ -910,6 +930,22 @@ static int run_ap_work(struct mp_callback *val, long expire_us)
 			return 0;
 	} while (expire_us <= 0 || !stopwatch_expired(&sw));
 
+	/*
+	 * val lives in the stack frame of the caller, so take it back from
+	 * the APs that didn't accept it. An AP that claimed it is copying it
+	 * and gets to finish that.
+	 */
+	cpus_accepted = 0;
+	for (i = 0; i < ARRAY_SIZE(ap_callbacks); i++) {
+		if (cur_cpu == i)
+			continue;
+		if (exchange_callback(&ap_callbacks[i], val, NULL))
+			continue;
+		while (read_callback(&ap_callbacks[i]) != NULL)
+			cpu_relax();
+		cpus_accepted++;
+	}
+
 	printk(BIOS_ERR, "AP call expired. %d/%d CPUs accepted.\n",
 		cpus_accepted, global_num_aps);
 	return -1;
@@ -941,6 +977,13 @@ static void ap_wait_for_instruction(void)
 			continue;
 		}
 
+		/*
+		 * Claim the callback first, so that the BSP can't take it back
+		 * while it is copied.
+		 */
+		if (!exchange_callback(per_cpu_slot, cb, CALLBACK_CLAIMED))
+			continue;
+
 		/* Copy to local variable before signaling consumption. */
 		memcpy(&lcb, cb, sizeof(lcb));
 		mfence();
@@ -969,6 +1012,76 @@ int mp_run_on_all_cpus(void (*func)(void *), void *arg, long expire_us)
 	return mp_run_on_aps(func, arg, MP_RUN_ON_ALL_CPUS, expire_us);
 }
 
+/* State of mp_run_work_items(), shared with the APs. */
+static struct {
+	void (*func)(void *arg, int index);
+	void *arg;
+	int count;
+	int next;
+	int done;
+} work_items;
+
+DECLARE_SPIN_LOCK(work_items_lock)
+
+static void work_items_worker(void *unused)
+{
+	void (*func)(void *arg, int index);
+	void *arg;
+	int index;
+
+	while (1) {
+		spin_lock(&work_items_lock);
+		index = work_items.next;
+		if (index >= work_items.count) {
+			spin_unlock(&work_items_lock);
+			return;
+		}
+		work_items.next++;
+		func = work_items.func;
+		arg = work_items.arg;
+		spin_unlock(&work_items_lock);
+
+		func(arg, index);
+
+		spin_lock(&work_items_lock);
+		work_items.done++;
+		spin_unlock(&work_items_lock);
+	}
+}
+
+int mp_run_work_items(void (*func)(void *arg, int index), void *arg,
+		      int count, long expire_us)
+{
+	int ret, done;
+
+	spin_lock(&work_items_lock);
+	work_items.func = func;
+	work_items.arg = arg;
+	work_items.count = count;
+	work_items.next = 0;
+	work_items.done = 0;
+	spin_unlock(&work_items_lock);
+
+	/* Items the APs don't pick up are run on the BSP. */
+	ret = mp_run_on_aps(work_items_worker, NULL, MP_RUN_ON_ALL_CPUS,
+			    expire_us);
+	work_items_worker(NULL);
+
+	do {
+		cpu_relax();
+		spin_lock(&work_items_lock);
+		done = work_items.done;
+		spin_unlock(&work_items_lock);
+	} while (done < count);
+
+	/* Leave nothing to do for an AP that only starts now. */
+	spin_lock(&work_items_lock);
+	work_items.count = 0;
+	spin_unlock(&work_items_lock);
+
+	return ret;
+}
+
 int mp_park_aps(void)
 {
 	struct stopwatch sw;
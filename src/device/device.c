@@ -52,6 +52,9 @@
 
 /** Pointer to the last device */
 extern struct device *last_dev;
+/** Last devices of the lists in the device index */
+extern struct device *dev_type_last[DEVICE_PATH_COUNT];
+extern struct device *dev_bucket_last[DEV_INDEX_BUCKETS];
 /** Linked list of free resources */
 struct resource *free_resources = NULL;
 
@@ -99,6 +102,55 @@ void dev_finalize_chips(void)
 
 DECLARE_SPIN_LOCK(dev_lock)
 
+/* Append a device to the lists of the device index it belongs to. */
+static void dev_index_add(struct device *dev)
+{
+	enum device_path_type type = dev->path.type;
+	int bucket;
+
+	if (type < DEVICE_PATH_COUNT) {
+		dev->next_same_type = NULL;
+		if (dev_type_last[type])
+			dev_type_last[type]->next_same_type = dev;
+		else
+			dev_type_first[type] = dev;
+		dev_type_last[type] = dev;
+	}
+
+	bucket = dev_path_bucket(&dev->path);
+	if (bucket >= 0) {
+		dev->next_in_bucket = NULL;
+		if (dev_bucket_last[bucket])
+			dev_bucket_last[bucket]->next_in_bucket = dev;
+		else
+			dev_bucket_first[bucket] = dev;
+		dev_bucket_last[bucket] = dev;
+	}
+}
+
+/**
+ * Rebuild the device index from all_devices.
+ *
+ * Needs to be called after changing the path of an existing device, e.g. when
+ * remapping PCIe root port functions.
+ */
+void dev_rebuild_index(void)
+{
+	struct device *dev;
+
+	spin_lock(&dev_lock);
+
+	memset(dev_type_first, 0, sizeof(dev_type_first));
+	memset(dev_type_last, 0, sizeof(dev_type_last));
+	memset(dev_bucket_first, 0, sizeof(dev_bucket_first));
+	memset(dev_bucket_last, 0, sizeof(dev_bucket_last));
+
+	for (dev = all_devices; dev; dev = dev->next)
+		dev_index_add(dev);
+
+	spin_unlock(&dev_lock);
+}
+
 #if CONFIG(GFXUMA)
 /* IGD UMA memory */
 uint64_t uma_memory_base = 0;
@@ -148,6 +200,8 @@ static struct device *__alloc_dev(struct bus *parent, struct device_path *path)
 	last_dev->next = dev;
 	last_dev = dev;
 
+	dev_index_add(dev);
+
 	return dev;
 }
 
@@ -41,7 +41,8 @@ DEVTREE_CONST struct device *dev_find_slot(unsigned int bus,
 	DEVTREE_CONST struct device *dev, *result;
 
 	result = 0;
-	for (dev = all_devices; dev; dev = dev->next) {
+	for (dev = dev_bucket_first[dev_index_bucket(devfn)]; dev;
+	     dev = dev->next_in_bucket) {
 		if ((dev->path.type == DEVICE_PATH_PCI) &&
 		    (dev->bus->secondary == bus) &&
 		    (dev->path.pci.devfn == devfn)) {
@@ -65,12 +66,16 @@ DEVTREE_CONST struct device *dev_find_path(
 {
 	DEVTREE_CONST struct device *dev, *result = NULL;
 
+	if (path_type >= DEVICE_PATH_COUNT)
+		return NULL;
+
 	if (prev_match == NULL)
-		prev_match = all_devices;
-	else
-		prev_match = prev_match->next;
+		return dev_type_first[path_type];
+
+	if (prev_match->path.type == path_type)
+		return prev_match->next_same_type;
 
-	for (dev = prev_match; dev; dev = dev->next) {
+	for (dev = prev_match->next; dev; dev = dev->next) {
 		if (dev->path.type == path_type) {
 			result = dev;
 			break;
@@ -91,6 +96,27 @@ DEVTREE_CONST struct device *dev_find_next_pci_device(
 	return dev_find_path(previous_dev, DEVICE_PATH_PCI);
 }
 
+/**
+ * Find the bucket of the device index a path belongs to.
+ *
+ * @param path The device path.
+ * @return Index into dev_bucket_first[], or -1 if the path type isn't hashed.
+ */
+int dev_path_bucket(const struct device_path *path)
+{
+	switch (path->type) {
+	case DEVICE_PATH_PCI:
+		return dev_index_bucket(path->pci.devfn);
+	case DEVICE_PATH_PNP:
+		return dev_index_bucket(DEV_INDEX_PNP_KEY(path->pnp.port,
+							  path->pnp.device));
+	case DEVICE_PATH_I2C:
+		return dev_index_bucket(path->i2c.device);
+	default:
+		return -1;
+	}
+}
+
 static int path_eq(const struct device_path *path1,
 		const struct device_path *path2)
 {
@@ -219,7 +245,8 @@ DEVTREE_CONST struct device *dev_find_slot_on_smbus(unsigned int bus,
 	DEVTREE_CONST struct device *dev, *result;
 
 	result = 0;
-	for (dev = all_devices; dev; dev = dev->next) {
+	for (dev = dev_bucket_first[dev_index_bucket(addr)]; dev;
+	     dev = dev->next_in_bucket) {
 		if ((dev->path.type == DEVICE_PATH_I2C) &&
 		    (dev->bus->secondary == bus) &&
 		    (dev->path.i2c.device == addr)) {
@@ -241,7 +268,9 @@ DEVTREE_CONST struct device *dev_find_slot_pnp(u16 port, u16 device)
 {
 	DEVTREE_CONST struct device *dev;
 
-	for (dev = all_devices; dev; dev = dev->next) {
+	for (dev = dev_bucket_first[dev_index_bucket(
+			DEV_INDEX_PNP_KEY(port, device))];
+	     dev; dev = dev->next_in_bucket) {
 		if ((dev->path.type == DEVICE_PATH_PNP) &&
 		    (dev->path.pnp.port == port) &&
 		    (dev->path.pnp.device == device)) {
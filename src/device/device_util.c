@@ -36,9 +36,9 @@ struct device *dev_find_lapic(unsigned apic_id)
 	struct device *dev;
 	struct device *result = NULL;
 
-	for (dev = all_devices; dev; dev = dev->next) {
-		if (dev->path.type == DEVICE_PATH_APIC &&
-		    dev->path.apic.apic_id == apic_id) {
+	for (dev = dev_type_first[DEVICE_PATH_APIC]; dev;
+	     dev = dev->next_same_type) {
+		if (dev->path.apic.apic_id == apic_id) {
 			result = dev;
 			break;
 		}
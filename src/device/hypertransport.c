@@ -387,6 +387,7 @@ static unsigned int do_hypertransport_scan_chain(struct bus *bus, unsigned min_d
 				        - (dev->path.pci.devfn >> 3) + 1;
 			last_func = func;
 		}
+		dev_rebuild_index();
 
 		/* Compute the number of unitids consumed. */
 		printk(BIOS_SPEW, "%s count: %04x static_count: %04x\n",
@@ -437,6 +438,7 @@ end_of_chain:
 				- CONFIG_HT_CHAIN_END_UNITID_BASE) << 3);
 			last_func = func;
 		}
+		dev_rebuild_index();
 
 		/* Update last one. */
 		ht_unitid_base[ht_dev_num-1] = CONFIG_HT_CHAIN_END_UNITID_BASE;
@@ -932,26 +932,123 @@ static struct device_operations *get_pci_bridge_ops(struct device *dev)
 	return &default_pci_ops_bus;
 }
 
+/*
+ * Index of the PCI driver table, sorted by vendor and device ID. Every device
+ * ID a driver entry lists, either in its zero terminated devices array or as
+ * its single device ID, gets its own entry. Entries with the same ID are kept
+ * in the order of the driver table, so a lookup returns the same driver as a
+ * linear search of _pci_drivers would.
+ */
+struct pci_driver_id {
+	u32 id;
+	const struct pci_driver *driver;
+};
+
+static struct pci_driver_id *pci_driver_ids;
+static size_t pci_driver_id_count;
+
+static inline u32 pci_driver_id_key(u16 vendor, u16 device)
+{
+	return ((u32)vendor << 16) | device;
+}
+
+static int pci_driver_id_less(const struct pci_driver_id *a,
+			      const struct pci_driver_id *b)
+{
+	if (a->id != b->id)
+		return a->id < b->id;
+	return a->driver < b->driver;
+}
+
+static void pci_driver_id_add(const struct pci_driver *driver, u16 device)
+{
+	struct pci_driver_id *entry = &pci_driver_ids[pci_driver_id_count++];
+
+	entry->id = pci_driver_id_key(driver->vendor, device);
+	entry->driver = driver;
+}
+
+/* Build the index of the PCI driver table the first time it is needed. */
+static void pci_driver_ids_init(void)
+{
+	const struct pci_driver *driver;
+	const unsigned short *device_list;
+	struct pci_driver_id tmp;
+	size_t num_ids = 0;
+	size_t gap, i, j;
+
+	if (pci_driver_ids)
+		return;
+
+	for (driver = &_pci_drivers[0]; driver != &_epci_drivers[0]; driver++) {
+		num_ids++;
+		for (device_list = driver->devices; device_list && *device_list;
+		     device_list++)
+			num_ids++;
+	}
+
+	pci_driver_ids = malloc(num_ids * sizeof(*pci_driver_ids));
+
+	for (driver = &_pci_drivers[0]; driver != &_epci_drivers[0]; driver++) {
+		for (device_list = driver->devices; device_list && *device_list;
+		     device_list++)
+			pci_driver_id_add(driver, *device_list);
+		pci_driver_id_add(driver, driver->device);
+	}
+
+	/* Shell sort, the table has up to a few thousand entries. */
+	for (gap = pci_driver_id_count / 2; gap > 0; gap /= 2) {
+		for (i = gap; i < pci_driver_id_count; i++) {
+			tmp = pci_driver_ids[i];
+			for (j = i; j >= gap &&
+			     pci_driver_id_less(&tmp, &pci_driver_ids[j - gap]);
+			     j -= gap)
+				pci_driver_ids[j] = pci_driver_ids[j - gap];
+			pci_driver_ids[j] = tmp;
+		}
+	}
+
+	/* Entries with a device list usually leave the single ID at zero. */
+	for (i = 1; i < pci_driver_id_count; i++) {
+		if (pci_driver_ids[i].id != pci_driver_ids[i - 1].id ||
+		    pci_driver_ids[i].driver == pci_driver_ids[i - 1].driver ||
+		    !(pci_driver_ids[i].id & 0xffff))
+			continue;
+		printk(BIOS_WARNING, "PCI ID %04x/%04x has more than one "
+		       "driver, using the first one.\n",
+		       pci_driver_ids[i].id >> 16,
+		       pci_driver_ids[i].id & 0xffff);
+	}
+}
+
 /**
- * Check if a device id matches a PCI driver entry.
+ * Find the PCI driver entry for a vendor and device ID.
  *
- * The driver entry can either point at a zero terminated array of acceptable
- * device IDs, or include a single device ID.
- *
- * @param driver pointer to the PCI driver entry being checked
- * @param device_id PCI device ID of the device being matched
+ * @param vendor PCI vendor ID of the device being matched
+ * @param device PCI device ID of the device being matched
+ * @return The first matching entry of the PCI driver table, or NULL.
  */
-static int device_id_match(struct pci_driver *driver, unsigned short device_id)
+static const struct pci_driver *find_pci_driver(u16 vendor, u16 device)
 {
-	if (driver->devices) {
-		unsigned short check_id;
-		const unsigned short *device_list = driver->devices;
-		while ((check_id = *device_list++) != 0)
-			if (check_id == device_id)
-				return 1;
+	u32 id = pci_driver_id_key(vendor, device);
+	size_t lo = 0, hi, mid;
+
+	pci_driver_ids_init();
+
+	/* Find the first entry not below id. */
+	hi = pci_driver_id_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (pci_driver_ids[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	return (driver->device == device_id);
+	if (lo < pci_driver_id_count && pci_driver_ids[lo].id == id)
+		return pci_driver_ids[lo].driver;
+
+	return NULL;
 }
 
 /**
@@ -965,24 +1062,19 @@ static int device_id_match(struct pci_driver *driver, unsigned short device_id)
  */
 static void set_pci_ops(struct device *dev)
 {
-	struct pci_driver *driver;
+	const struct pci_driver *driver;
 
 	if (dev->ops)
 		return;
 
-	/*
-	 * Look through the list of setup drivers and find one for
-	 * this PCI device.
-	 */
-	for (driver = &_pci_drivers[0]; driver != &_epci_drivers[0]; driver++) {
-		if ((driver->vendor == dev->vendor) &&
-		    device_id_match(driver, dev->device)) {
-			dev->ops = (struct device_operations *)driver->ops;
-			printk(BIOS_SPEW, "%s [%04x/%04x] %sops\n",
-			       dev_path(dev), driver->vendor, driver->device,
-			       (driver->ops->scan_bus ? "bus " : ""));
-			return;
-		}
+	/* Look up the setup driver for this PCI device. */
+	driver = find_pci_driver(dev->vendor, dev->device);
+	if (driver) {
+		dev->ops = (struct device_operations *)driver->ops;
+		printk(BIOS_SPEW, "%s [%04x/%04x] %sops\n",
+		       dev_path(dev), driver->vendor, driver->device,
+		       (driver->ops->scan_bus ? "bus " : ""));
+		return;
 	}
 
 	/* If I don't have a specific driver use the default operations. */
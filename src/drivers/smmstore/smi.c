@@ -51,7 +51,8 @@ uint32_t smmstore_exec(uint8_t command, void *param)
 		break;
 	}
 
-	case SMMSTORE_CMD_APPEND: {
+	case SMMSTORE_CMD_APPEND:
+	case SMMSTORE_CMD_SET: {
 		printk(BIOS_DEBUG, "Appending into SMM store\n");
 		struct smmstore_params_append *params = param;
 
@@ -66,6 +67,39 @@ uint32_t smmstore_exec(uint8_t command, void *param)
 		break;
 	}
 
+	case SMMSTORE_CMD_GET: {
+		printk(BIOS_DEBUG, "Looking up SMM store value\n");
+		struct smmstore_params_get *params = param;
+		uint32_t valsize = params->valsize;
+		int res;
+
+		if (range_check(params->key, params->keysize) != 0)
+			break;
+		if (range_check(params->val, params->valsize) != 0)
+			break;
+
+		res = smmstore_get_data(params->key, params->keysize,
+					params->val, &valsize);
+		params->valsize = valsize;
+		if (res == 0)
+			ret = SMMSTORE_RET_SUCCESS;
+		else if (res > 0)
+			ret = SMMSTORE_RET_NOT_FOUND;
+		break;
+	}
+
+	case SMMSTORE_CMD_DELETE: {
+		printk(BIOS_DEBUG, "Deleting from SMM store\n");
+		struct smmstore_params_delete *params = param;
+
+		if (range_check(params->key, params->keysize) != 0)
+			break;
+
+		if (smmstore_delete_data(params->key, params->keysize) == 0)
+			ret = SMMSTORE_RET_SUCCESS;
+		break;
+	}
+
 	case SMMSTORE_CMD_CLEAR: {
 		if (smmstore_clear_region() == 0)
 			ret = SMMSTORE_RET_SUCCESS;
@@ -19,9 +19,13 @@
 #include <commonlib/region.h>
 #include <console/console.h>
 #include <smmstore.h>
+#include <string.h>
 
 /*
- * The region format is still not finalized, but so far it looks like this:
+ * The region is split into two banks of the same size. Each one looks like
+ * this:
+ *   uint32le_t signature = "SMSB"
+ *   uint32le_t generation
  *   (
  *    uint32le_t key_sz
  *    uint32le_t value_sz
@@ -36,11 +40,82 @@
  * the constraint that entries are either complete or will be ignored, as long
  * as flash is written sequentially and into a fully erased block.
  *
- * Future additions to the format will split the region in half with an active
- * block marker to allow safe compaction (ie. write the new data in the unused
- * region, mark it active after the write completed). Otherwise a well-timed
- * crash/reboot could clear out all variables.
+ * The last valid entry of a key holds its value, an entry with an empty
+ * value deletes the key.
+ *
+ * The bank with a valid signature and the highest generation is in use.
+ * When it is full, the live entries are copied to the other bank after
+ * erasing it, and its header is written last. A well-timed crash/reboot
+ * therefore leaves the old bank in use.
+ *
+ * Stores written before the banks existed have no header. They are used as
+ * a single list over the whole region, which can't be compacted, until they
+ * are cleared.
+ */
+
+#define SMMSTORE_BANK_SIGNATURE	(('S'<<0)|('M'<<8)|('S'<<16)|('B'<<24))
+#define SMMSTORE_END_MARKER	0xffffffff
+
+struct smmstore_bank_header {
+	uint32_t signature;
+	uint32_t generation;
+} __packed;
+
+struct smmstore_record {
+	uint32_t key_sz;
+	uint32_t value_sz;
+} __packed;
+
+/* All offsets are relative to the start of the store. */
+struct store_bank {
+	size_t offset;
+	size_t size;
+	/* Offset of the first entry */
+	size_t data;
+	uint32_t generation;
+};
+
+/*
+ * The index maps the hash of a key to the offset of its last entry, so that
+ * the list doesn't have to be searched for every access.
  */
+struct index_entry {
+	uint32_t hash;
+	uint32_t offset;
+};
+
+#define INDEX_EMPTY		0xffffffff
+
+/* 32-bit FNV-1a */
+#define HASH_OFFSET_BASIS	0x811c9dc5
+#define HASH_PRIME		0x01000193
+
+#define CHUNK_SIZE		64
+
+static struct {
+	int mounted;
+	struct region location;
+	int legacy;
+	/* The store is empty and the bank header isn't written yet. */
+	int unformatted;
+	/* The list ends in a broken entry, only compaction can add more. */
+	int full;
+	struct store_bank bank;
+	size_t end;
+	size_t index_used;
+	/* Not all keys are in the index, the ones missing need a search. */
+	int index_incomplete;
+	struct index_entry index[CONFIG_SMMSTORE_INDEX_SIZE];
+} store_state;
+
+/* A key either in memory or in an entry of the store. */
+struct key_ref {
+	const void *buf;
+	/* Offset of the entry if buf is NULL */
+	size_t offset;
+	uint32_t size;
+	uint32_t hash;
+};
 
 /*
  * Return a region device that points into the store file.
@@ -80,137 +155,694 @@ static int lookup_store(struct region_device *rstore)
 	return 0;
 }
 
+static uint32_t hash_add(uint32_t hash, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	while (size--) {
+		hash ^= *p++;
+		hash *= HASH_PRIME;
+	}
+
+	return hash;
+}
+
 /*
- * Read entire store into user provided buffer
+ * Compare size bytes of the store at offset to buf, or to the store at
+ * buf_offset if buf is NULL.
  *
- * returns 0 on success, -1 on failure
- * writes up to `*bufsize` bytes into `buf` and updates `*bufsize`
+ * returns 0 if they are equal, 1 if not and -1 on failure
  */
-int smmstore_read_region(void *buf, ssize_t *bufsize)
+static int store_compare(const struct region_device *store, size_t offset,
+			 const void *buf, size_t buf_offset, size_t size)
 {
-	struct region_device store;
+	uint8_t a[CHUNK_SIZE], b[CHUNK_SIZE];
+	size_t n;
 
-	if (bufsize == NULL)
+	while (size) {
+		n = MIN(size, sizeof(a));
+		if (rdev_readat(store, a, offset, n) != n)
+			return -1;
+
+		if (buf == NULL) {
+			if (rdev_readat(store, b, buf_offset, n) != n)
+				return -1;
+			if (memcmp(a, b, n))
+				return 1;
+			buf_offset += n;
+		} else {
+			if (memcmp(a, buf, n))
+				return 1;
+			buf = (const uint8_t *)buf + n;
+		}
+
+		offset += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+static size_t record_size(uint32_t key_sz, uint32_t value_sz)
+{
+	return ALIGN_UP(sizeof(struct smmstore_record) + key_sz + value_sz + 1,
+			sizeof(uint32_t));
+}
+
+static size_t bank_end(void)
+{
+	return store_state.bank.offset + store_state.bank.size;
+}
+
+/*
+ * Read the sizes of the entry at offset
+ *
+ * returns 0 for an entry, 1 at the end of the list and -1 if the entry is
+ * broken
+ */
+static int read_record(const struct region_device *store, size_t offset,
+		       struct smmstore_record *rec)
+{
+	if (offset + sizeof(rec->key_sz) > bank_end())
+		return 1;
+
+	if (rdev_readat(store, &rec->key_sz, offset, sizeof(rec->key_sz)) !=
+	    sizeof(rec->key_sz))
 		return -1;
 
-	*bufsize = 0;
-	if (lookup_store(&store) < 0) {
-		printk(BIOS_WARNING, "reading region failed\n");
+	if (rec->key_sz == SMMSTORE_END_MARKER)
+		return 1;
+
+	if (offset + sizeof(*rec) > bank_end() ||
+	    rdev_readat(store, &rec->value_sz, offset + sizeof(rec->key_sz),
+			sizeof(rec->value_sz)) != sizeof(rec->value_sz))
 		return -1;
-	}
 
-	ssize_t tx = min(*bufsize, region_device_sz(&store));
-	*bufsize = rdev_readat(&store, buf, 0, tx);
+	/* Avoid wrapping, data_size < MAX_UINT32_T / 2 */
+	if (rec->key_sz > store_state.bank.size ||
+	    rec->value_sz > store_state.bank.size ||
+	    record_size(rec->key_sz, rec->value_sz) > bank_end() - offset)
+		return -1;
 
-	if (*bufsize < 0)
+	return 0;
+}
+
+/* returns 1 if the entry is valid, 0 if not and -1 on failure */
+static int record_active(const struct region_device *store, size_t offset,
+			 const struct smmstore_record *rec)
+{
+	uint8_t active;
+
+	offset += sizeof(*rec) + rec->key_sz + rec->value_sz;
+	if (rdev_readat(store, &active, offset, sizeof(active)) !=
+	    sizeof(active))
 		return -1;
 
+	return active == 0;
+}
+
+static int key_ref_from_record(const struct region_device *store,
+			       size_t offset, const struct smmstore_record *rec,
+			       struct key_ref *key)
+{
+	uint8_t buf[CHUNK_SIZE];
+	size_t pos, n;
+
+	key->buf = NULL;
+	key->offset = offset;
+	key->size = rec->key_sz;
+	key->hash = HASH_OFFSET_BASIS;
+
+	offset += sizeof(*rec);
+	for (pos = 0; pos < rec->key_sz; pos += n) {
+		n = MIN(rec->key_sz - pos, sizeof(buf));
+		if (rdev_readat(store, buf, offset + pos, n) != n)
+			return -1;
+		key->hash = hash_add(key->hash, buf, n);
+	}
+
 	return 0;
 }
 
+/* returns 1 if the entry at offset has the key, 0 if not and -1 on failure */
+static int record_has_key(const struct region_device *store, size_t offset,
+			  const struct key_ref *key)
+{
+	uint32_t key_sz;
+	int ret;
+
+	if (rdev_readat(store, &key_sz, offset, sizeof(key_sz)) !=
+	    sizeof(key_sz))
+		return -1;
+
+	if (key_sz != key->size)
+		return 0;
+
+	ret = store_compare(store, offset + sizeof(struct smmstore_record),
+			    key->buf, key->offset + sizeof(struct smmstore_record),
+			    key->size);
+	if (ret < 0)
+		return -1;
+
+	return !ret;
+}
+
+/*
+ * Find the index entry of the key, or the free one it would go into.
+ * Returns NULL if neither exists.
+ */
+static struct index_entry *index_find(const struct region_device *store,
+				      const struct key_ref *key)
+{
+	const size_t n = ARRAY_SIZE(store_state.index);
+	struct index_entry *e;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		e = &store_state.index[(key->hash + i) % n];
+		if (e->offset == INDEX_EMPTY)
+			return e;
+		if (e->hash == key->hash &&
+		    record_has_key(store, e->offset, key) == 1)
+			return e;
+	}
+
+	return NULL;
+}
+
+static void index_add(const struct region_device *store,
+		      const struct key_ref *key, size_t offset)
+{
+	struct index_entry *e;
+
+	e = index_find(store, key);
+
+	/* Keep the probe sequences short, the search is the fallback. */
+	if (e != NULL && e->offset == INDEX_EMPTY &&
+	    store_state.index_used >= ARRAY_SIZE(store_state.index) * 3 / 4)
+		e = NULL;
+
+	if (e == NULL) {
+		store_state.index_incomplete = 1;
+		return;
+	}
+
+	if (e->offset == INDEX_EMPTY) {
+		e->hash = key->hash;
+		store_state.index_used++;
+	}
+	e->offset = offset;
+}
+
 /*
- * Append data to region
+ * Find the last valid entry of the key
  *
- * Returns 0 on success, -1 on failure
+ * returns its offset, or -1 if there is none
  */
-int smmstore_append_data(void *key, uint32_t key_sz,
-	void *value, uint32_t value_sz)
+static ssize_t find_record(const struct region_device *store,
+			   const struct key_ref *key)
 {
-	struct region_device store;
+	struct smmstore_record rec;
+	struct index_entry *e;
+	ssize_t found = -1;
+	size_t offset;
 
-	if (lookup_store(&store) < 0) {
-		printk(BIOS_WARNING, "reading region failed\n");
+	e = index_find(store, key);
+	if (e != NULL && e->offset != INDEX_EMPTY)
+		return e->offset;
+
+	if (!store_state.index_incomplete)
 		return -1;
+
+	for (offset = store_state.bank.data; offset < store_state.end;
+	     offset += record_size(rec.key_sz, rec.value_sz)) {
+		if (read_record(store, offset, &rec))
+			break;
+		if (record_active(store, offset, &rec) == 1 &&
+		    record_has_key(store, offset, key) == 1)
+			found = offset;
 	}
 
-	ssize_t data_sz = region_device_sz(&store);
+	return found;
+}
 
-	/* scan for end */
-	ssize_t end = 0;
-	uint32_t k_sz, v_sz;
-	while (end < data_sz) {
-		/* make odd corner cases identifiable, eg. invalid v_sz */
-		k_sz = 0;
+/*
+ * Find the bank in use and index its entries
+ *
+ * returns 0 on success, -1 on failure
+ */
+static int mount_store(const struct region_device *store)
+{
+	struct smmstore_bank_header hdr[2];
+	struct store_bank *bank = &store_state.bank;
+	struct smmstore_record rec;
+	struct key_ref key;
+	size_t half, offset;
+	uint32_t first;
+	int i, ret, active = -1;
+
+	memset(&store_state, 0, sizeof(store_state));
+	memset(store_state.index, 0xff, sizeof(store_state.index));
+
+	half = ALIGN_DOWN(region_device_sz(store) / 2, 4 * KiB);
+	if (half == 0) {
+		printk(BIOS_WARNING, "smm store: region too small\n");
+		return -1;
+	}
 
-		if (rdev_readat(&store, &k_sz, end, sizeof(k_sz)) < 0) {
-			printk(BIOS_WARNING, "failed reading key size\n");
+	for (i = 0; i < ARRAY_SIZE(hdr); i++) {
+		if (rdev_readat(store, &hdr[i], i * half, sizeof(hdr[i])) !=
+		    sizeof(hdr[i]))
+			return -1;
+		if (hdr[i].signature != SMMSTORE_BANK_SIGNATURE)
+			continue;
+		if (active < 0 || hdr[i].generation > hdr[active].generation)
+			active = i;
+	}
+
+	if (active >= 0) {
+		bank->offset = active * half;
+		bank->size = half;
+		bank->data = bank->offset + sizeof(hdr[0]);
+		bank->generation = hdr[active].generation;
+	} else {
+		if (rdev_readat(store, &first, 0, sizeof(first)) !=
+		    sizeof(first))
 			return -1;
+
+		if (first != SMMSTORE_END_MARKER) {
+			printk(BIOS_INFO, "smm store: no banks, can't compact\n");
+			store_state.legacy = 1;
+			bank->offset = 0;
+			bank->size = region_device_sz(store);
+			bank->data = 0;
+		} else {
+			store_state.unformatted = 1;
+			bank->offset = 0;
+			bank->size = half;
+			bank->data = sizeof(hdr[0]);
 		}
+	}
 
-		/* found the end */
-		if (k_sz == 0xffffffff)
+	for (offset = bank->data;;
+	     offset += record_size(rec.key_sz, rec.value_sz)) {
+		ret = read_record(store, offset, &rec);
+		if (ret > 0)
+			break;
+		if (ret < 0) {
+			printk(BIOS_WARNING, "smm store: broken entry at 0x%zx\n",
+			       offset);
+			store_state.full = 1;
 			break;
-
-		/* something is fishy here:
-		 * Avoid wrapping (since data_size < MAX_UINT32_T / 2) while
-		 * other problems are covered by the loop condition
-		 */
-		if (k_sz > data_sz) {
-			printk(BIOS_WARNING, "key size out of bounds\n");
-			return -1;
 		}
 
-		if (rdev_readat(&store, &v_sz, end + 4, sizeof(v_sz)) < 0) {
-			printk(BIOS_WARNING, "failed reading value size\n");
+		ret = record_active(store, offset, &rec);
+		if (ret < 0)
 			return -1;
-		}
+		if (!ret)
+			continue;
 
-		if (v_sz > data_sz) {
-			printk(BIOS_WARNING, "value size out of bounds\n");
+		if (key_ref_from_record(store, offset, &rec, &key))
 			return -1;
-		}
+		index_add(store, &key, offset);
+	}
+
+	store_state.end = offset;
+	store_state.location = store->region;
+	store_state.mounted = 1;
 
-		end += 8 + k_sz + v_sz + 1;
-		end = ALIGN_UP(end, sizeof(uint32_t));
+	printk(BIOS_DEBUG, "smm store: using 0x%zx of 0x%zx bytes at 0x%zx\n",
+	       store_state.end - bank->data, bank->size, bank->offset);
+
+	return 0;
+}
+
+/* Check that the flash wasn't changed underneath, eg. due to an update. */
+static int store_changed(const struct region_device *store)
+{
+	struct smmstore_bank_header hdr;
+	uint32_t marker;
+
+	if (region_offset(&store->region) !=
+	    region_offset(&store_state.location) ||
+	    region_sz(&store->region) != region_sz(&store_state.location))
+		return 1;
+
+	if (!store_state.legacy) {
+		if (rdev_readat(store, &hdr, store_state.bank.offset,
+				sizeof(hdr)) != sizeof(hdr))
+			return 1;
+		if (store_state.unformatted &&
+		    hdr.signature != SMMSTORE_END_MARKER)
+			return 1;
+		if (!store_state.unformatted &&
+		    (hdr.signature != SMMSTORE_BANK_SIGNATURE ||
+		     hdr.generation != store_state.bank.generation))
+			return 1;
+	}
+
+	if (!store_state.full &&
+	    store_state.end + sizeof(marker) <= bank_end()) {
+		if (rdev_readat(store, &marker, store_state.end,
+				sizeof(marker)) != sizeof(marker))
+			return 1;
+		if (marker != SMMSTORE_END_MARKER)
+			return 1;
 	}
 
-	printk(BIOS_WARNING, "used smm store size might be 0x%zx bytes\n", end);
+	return 0;
+}
+
+/*
+ * Look up the store and make sure the index is up to date
+ *
+ * returns 0 on success, -1 on failure
+ */
+static int prepare_store(struct region_device *store)
+{
+	if (lookup_store(store) < 0)
+		return -1;
+
+	if (store_state.mounted && !store_changed(store))
+		return 0;
 
-	if (k_sz != 0xffffffff) {
-		printk(BIOS_WARNING,
-			"eof of data marker looks invalid: 0x%x\n", k_sz);
+	return mount_store(store);
+}
+
+static int open_store_rw(const struct region_device *store,
+			 struct region_device *rw)
+{
+	if (boot_device_rw_subregion(&store->region, rw) < 0) {
+		printk(BIOS_WARNING, "couldn't open store for writing\n");
 		return -1;
 	}
 
-	printk(BIOS_WARNING, "used size looks legit\n");
+	return 0;
+}
 
-	printk(BIOS_WARNING, "open (%zx, %zx) for writing\n",
-		region_device_offset(&store), region_device_sz(&store));
-	if (boot_device_rw_subregion(&store.region, &store) < 0) {
-		printk(BIOS_WARNING, "couldn't open store for writing\n");
+static int write_record(const struct region_device *rw, size_t offset,
+			const void *key, uint32_t key_sz,
+			const void *value, uint32_t value_sz)
+{
+	struct smmstore_record rec = {
+		.key_sz = key_sz,
+		.value_sz = value_sz,
+	};
+	uint8_t nul = 0;
+
+	if (rdev_writeat(rw, &rec, offset, sizeof(rec)) != sizeof(rec)) {
+		printk(BIOS_WARNING, "failed writing key and value size\n");
+		return -1;
+	}
+	offset += sizeof(rec);
+	if (rdev_writeat(rw, key, offset, key_sz) != key_sz) {
+		printk(BIOS_WARNING, "failed writing key data\n");
+		return -1;
+	}
+	offset += key_sz;
+	if (value_sz && rdev_writeat(rw, value, offset, value_sz) != value_sz) {
+		printk(BIOS_WARNING, "failed writing value data\n");
+		return -1;
+	}
+	offset += value_sz;
+	if (rdev_writeat(rw, &nul, offset, 1) != 1) {
+		printk(BIOS_WARNING, "failed writing termination\n");
 		return -1;
 	}
 
-	uint32_t record_sz = 8 + key_sz + value_sz + 1;
-	if (end + record_sz >= data_sz) {
+	return 0;
+}
+
+static int copy_record(const struct region_device *store,
+		       const struct region_device *rw, size_t from, size_t to,
+		       size_t size)
+{
+	uint8_t buf[CHUNK_SIZE];
+	size_t n;
+
+	for (; size; size -= n, from += n, to += n) {
+		n = MIN(size, sizeof(buf));
+		if (rdev_readat(store, buf, from, n) != n ||
+		    rdev_writeat(rw, buf, to, n) != n)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy the live entries into the other bank, followed by the new one, and
+ * switch over to it by writing its header
+ *
+ * returns 0 on success, -1 on failure
+ */
+static int compact_store(const struct region_device *store,
+			 const struct region_device *rw,
+			 const struct key_ref *key,
+			 const void *value, uint32_t value_sz)
+{
+	const struct store_bank *bank = &store_state.bank;
+	struct smmstore_bank_header hdr;
+	struct smmstore_record rec;
+	struct key_ref rec_key;
+	size_t offset, to, end, size;
+	int ret;
+
+	if (store_state.legacy) {
 		printk(BIOS_WARNING, "not enough space for new data\n");
 		return -1;
 	}
 
-	if (rdev_writeat(&store, &key_sz, end, 4) != 4) {
-		printk(BIOS_WARNING, "failed writing key size\n");
+	to = bank->offset ? 0 : bank->size;
+	end = to + bank->size;
+
+	printk(BIOS_INFO, "smm store: compacting into bank at 0x%zx\n", to);
+
+	if (rdev_eraseat(rw, to, bank->size) != bank->size) {
+		printk(BIOS_WARNING, "smm store: erasing bank failed\n");
+		return -1;
 	}
-	end += 4;
-	if (rdev_writeat(&store, &value_sz, end, 4) != 4) {
-		printk(BIOS_WARNING, "failed writing value size\n");
+	to += sizeof(hdr);
+
+	for (offset = bank->data; offset < store_state.end; offset += size) {
+		if (read_record(store, offset, &rec))
+			break;
+		size = record_size(rec.key_sz, rec.value_sz);
+
+		/* Deleted keys are dropped along with the old values. */
+		ret = record_active(store, offset, &rec);
+		if (ret < 0)
+			return -1;
+		if (!ret || !rec.value_sz)
+			continue;
+
+		ret = record_has_key(store, offset, key);
+		if (ret < 0)
+			return -1;
+		if (ret)
+			continue;
+
+		if (key_ref_from_record(store, offset, &rec, &rec_key))
+			return -1;
+		if (find_record(store, &rec_key) != offset)
+			continue;
+
+		if (to + size >= end)
+			goto full;
+		if (copy_record(store, rw, offset, to, size))
+			return -1;
+		to += size;
 	}
-	end += 4;
-	if (rdev_writeat(&store, key, end, key_sz) != key_sz) {
-		printk(BIOS_WARNING, "failed writing key data\n");
+
+	if (value_sz) {
+		if (to + record_size(key->size, value_sz) >= end)
+			goto full;
+		if (write_record(rw, to, key->buf, key->size, value, value_sz))
+			return -1;
 	}
-	end += key_sz;
-	if (rdev_writeat(&store, value, end, value_sz) != value_sz) {
-		printk(BIOS_WARNING, "failed writing value data\n");
+
+	hdr.signature = SMMSTORE_BANK_SIGNATURE;
+	hdr.generation = bank->generation + 1;
+	if (rdev_writeat(rw, &hdr, end - bank->size, sizeof(hdr)) !=
+	    sizeof(hdr)) {
+		printk(BIOS_WARNING, "smm store: failed writing bank header\n");
+		return -1;
 	}
-	end += value_sz;
-	uint8_t nul = 0;
-	if (rdev_writeat(&store, &nul, end, 1) != 1) {
-		printk(BIOS_WARNING, "failed writing termination\n");
+
+	return mount_store(store);
+
+full:
+	printk(BIOS_WARNING, "not enough space for new data\n");
+	return -1;
+}
+
+/*
+ * Read the entries of the store into user provided buffer
+ *
+ * returns 0 on success, -1 on failure
+ * writes up to `*bufsize` bytes into `buf` and updates `*bufsize`
+ */
+int smmstore_read_region(void *buf, ssize_t *bufsize)
+{
+	struct region_device store;
+	ssize_t tx;
+
+	if (bufsize == NULL)
+		return -1;
+
+	tx = *bufsize;
+	*bufsize = 0;
+	if (prepare_store(&store) < 0) {
+		printk(BIOS_WARNING, "reading region failed\n");
+		return -1;
+	}
+
+	tx = min(tx, bank_end() - store_state.bank.data);
+	*bufsize = rdev_readat(&store, buf, store_state.bank.data, tx);
+
+	if (*bufsize < 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Look up the value of a key
+ *
+ * returns 0 on success, 1 if the key isn't in the store and -1 on failure,
+ * including a buffer that is too small
+ * writes up to `*value_sz` bytes into `value` and updates `*value_sz`
+ */
+int smmstore_get_data(void *key, uint32_t key_sz,
+	void *value, uint32_t *value_sz)
+{
+	struct region_device store;
+	struct smmstore_record rec;
+	struct key_ref ref = { .buf = key, .size = key_sz };
+	ssize_t offset;
+
+	if (prepare_store(&store) < 0) {
+		printk(BIOS_WARNING, "reading region failed\n");
+		return -1;
 	}
 
+	/* No such key can be stored, don't even look at it. */
+	if (key_sz > store_state.bank.size)
+		return 1;
+
+	ref.hash = hash_add(HASH_OFFSET_BASIS, key, key_sz);
+	offset = find_record(&store, &ref);
+	if (offset < 0)
+		return 1;
+
+	if (read_record(&store, offset, &rec))
+		return -1;
+
+	if (!rec.value_sz)
+		return 1;
+
+	if (rec.value_sz > *value_sz) {
+		*value_sz = rec.value_sz;
+		return -1;
+	}
+
+	offset += sizeof(rec) + rec.key_sz;
+	if (rdev_readat(&store, value, offset, rec.value_sz) != rec.value_sz)
+		return -1;
+
+	*value_sz = rec.value_sz;
+
 	return 0;
 }
 
+/*
+ * Append data to region, compacting it if it is full. An empty value
+ * deletes the key.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int smmstore_append_data(void *key, uint32_t key_sz,
+	void *value, uint32_t value_sz)
+{
+	struct region_device store, rw;
+	struct smmstore_bank_header hdr;
+	struct smmstore_record rec;
+	struct key_ref ref = { .buf = key, .size = key_sz };
+	ssize_t offset;
+	size_t size;
+
+	if (prepare_store(&store) < 0) {
+		printk(BIOS_WARNING, "reading region failed\n");
+		return -1;
+	}
+
+	/*
+	 * Check the sizes before touching the data, they come from the SMI
+	 * caller and could make the sums below wrap.
+	 */
+	if (key_sz > store_state.bank.size ||
+	    value_sz > store_state.bank.size) {
+		printk(BIOS_WARNING, "smm store: record too large\n");
+		return -1;
+	}
+
+	/* Don't wear out the flash writing values that are already there. */
+	ref.hash = hash_add(HASH_OFFSET_BASIS, key, key_sz);
+	offset = find_record(&store, &ref);
+	if (offset >= 0) {
+		if (read_record(&store, offset, &rec))
+			return -1;
+		if (rec.value_sz == value_sz &&
+		    store_compare(&store, offset + sizeof(rec) + key_sz,
+				  value, 0, value_sz) == 0)
+			return 0;
+	} else if (!value_sz) {
+		return 0;
+	}
+
+	if (open_store_rw(&store, &rw) < 0)
+		return -1;
+
+	size = record_size(key_sz, value_sz);
+	if (store_state.full || store_state.end + size >= bank_end())
+		return compact_store(&store, &rw, &ref, value, value_sz);
+
+	if (store_state.unformatted) {
+		hdr.signature = SMMSTORE_BANK_SIGNATURE;
+		hdr.generation = 1;
+		if (rdev_writeat(&rw, &hdr, store_state.bank.offset,
+				 sizeof(hdr)) != sizeof(hdr)) {
+			printk(BIOS_WARNING,
+			       "smm store: failed writing bank header\n");
+			store_state.mounted = 0;
+			return -1;
+		}
+		store_state.unformatted = 0;
+		store_state.bank.generation = hdr.generation;
+	}
+
+	if (write_record(&rw, store_state.end, key, key_sz, value, value_sz)) {
+		/* Have a look at what made it to the flash. */
+		store_state.mounted = 0;
+		return -1;
+	}
+
+	index_add(&store, &ref, store_state.end);
+	store_state.end += size;
+
+	return 0;
+}
+
+/*
+ * Delete a key by appending an empty value
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int smmstore_delete_data(void *key, uint32_t key_sz)
+{
+	return smmstore_append_data(key, key_sz, NULL, 0);
+}
+
 /*
  * Clear region
  *
@@ -218,15 +850,20 @@ int smmstore_append_data(void *key, uint32_t key_sz,
  */
 int smmstore_clear_region(void)
 {
-	struct region_device store;
+	struct region_device store, rw;
+
+	store_state.mounted = 0;
 
 	if (lookup_store(&store) < 0) {
 		printk(BIOS_WARNING, "smm store: reading region failed\n");
 		return -1;
 	}
 
-	ssize_t res = rdev_eraseat(&store, 0, region_device_sz(&store));
-	if (res != region_device_sz(&store)) {
+	if (open_store_rw(&store, &rw) < 0)
+		return -1;
+
+	ssize_t res = rdev_eraseat(&rw, 0, region_device_sz(&rw));
+	if (res != region_device_sz(&rw)) {
 		printk(BIOS_WARNING, "smm store: erasing region failed\n");
 		return -1;
 	}
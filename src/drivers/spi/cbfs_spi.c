@@ -137,6 +137,43 @@ const struct region_device *boot_device_rw(void)
 	return boot_device_ro();
 }
 
+/* Only sub-regions of the boot device can be read in the background. */
+static bool is_spi_read(const struct boot_device_read *rd)
+{
+	size_t size = region_device_sz(rd->rdev);
+
+	return rd->rdev->root == &mdev.rdev && rd->size <= size &&
+		rd->offset <= size - rd->size;
+}
+
+int boot_device_read_start(const struct boot_device_read *rd)
+{
+	if (!is_spi_read(rd)) {
+		if (rdev_readat(rd->rdev, rd->buf, rd->offset, rd->size) !=
+		    rd->size)
+			return -1;
+		return 0;
+	}
+
+	if (spi_flash_read_start(&spi_flash_info,
+				 region_device_offset(rd->rdev) + rd->offset,
+				 rd->size, rd->buf))
+		return -1;
+
+	return 0;
+}
+
+int boot_device_read_wait(const struct boot_device_read *rd)
+{
+	if (!is_spi_read(rd))
+		return 0;
+
+	if (spi_flash_read_wait(&spi_flash_info))
+		return -1;
+
+	return 0;
+}
+
 const struct spi_flash *boot_device_spi_flash(void)
 {
 	boot_device_init();
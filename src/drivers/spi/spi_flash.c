@@ -404,6 +404,23 @@ int spi_flash_read(const struct spi_flash *flash, u32 offset, size_t len,
 	return spi_flash_read_chunked(flash, offset, len, buf);
 }
 
+int spi_flash_read_start(const struct spi_flash *flash, u32 offset,
+			 size_t len, void *buf)
+{
+	if (flash->ops->read_start)
+		return flash->ops->read_start(flash, offset, len, buf);
+
+	return spi_flash_read(flash, offset, len, buf);
+}
+
+int spi_flash_read_wait(const struct spi_flash *flash)
+{
+	if (flash->ops->read_start)
+		return flash->ops->read_wait(flash);
+
+	return 0;
+}
+
 int spi_flash_write(const struct spi_flash *flash, u32 offset, size_t len,
 		const void *buf)
 {
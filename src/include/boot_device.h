@@ -68,6 +68,26 @@ int boot_device_rw_subregion(const struct region *sub,
 int boot_device_wp_region(const struct region_device *rd,
 				const enum bootdev_prot_type type);
 
+/*
+ * A read from a region of the boot device that may complete in the
+ * background, so that the caller can work on the previous data meanwhile.
+ */
+struct boot_device_read {
+	const struct region_device *rdev;
+	void *buf;
+	size_t offset;
+	size_t size;
+};
+
+/*
+ * Start reading rd->size bytes at rd->offset of rd->rdev into rd->buf, and
+ * wait for that read to finish. Only one read can be pending at a time.
+ * Boot devices that can't read in the background finish the read in
+ * boot_device_read_start(). Both return 0 on success, < 0 on error.
+ */
+int boot_device_read_start(const struct boot_device_read *rd);
+int boot_device_read_wait(const struct boot_device_read *rd);
+
 /*
  * Initialize the boot device. This may be called multiple times within
  * a stage so boot device implementations should account for this behavior.
@@ -59,6 +59,10 @@ size_t cbfs_prog_stage_section(struct prog *pstage, uintptr_t *base);
 /* Load stage into memory filling in prog. Return 0 on success. < 0 on error. */
 int cbfs_prog_stage_load(struct prog *prog);
 
+/* Locate and load stage named after prog from the boot media, measuring it
+ * while it is loaded. Return 0 on success. < 0 on error. */
+int cbfs_boot_load_prog_stage(struct prog *prog);
+
 /*****************************************************************
  * Support structures and functions. Direct field access should  *
  * only be done by implementers of cbfs regions -- Not the above *
@@ -139,6 +139,15 @@ int mp_run_on_aps(void (*func)(void *), void *arg, int logical_cpu_num,
 /* Like mp_run_on_aps() but also runs func on BSP. */
 int mp_run_on_all_cpus(void (*func)(void *), void *arg, long expire_us);
 
+/*
+ * Calls func(arg, index) for every index below count, spread over the BSP and
+ * the APs, which take the indices in increasing order. Returns once all calls
+ * are done, with the result of handing the work to the APs: on failure the
+ * items were run by the BSP and the APs that accepted in time.
+ */
+int mp_run_work_items(void (*func)(void *arg, int index), void *arg,
+		      int count, long expire_us);
+
 /*
  * Park all APs to prepare for OS boot. This is handled automatically
  * by the coreboot infrastructure.
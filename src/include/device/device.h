@@ -114,6 +114,11 @@ struct device {
 
 	DEVTREE_CONST struct device *next;	/* chain of all devices */
 
+	/* chain of devices with the same path type */
+	DEVTREE_CONST struct device *next_same_type;
+	/* chain of devices in the same bucket of the device index */
+	DEVTREE_CONST struct device *next_in_bucket;
+
 	struct device_path path;
 	unsigned int	vendor;
 	unsigned int	device;
@@ -158,6 +163,29 @@ struct device {
 extern DEVTREE_CONST struct device	dev_root;
 /* list of all devices */
 extern DEVTREE_CONST struct device * DEVTREE_CONST all_devices;
+
+/*
+ * Index of all devices, generated by sconfig for the static devices and
+ * extended by alloc_dev(). Both lists are in the order of all_devices.
+ * dev_type_first[] lists the devices of each path type. dev_bucket_first[]
+ * hashes the PCI devfn, PNP port and device, and I2C device with
+ * dev_index_bucket(). util/sconfig computes the same buckets.
+ */
+#define DEV_INDEX_BUCKET_BITS	6
+#define DEV_INDEX_BUCKETS	(1 << DEV_INDEX_BUCKET_BITS)
+#define DEV_INDEX_PNP_KEY(port, device) \
+	((uint32_t)(port) ^ ((uint32_t)(device) << 16))
+
+static inline unsigned int dev_index_bucket(uint32_t key)
+{
+	return (uint32_t)(key * 0x9e3779b1) >> (32 - DEV_INDEX_BUCKET_BITS);
+}
+
+extern DEVTREE_CONST struct device * DEVTREE_CONST
+	dev_type_first[DEVICE_PATH_COUNT];
+extern DEVTREE_CONST struct device * DEVTREE_CONST
+	dev_bucket_first[DEV_INDEX_BUCKETS];
+
 extern struct resource	*free_resources;
 extern struct bus	*free_links;
 
@@ -171,6 +199,7 @@ extern uint64_t uma_memory_size;
 
 /* Generic device interface functions */
 struct device *alloc_dev(struct bus *parent, struct device_path *path);
+void dev_rebuild_index(void);
 void dev_initialize_chips(void);
 void dev_enumerate(void);
 void dev_configure(void);
@@ -196,6 +225,7 @@ bool dev_is_active_bridge(struct device *dev);
 void run_bios(struct device *dev, unsigned long addr);
 
 /* Helper functions */
+int dev_path_bucket(const struct device_path *path);
 DEVTREE_CONST struct device *find_dev_path(
 		const struct bus *parent,
 		const struct device_path *path);
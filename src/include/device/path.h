@@ -24,6 +24,8 @@ enum device_path_type {
 	 * When adding path types to this table, please also update the
 	 * DEVICE_PATH_NAMES macro below.
 	 */
+
+	DEVICE_PATH_COUNT
 };
 
 #define DEVICE_PATH_NAMES {			\
@@ -22,6 +22,15 @@
 
 /* Defined in src/lib/lzma.c. Returns decompressed size or 0 on error. */
 size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn);
+/* Reentrant variant, the caller provides the decoder scratchpad. */
+#define ULZMAN_SCRATCHPAD_SIZE 15980
+size_t ulzman_scratch(const void *src, size_t srcn, void *dst, size_t dstn,
+		      void *scratchpad);
+
+/* Defined in src/lib/lz4_compress.c. Compresses src into an LZ4F image for
+ * ulz4fn(). Without dst only the size is computed. Returns the size of the
+ * image or 0 if it doesn't fit into dstn bytes. */
+size_t lz4fn(const void *src, size_t srcn, void *dst, size_t dstn);
 
 /* Defined in src/lib/ramtest.c */
 /* Assumption is 32-bit addressable UC memory. */
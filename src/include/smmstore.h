@@ -22,10 +22,15 @@
 #define SMMSTORE_RET_SUCCESS 0
 #define SMMSTORE_RET_FAILURE 1
 #define SMMSTORE_RET_UNSUPPORTED 2
+#define SMMSTORE_RET_NOT_FOUND 3
 
 #define SMMSTORE_CMD_CLEAR 1
 #define SMMSTORE_CMD_READ 2
 #define SMMSTORE_CMD_APPEND 3
+#define SMMSTORE_CMD_GET 4
+/* Setting a value appends it, like SMMSTORE_CMD_APPEND */
+#define SMMSTORE_CMD_SET 5
+#define SMMSTORE_CMD_DELETE 6
 
 struct smmstore_params_read {
 	void *buf;
@@ -39,6 +44,19 @@ struct smmstore_params_append {
 	size_t valsize;
 };
 
+/* valsize is the size of the buffer, updated to the size of the value */
+struct smmstore_params_get {
+	void *key;
+	size_t keysize;
+	void *val;
+	size_t valsize;
+};
+
+struct smmstore_params_delete {
+	void *key;
+	size_t keysize;
+};
+
 /* SMM responder */
 uint32_t smmstore_exec(uint8_t command, void *param);
 
@@ -46,5 +64,8 @@ uint32_t smmstore_exec(uint8_t command, void *param);
 int smmstore_read_region(void *buf, ssize_t *bufsize);
 int smmstore_append_data(void *key, uint32_t key_sz,
 	void *value, uint32_t value_sz);
+int smmstore_get_data(void *key, uint32_t key_sz,
+	void *value, uint32_t *value_sz);
+int smmstore_delete_data(void *key, uint32_t key_sz);
 int smmstore_clear_region(void);
 #endif
@@ -55,6 +55,13 @@ enum spi_flash_status_reg_lockdown {
 struct spi_flash_ops {
 	int (*read)(const struct spi_flash *flash, u32 offset, size_t len,
 			void *buf);
+	/*
+	 * Optional: start a read that completes in the background, and wait
+	 * for it to finish. Only one read can be pending at a time.
+	 */
+	int (*read_start)(const struct spi_flash *flash, u32 offset,
+			  size_t len, void *buf);
+	int (*read_wait)(const struct spi_flash *flash);
 	int (*write)(const struct spi_flash *flash, u32 offset, size_t len,
 			const void *buf);
 	int (*erase)(const struct spi_flash *flash, u32 offset, size_t len);
@@ -147,6 +154,14 @@ int spi_flash_read(const struct spi_flash *flash, u32 offset, size_t len,
 int spi_flash_write(const struct spi_flash *flash, u32 offset, size_t len,
 		    const void *buf);
 int spi_flash_erase(const struct spi_flash *flash, u32 offset, size_t len);
+/*
+ * Start a read, and wait for it to finish. The data is only valid after
+ * spi_flash_read_wait() returned. Flash drivers without support for
+ * background reads finish the read in spi_flash_read_start().
+ */
+int spi_flash_read_start(const struct spi_flash *flash, u32 offset,
+			 size_t len, void *buf);
+int spi_flash_read_wait(const struct spi_flash *flash);
 int spi_flash_status(const struct spi_flash *flash, u8 *reg);
 
 /*
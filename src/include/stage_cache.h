@@ -55,6 +55,9 @@ struct stage_cache {
 	uint64_t load_addr;
 	uint64_t entry_addr;
 	uint64_t arg;
+	/* CBFS_COMPRESS_NONE or CBFS_COMPRESS_LZ4 */
+	uint32_t compression;
+	uint32_t size;
 };
 
 #endif /* _STAGE_CACHE_H_ */
@@ -27,6 +27,20 @@ int __weak boot_device_wp_region(const struct region_device *rd,
 	return -1;
 }
 
+int __weak boot_device_read_start(const struct boot_device_read *rd)
+{
+	if (rdev_readat(rd->rdev, rd->buf, rd->offset, rd->size) != rd->size)
+		return -1;
+
+	return 0;
+}
+
+int __weak boot_device_read_wait(const struct boot_device_read *rd)
+{
+	/* The read was done synchronously. */
+	return 0;
+}
+
 static int boot_device_subregion(const struct region *sub,
 				struct region_device *subrd,
 				const struct region_device *parent)
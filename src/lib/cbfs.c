@@ -37,7 +37,8 @@
 #define DEBUG(x...)
 #endif
 
-int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
+static int cbfs_boot_locate_unmeasured(struct cbfsf *fh, const char *name,
+				       uint32_t *type)
 {
 	struct region_device rdev;
 	const struct region_device *boot_dev;
@@ -61,7 +62,12 @@ int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
 		return -1;
 	}
 
-	int ret = cbfs_locate(fh, &rdev, name, type);
+	return cbfs_locate(fh, &rdev, name, type);
+}
+
+int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
+{
+	int ret = cbfs_boot_locate_unmeasured(fh, name, type);
 	if (!ret)
 		if (vboot_measure_cbfs_hook(fh, name))
 			return -1;
@@ -72,9 +78,11 @@ int cbfs_boot_locate(struct cbfsf *fh, const char *name, uint32_t *type)
 void *cbfs_boot_map_with_leak(const char *name, uint32_t type, size_t *size)
 {
 	struct cbfsf fh;
+	struct vboot_cbfs_measurement m;
 	size_t fsize;
+	void *map;
 
-	if (cbfs_boot_locate(&fh, name, &type))
+	if (cbfs_boot_locate_unmeasured(&fh, name, &type))
 		return NULL;
 
 	fsize = region_device_sz(&fh.data);
@@ -82,7 +90,17 @@ void *cbfs_boot_map_with_leak(const char *name, uint32_t type, size_t *size)
 	if (size != NULL)
 		*size = fsize;
 
-	return rdev_mmap(&fh.data, 0, fsize);
+	map = rdev_mmap(&fh.data, 0, fsize);
+	if (map == NULL)
+		return NULL;
+
+	/* Measure the mapping, so the file is read only once. */
+	if (vboot_measure_cbfs_start(&m, &fh, name) ||
+	    vboot_measure_cbfs_update(&m, map, fsize) ||
+	    vboot_measure_cbfs_finish(&m))
+		return NULL;
+
+	return map;
 }
 
 int cbfs_locate_file_in_region(struct cbfsf *fh, const char *region_name,
@@ -99,8 +117,13 @@ int cbfs_locate_file_in_region(struct cbfsf *fh, const char *region_name,
 	return cbfs_locate(fh, &rdev, name, type);
 }
 
-size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
-	size_t in_size, void *buffer, size_t buffer_size, uint32_t compression)
+/*
+ * The data is measured as it is read, before it is decompressed, if m isn't
+ * NULL.
+ */
+static size_t load_and_decompress(const struct region_device *rdev,
+	size_t offset, size_t in_size, void *buffer, size_t buffer_size,
+	uint32_t compression, struct vboot_cbfs_measurement *m)
 {
 	size_t out_size;
 
@@ -110,6 +133,8 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 			return 0;
 		if (rdev_readat(rdev, buffer, offset, in_size) != in_size)
 			return 0;
+		if (m && vboot_measure_cbfs_update(m, buffer, in_size))
+			return 0;
 		return in_size;
 
 	case CBFS_COMPRESS_LZ4:
@@ -124,6 +149,8 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 		void *compr_start = buffer + buffer_size - in_size;
 		if (rdev_readat(rdev, compr_start, offset, in_size) != in_size)
 			return 0;
+		if (m && vboot_measure_cbfs_update(m, compr_start, in_size))
+			return 0;
 
 		timestamp_add_now(TS_START_ULZ4F);
 		out_size = ulz4fn(compr_start, in_size, buffer, buffer_size);
@@ -142,6 +169,10 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 		void *map = rdev_mmap(rdev, offset, in_size);
 		if (map == NULL)
 			return 0;
+		if (m && vboot_measure_cbfs_update(m, map, in_size)) {
+			rdev_munmap(rdev, map);
+			return 0;
+		}
 
 		/* Note: timestamp not useful for memory-mapped media (x86) */
 		timestamp_add_now(TS_START_ULZMA);
@@ -157,6 +188,13 @@ size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
 	}
 }
 
+size_t cbfs_load_and_decompress(const struct region_device *rdev, size_t offset,
+	size_t in_size, void *buffer, size_t buffer_size, uint32_t compression)
+{
+	return load_and_decompress(rdev, offset, in_size, buffer, buffer_size,
+				   compression, NULL);
+}
+
 static inline int tohex4(unsigned int c)
 {
 	return (c <= 9) ? (c + '0') : (c - 10 + 'a');
@@ -182,17 +220,9 @@ void *cbfs_boot_map_optionrom(uint16_t vendor, uint16_t device)
 
 void *cbfs_boot_load_stage_by_name(const char *name)
 {
-	struct cbfsf fh;
 	struct prog stage = PROG_INIT(PROG_UNKNOWN, name);
-	uint32_t type = CBFS_TYPE_STAGE;
-
-	if (cbfs_boot_locate(&fh, name, &type))
-		return NULL;
-
-	/* Chain data portion in the prog. */
-	cbfs_file_data(prog_rdev(&stage), &fh);
 
-	if (cbfs_prog_stage_load(&stage))
+	if (cbfs_boot_load_prog_stage(&stage))
 		return NULL;
 
 	return prog_entry(&stage);
@@ -202,10 +232,12 @@ size_t cbfs_boot_load_file(const char *name, void *buf, size_t buf_size,
 			   uint32_t type)
 {
 	struct cbfsf fh;
+	struct vboot_cbfs_measurement m;
 	uint32_t compression_algo;
 	size_t decompressed_size;
+	size_t size;
 
-	if (cbfs_boot_locate(&fh, name, &type) < 0)
+	if (cbfs_boot_locate_unmeasured(&fh, name, &type) < 0)
 		return 0;
 
 	if (cbfsf_decompression_info(&fh, &compression_algo,
@@ -214,8 +246,15 @@ size_t cbfs_boot_load_file(const char *name, void *buf, size_t buf_size,
 	    || decompressed_size > buf_size)
 		return 0;
 
-	return cbfs_load_and_decompress(&fh.data, 0, region_device_sz(&fh.data),
-					buf, buf_size, compression_algo);
+	if (vboot_measure_cbfs_start(&m, &fh, name))
+		return 0;
+
+	size = load_and_decompress(&fh.data, 0, region_device_sz(&fh.data),
+				   buf, buf_size, compression_algo, &m);
+	if (!size || vboot_measure_cbfs_finish(&m))
+		return 0;
+
+	return size;
 }
 
 size_t cbfs_prog_stage_section(struct prog *pstage, uintptr_t *base)
@@ -230,7 +269,8 @@ size_t cbfs_prog_stage_section(struct prog *pstage, uintptr_t *base)
 	return stage.memlen;
 }
 
-int cbfs_prog_stage_load(struct prog *pstage)
+static int prog_stage_load(struct prog *pstage,
+			   struct vboot_cbfs_measurement *m)
 {
 	struct cbfs_stage stage;
 	uint8_t *load;
@@ -241,6 +281,8 @@ int cbfs_prog_stage_load(struct prog *pstage)
 
 	if (rdev_readat(fh, &stage, 0, sizeof(stage)) != sizeof(stage))
 		return -1;
+	if (m && vboot_measure_cbfs_update(m, &stage, sizeof(stage)))
+		return -1;
 
 	fsize = region_device_sz(fh);
 	fsize -= sizeof(stage);
@@ -260,12 +302,15 @@ int cbfs_prog_stage_load(struct prog *pstage)
 		CONFIG(BOOT_DEVICE_MEMORY_MAPPED)) {
 		void *mapping = rdev_mmap(fh, foffset, fsize);
 		rdev_munmap(fh, mapping);
-		if (mapping == load)
+		if (mapping == load) {
+			if (m && vboot_measure_cbfs_update(m, load, fsize))
+				return -1;
 			goto out;
+		}
 	}
 
-	fsize = cbfs_load_and_decompress(fh, foffset, fsize, load,
-					 stage.memlen, stage.compression);
+	fsize = load_and_decompress(fh, foffset, fsize, load, stage.memlen,
+				    stage.compression, m);
 	if (!fsize)
 		return -1;
 
@@ -281,6 +326,36 @@ out:
 	return 0;
 }
 
+int cbfs_prog_stage_load(struct prog *pstage)
+{
+	return prog_stage_load(pstage, NULL);
+}
+
+int cbfs_boot_load_prog_stage(struct prog *pstage)
+{
+	struct cbfsf fh;
+	struct vboot_cbfs_measurement m;
+	uint32_t type = CBFS_TYPE_STAGE;
+
+	cbfs_prepare_program_locate();
+
+	if (cbfs_boot_locate_unmeasured(&fh, prog_name(pstage), &type))
+		return -1;
+
+	cbfsf_file_type(&fh, &pstage->cbfs_type);
+
+	/* Chain data portion in the prog. */
+	cbfs_file_data(prog_rdev(pstage), &fh);
+
+	if (vboot_measure_cbfs_start(&m, &fh, prog_name(pstage)))
+		return -1;
+
+	if (prog_stage_load(pstage, &m))
+		return -1;
+
+	return vboot_measure_cbfs_finish(&m) ? -1 : 0;
+}
+
 /* This only supports the "COREBOOT" fmap region. */
 static int cbfs_master_header_props(struct cbfs_props *props)
 {
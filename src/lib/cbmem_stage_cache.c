@@ -15,6 +15,9 @@
 
 #include <arch/early_variables.h>
 #include <cbmem.h>
+#include <commonlib/cbfs_serialized.h>
+#include <commonlib/compression.h>
+#include <lib.h>
 #include <stage_cache.h>
 #include <string.h>
 #include <console/console.h>
@@ -24,6 +27,7 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 {
 	struct stage_cache *meta;
 	void *c;
+	size_t size, csize;
 
 	meta = cbmem_add(CBMEM_ID_STAGEx_META + stage_id, sizeof(*meta));
 	if (meta == NULL) {
@@ -34,15 +38,29 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	meta->load_addr = (uintptr_t)prog_start(stage);
 	meta->entry_addr = (uintptr_t)prog_entry(stage);
 	meta->arg = (uintptr_t)prog_entry_arg(stage);
+	meta->compression = CBFS_COMPRESS_NONE;
+	meta->size = prog_size(stage);
+
+	size = prog_size(stage);
+	if (CONFIG(COMPRESS_STAGE_CACHE)) {
+		csize = lz4fn(prog_start(stage), size, NULL, size);
+		if (csize) {
+			meta->compression = CBFS_COMPRESS_LZ4;
+			size = csize;
+		}
+	}
 
-	c = cbmem_add(CBMEM_ID_STAGEx_CACHE + stage_id, prog_size(stage));
+	c = cbmem_add(CBMEM_ID_STAGEx_CACHE + stage_id, size);
 	if (c == NULL) {
 		printk(BIOS_ERR, "Error: Can't add stage_cache %x to cbmem\n",
 				CBMEM_ID_STAGEx_CACHE + stage_id);
 		return;
 	}
 
-	memcpy(c, prog_start(stage), prog_size(stage));
+	if (meta->compression == CBFS_COMPRESS_LZ4)
+		lz4fn(prog_start(stage), prog_size(stage), c, size);
+	else
+		memcpy(c, prog_start(stage), size);
 }
 
 void stage_cache_add_raw(int stage_id, const void *base, const size_t size)
@@ -103,7 +121,16 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	size = cbmem_entry_size(e);
 	load_addr = (void *)(uintptr_t)meta->load_addr;
 
-	memcpy(load_addr, c, size);
+	if (meta->compression == CBFS_COMPRESS_LZ4) {
+		if (ulz4fn(c, size, load_addr, meta->size) != meta->size) {
+			printk(BIOS_ERR, "Error: Can't decompress stage_cache %x\n",
+					CBMEM_ID_STAGEx_CACHE + stage_id);
+			return;
+		}
+		size = meta->size;
+	} else {
+		memcpy(load_addr, c, size);
+	}
 
 	prog_set_area(stage, load_addr, size);
 	prog_set_entry(stage, (void *)(uintptr_t)meta->entry_addr,
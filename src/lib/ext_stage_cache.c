@@ -16,8 +16,11 @@
 #include <arch/early_variables.h>
 #include <bootstate.h>
 #include <cbmem.h>
+#include <commonlib/cbfs_serialized.h>
+#include <commonlib/compression.h>
 #include <console/console.h>
 #include <imd.h>
+#include <lib.h>
 #include <stage_cache.h>
 #include <string.h>
 
@@ -63,6 +66,7 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	const struct imd_entry *e;
 	struct stage_cache *meta;
 	void *c;
+	size_t size, csize;
 
 	imd = imd_get();
 	e = imd_entry_add(imd, CBMEM_ID_STAGEx_META + stage_id, sizeof(*meta));
@@ -78,9 +82,19 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	meta->load_addr = (uintptr_t)prog_start(stage);
 	meta->entry_addr = (uintptr_t)prog_entry(stage);
 	meta->arg = (uintptr_t)prog_entry_arg(stage);
+	meta->compression = CBFS_COMPRESS_NONE;
+	meta->size = prog_size(stage);
+
+	size = prog_size(stage);
+	if (CONFIG(COMPRESS_STAGE_CACHE)) {
+		csize = lz4fn(prog_start(stage), size, NULL, size);
+		if (csize) {
+			meta->compression = CBFS_COMPRESS_LZ4;
+			size = csize;
+		}
+	}
 
-	e = imd_entry_add(imd, CBMEM_ID_STAGEx_CACHE + stage_id,
-				prog_size(stage));
+	e = imd_entry_add(imd, CBMEM_ID_STAGEx_CACHE + stage_id, size);
 
 	if (e == NULL) {
 		printk(BIOS_DEBUG, "Error: Can't add stage_cache %x to imd\n",
@@ -90,7 +104,10 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 
 	c = imd_entry_at(imd, e);
 
-	memcpy(c, prog_start(stage), prog_size(stage));
+	if (meta->compression == CBFS_COMPRESS_LZ4)
+		lz4fn(prog_start(stage), prog_size(stage), c, size);
+	else
+		memcpy(c, prog_start(stage), size);
 }
 
 void stage_cache_add_raw(int stage_id, const void *base, const size_t size)
@@ -163,7 +180,17 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	c = imd_entry_at(imd, e);
 	size = imd_entry_size(imd, e);
 
-	memcpy((void *)(uintptr_t)meta->load_addr, c, size);
+	if (meta->compression == CBFS_COMPRESS_LZ4) {
+		if (ulz4fn(c, size, (void *)(uintptr_t)meta->load_addr,
+			   meta->size) != meta->size) {
+			printk(BIOS_DEBUG, "Error: Can't decompress stage_cache %x\n",
+					CBMEM_ID_STAGEx_CACHE + stage_id);
+			return;
+		}
+		size = meta->size;
+	} else {
+		memcpy((void *)(uintptr_t)meta->load_addr, c, size);
+	}
 
 	prog_set_area(stage, (void *)(uintptr_t)meta->load_addr, size);
 	prog_set_entry(stage, (void *)(uintptr_t)meta->entry_addr,
@@ -0,0 +1,187 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * A simple, greedy LZ4 compressor. It doesn't compress as well as the
+ * reference implementation, but it is small, needs only a little scratch
+ * space and is fast enough to compress stages at boot time.
+ */
+
+#include <commonlib/endian.h>
+#include <commonlib/helpers.h>
+#include <lib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LZ4F_MAGICNUMBER	0x184D2204
+/* Version 1, independent blocks, no checksums and no content size. */
+#define LZ4F_FLAGS		0x60
+/* Blocks of up to 64KiB, so that a position in a block fits 16 bits. */
+#define LZ4F_BLOCK_DESCRIPTOR	0x40
+#define LZ4F_BLOCK_SIZE		(64 * KiB)
+#define LZ4F_NOT_COMPRESSED	(1U << 31)
+
+#define MIN_MATCH		4
+/* The last match has to start 12 bytes and end 5 bytes before the end. */
+#define MF_LIMIT		12
+#define LAST_LITERALS		5
+
+#define HASH_LOG		11
+
+struct lz4_out {
+	uint8_t *dst;
+	size_t pos;
+	size_t limit;
+};
+
+static int out_bytes(struct lz4_out *o, const void *src, size_t n)
+{
+	if (o->limit - o->pos < n)
+		return -1;
+
+	if (o->dst)
+		memcpy(o->dst + o->pos, src, n);
+	o->pos += n;
+
+	return 0;
+}
+
+static int out_byte(struct lz4_out *o, uint8_t b)
+{
+	return out_bytes(o, &b, sizeof(b));
+}
+
+static int out_le32(struct lz4_out *o, uint32_t val)
+{
+	uint8_t b[4];
+
+	write_le32(b, val);
+	return out_bytes(o, b, sizeof(b));
+}
+
+/* Lengths that don't fit the token are continued in bytes of up to 255. */
+static int out_length(struct lz4_out *o, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		if (out_byte(o, 255))
+			return -1;
+	}
+
+	return out_byte(o, len);
+}
+
+/* Without a match this is the last sequence of a block. */
+static int out_sequence(struct lz4_out *o, const uint8_t *literals,
+			size_t literal_len, size_t offset, size_t match_len)
+{
+	size_t ml = match_len ? match_len - MIN_MATCH : 0;
+
+	if (out_byte(o, MIN(literal_len, 15) << 4 | MIN(ml, 15)))
+		return -1;
+	if (literal_len >= 15 && out_length(o, literal_len - 15))
+		return -1;
+	if (out_bytes(o, literals, literal_len))
+		return -1;
+
+	if (!match_len)
+		return 0;
+
+	if (out_byte(o, offset & 0xff) || out_byte(o, offset >> 8))
+		return -1;
+	if (ml >= 15 && out_length(o, ml - 15))
+		return -1;
+
+	return 0;
+}
+
+static uint32_t hash(const uint8_t *p)
+{
+	return (read_le32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static int compress_block(struct lz4_out *o, const uint8_t *src, size_t len)
+{
+	MAYBE_STATIC uint16_t table[1 << HASH_LOG];
+	const uint8_t *anchor = src;
+	const uint8_t *ip = src;
+	const uint8_t *ref;
+	uint32_t h;
+	size_t ml;
+
+	/* Stale entries are fine, every candidate is compared anyway. */
+	memset(table, 0, sizeof(table));
+
+	while (len > MF_LIMIT && ip < src + len - MF_LIMIT) {
+		h = hash(ip);
+		ref = src + table[h];
+		table[h] = ip - src;
+
+		if (ref >= ip || read_le32(ref) != read_le32(ip)) {
+			ip++;
+			continue;
+		}
+
+		for (ml = MIN_MATCH; ip + ml < src + len - LAST_LITERALS &&
+		     ref[ml] == ip[ml]; ml++)
+			;
+
+		if (out_sequence(o, anchor, ip - anchor, ip - ref, ml))
+			return -1;
+
+		ip += ml;
+		anchor = ip;
+	}
+
+	return out_sequence(o, anchor, src + len - anchor, 0, 0);
+}
+
+size_t lz4fn(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	struct lz4_out o = { .dst = dst, .pos = 0, .limit = dstn };
+	struct lz4_out block;
+	const uint8_t *in = src;
+	size_t offset, len;
+
+	/* The header checksum is left out, ulz4fn() doesn't check it. */
+	if (out_le32(&o, LZ4F_MAGICNUMBER) || out_byte(&o, LZ4F_FLAGS) ||
+	    out_byte(&o, LZ4F_BLOCK_DESCRIPTOR) || out_byte(&o, 0))
+		return 0;
+
+	for (offset = 0; offset < srcn; offset += len) {
+		len = MIN(srcn - offset, LZ4F_BLOCK_SIZE);
+
+		if (dstn - o.pos < sizeof(uint32_t))
+			return 0;
+
+		/* Only keep the compressed block if it is smaller. */
+		block.dst = dst;
+		block.pos = o.pos + sizeof(uint32_t);
+		block.limit = MIN(dstn, block.pos + len - 1);
+
+		if (!compress_block(&block, in + offset, len)) {
+			if (out_le32(&o, block.pos - o.pos - sizeof(uint32_t)))
+				return 0;
+			o.pos = block.pos;
+		} else if (out_le32(&o, len | LZ4F_NOT_COMPRESSED) ||
+			   out_bytes(&o, in + offset, len)) {
+			return 0;
+		}
+	}
+
+	/* End mark */
+	if (out_le32(&o, 0))
+		return 0;
+
+	return o.pos;
+}
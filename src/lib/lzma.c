@@ -16,7 +16,8 @@
 
 #include "lzmadecode.h"
 
-size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
+size_t ulzman_scratch(const void *src, size_t srcn, void *dst, size_t dstn,
+		      void *scratchpad)
 {
 	unsigned char properties[LZMA_PROPERTIES_SIZE];
 	const int data_offset = LZMA_PROPERTIES_SIZE + 8;
@@ -26,7 +27,6 @@ size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
 	int res;
 	CLzmaDecoderState state;
 	SizeT mallocneeds;
-	MAYBE_STATIC unsigned char scratchpad[15980];
 	const unsigned char *cp;
 
 	memcpy(properties, src, LZMA_PROPERTIES_SIZE);
@@ -44,7 +44,7 @@ size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
 		return 0;
 	}
 	mallocneeds = (LzmaGetNumProbs(&state.Properties) * sizeof(CProb));
-	if (mallocneeds > 15980) {
+	if (mallocneeds > ULZMAN_SCRATCHPAD_SIZE) {
 		printk(BIOS_WARNING, "lzma: Decoder scratchpad too small!\n");
 		return 0;
 	}
@@ -57,3 +57,10 @@ size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
 	}
 	return outProcessed;
 }
+
+size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	MAYBE_STATIC unsigned char scratchpad[ULZMAN_SCRATCHPAD_SIZE];
+
+	return ulzman_scratch(src, srcn, dst, dstn, scratchpad);
+}
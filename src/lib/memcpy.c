@@ -1,11 +1,36 @@
 #include <string.h>
+#include <stdint.h>
+
 void *memcpy(void *vdest, const void *vsrc, size_t bytes)
 {
 	const char *src = vsrc;
 	char *dest = vdest;
-	int i;
+	size_t i;
+
+	/* Copy whole words when source and destination can be aligned. */
+	if ((((uintptr_t)dest ^ (uintptr_t)src) & (sizeof(long) - 1)) == 0) {
+		while (bytes && ((uintptr_t)dest & (sizeof(long) - 1))) {
+			*dest++ = *src++;
+			bytes--;
+		}
+
+		for (; bytes >= 4 * sizeof(long); bytes -= 4 * sizeof(long)) {
+			((long *)dest)[0] = ((const long *)src)[0];
+			((long *)dest)[1] = ((const long *)src)[1];
+			((long *)dest)[2] = ((const long *)src)[2];
+			((long *)dest)[3] = ((const long *)src)[3];
+			dest += 4 * sizeof(long);
+			src += 4 * sizeof(long);
+		}
+
+		for (; bytes >= sizeof(long); bytes -= sizeof(long)) {
+			*(long *)dest = *(const long *)src;
+			dest += sizeof(long);
+			src += sizeof(long);
+		}
+	}
 
-	for (i = 0; i < (int)bytes; i++)
+	for (i = 0; i < bytes; i++)
 		dest[i] = src[i];
 
 	return vdest;
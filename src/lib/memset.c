@@ -1,11 +1,38 @@
 #include <string.h>
+#include <stdint.h>
 
 void *memset(void *s, int c, size_t n)
 {
-	int i;
 	char *ss = (char *) s;
+	unsigned long w = (unsigned char)c;
+	size_t i;
 
-	for (i = 0; i < (int)n; i++)
+	while (n && ((uintptr_t)ss & (sizeof(long) - 1))) {
+		*ss++ = c;
+		n--;
+	}
+
+	if (n >= sizeof(long)) {
+		/* Fill every byte of the word with c. */
+		w |= w << 8;
+		w |= w << 16;
+		w |= w << 16 << 16;
+
+		for (; n >= 4 * sizeof(long); n -= 4 * sizeof(long)) {
+			((unsigned long *)ss)[0] = w;
+			((unsigned long *)ss)[1] = w;
+			((unsigned long *)ss)[2] = w;
+			((unsigned long *)ss)[3] = w;
+			ss += 4 * sizeof(long);
+		}
+
+		for (; n >= sizeof(long); n -= sizeof(long)) {
+			*(unsigned long *)ss = w;
+			ss += sizeof(long);
+		}
+	}
+
+	for (i = 0; i < n; i++)
 		ss[i] = c;
 
 	return s;
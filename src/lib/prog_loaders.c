@@ -55,12 +55,9 @@ void run_romstage(void)
 	struct prog romstage =
 		PROG_INIT(PROG_ROMSTAGE, CONFIG_CBFS_PREFIX "/romstage");
 
-	if (prog_locate(&romstage))
-		goto fail;
-
 	timestamp_add_now(TS_START_COPYROM);
 
-	if (cbfs_prog_stage_load(&romstage))
+	if (cbfs_boot_load_prog_stage(&romstage))
 		goto fail;
 
 	timestamp_add_now(TS_END_COPYROM);
@@ -14,7 +14,9 @@
  * GNU General Public License for more details.
  */
 
+#include <console/console.h>
 #include <program_loading.h>
+#include <security/vboot/vboot_crtm.h>
 
 /* For each segment of a program loaded this function is called*/
 void prog_segment_loaded(uintptr_t start, size_t size, int flags)
@@ -37,6 +39,11 @@ void __weak arch_segment_loaded(uintptr_t start, size_t size,
 
 void prog_run(struct prog *prog)
 {
+	/* The measurements have to be in the TPM before the program runs. */
+	if (CONFIG(VBOOT_MEASURED_BOOT_DEFERRED) && !ENV_DECOMPRESSOR &&
+	    vboot_measure_flush())
+		die("TPM: Couldn't extend the deferred measurements.\n");
+
 	platform_prog_run(prog);
 	arch_prog_run(prog);
 }
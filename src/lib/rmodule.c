@@ -53,7 +53,8 @@ int rmodule_parse(void *ptr, struct rmodule *module)
 	/* Sanity check the raw data. */
 	if (rhdr->magic != RMODULE_MAGIC)
 		return -1;
-	if (rhdr->version != RMODULE_VERSION_1)
+	if (rhdr->version != RMODULE_VERSION_1 &&
+	    rhdr->version != RMODULE_VERSION_2)
 		return -1;
 
 	/* Indicate the module hasn't been loaded yet. */
@@ -124,11 +125,6 @@ static inline size_t rmodule_number_relocations(const struct rmodule *module)
 
 static void rmodule_copy_payload(const struct rmodule *module)
 {
-	printk(BIOS_DEBUG, "Loading module at %p with entry %p. "
-	       "filesize: 0x%x memsize: 0x%x\n",
-	       module->location, rmodule_entry(module),
-	       module->payload_size, rmodule_memory_size(module));
-
 	/* No need to copy the payload if the load location and the
 	 * payload location are the same. */
 	if (module->location == module->payload)
@@ -170,6 +166,86 @@ static int rmodule_relocate(const struct rmodule *module)
 	return 0;
 }
 
+/*
+ * Copy the payload and apply the relocations of a version 2 rmodule in one
+ * pass: each relocated pointer is read from the payload, adjusted and
+ * written to the load location along with the bytes before it.
+ */
+static int rmodule_copy_and_relocate(const struct rmodule *module)
+{
+	const uint8_t *reloc, *end;
+	const char *src = module->payload;
+	char *dst = module->location;
+	size_t copied, offset, count;
+	uintptr_t adjustment, addr, link_start;
+	uintptr_t *adjust_loc;
+	uint32_t val, run;
+	size_t n;
+
+	adjustment = (uintptr_t)rmodule_load_addr(module, 0);
+	link_start = module->header->module_link_start_address;
+
+	reloc = module->relocations;
+	end = reloc + module->header->relocations_end_offset -
+	      module->header->relocations_begin_offset;
+
+	copied = 0;
+	count = 0;
+	addr = 0;
+	while (reloc < end) {
+		n = rmodule_read_uleb128(reloc, end, &val);
+		if (!n)
+			return -1;
+		reloc += n;
+
+		run = 0;
+		if (val & 1) {
+			n = rmodule_read_uleb128(reloc, end, &run);
+			if (!n)
+				return -1;
+			reloc += n;
+		}
+
+		for (addr += val >> 1;; addr += sizeof(uintptr_t)) {
+			offset = addr - link_start;
+			if (addr < link_start || offset < copied ||
+			    offset + sizeof(uintptr_t) > module->payload_size) {
+				printk(BIOS_ERR, "Relocation 0x%08lx out of place\n",
+				       (unsigned long)addr);
+				return -1;
+			}
+
+			if (dst != src)
+				memcpy(&dst[copied], &src[copied],
+				       offset - copied);
+
+			adjust_loc = (uintptr_t *)&dst[offset];
+			printk(PK_ADJ_LEVEL, "Adjusting %p: 0x%08lx -> 0x%08lx\n",
+			       adjust_loc,
+			       (unsigned long)*(const uintptr_t *)&src[offset],
+			       (unsigned long)(*(const uintptr_t *)&src[offset]
+					       + adjustment));
+			*adjust_loc = *(const uintptr_t *)&src[offset] +
+				      adjustment;
+
+			copied = offset + sizeof(uintptr_t);
+			count++;
+
+			if (!run--)
+				break;
+		}
+	}
+
+	if (dst != src)
+		memcpy(&dst[copied], &src[copied],
+		       module->payload_size - copied);
+
+	printk(BIOS_DEBUG, "Processed %zu relocs. Offset value of 0x%08lx\n",
+	       count, (unsigned long)adjustment);
+
+	return 0;
+}
+
 int rmodule_load_alignment(const struct rmodule *module)
 {
 	/* The load alignment is the start of the program's linked address.
@@ -189,11 +265,23 @@ int rmodule_load(void *base, struct rmodule *module)
 	 *  3. Clear the bss segment last since the relocations live where
 	 *     the bss is. If an rmodule is being loaded from its load
 	 *     address the relocations need to be processed before the bss.
+	 * Version 2 rmodules do the first two steps in one pass.
 	 */
 	module->location = base;
-	rmodule_copy_payload(module);
-	if (rmodule_relocate(module))
-		return -1;
+
+	printk(BIOS_DEBUG, "Loading module at %p with entry %p. "
+	       "filesize: 0x%x memsize: 0x%x\n",
+	       module->location, rmodule_entry(module),
+	       module->payload_size, rmodule_memory_size(module));
+
+	if (module->header->version == RMODULE_VERSION_2) {
+		if (rmodule_copy_and_relocate(module))
+			return -1;
+	} else {
+		rmodule_copy_payload(module);
+		if (rmodule_relocate(module))
+			return -1;
+	}
 	rmodule_clear_bss(module);
 
 	prog_segment_loaded((uintptr_t)module->location,
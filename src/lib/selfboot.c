@@ -28,6 +28,11 @@
 #include <program_loading.h>
 #include <timestamp.h>
 #include <cbmem.h>
+#if CONFIG(PARALLEL_MP_AP_WORK) && ENV_RAMSTAGE
+#include <cpu/x86/mp.h>
+#include <smp/spinlock.h>
+#include <timer.h>
+#endif
 
 /* The type syntax for C is essentially unparsable. -- Rob Pike */
 typedef int (*checker_t)(struct cbfs_payload_segment *cbfssegs, void *args);
@@ -72,6 +77,8 @@ static int load_one_segment(uint8_t *dest,
 		printk(BIOS_DEBUG, "Loading Segment: addr: 0x%p memsz: 0x%016zx filesz: 0x%016zx\n",
 		       dest, memsz, len);
 
+		timestamp_add_now(TS_START_PAYLOAD_SEGMENT);
+
 		/* Compute the boundaries of the segment */
 		end = dest + memsz;
 
@@ -123,6 +130,8 @@ static int load_one_segment(uint8_t *dest,
 			memset(middle, 0, end - middle);
 		}
 
+		timestamp_add_now(TS_END_PAYLOAD_SEGMENT);
+
 		/*
 		 * Each architecture can perform additional operations
 		 * on the loaded segment
@@ -162,6 +171,255 @@ static int check_payload_segments(struct cbfs_payload_segment *cbfssegs,
 	return 0;
 }
 
+#if CONFIG(PARALLEL_MP_AP_WORK) && ENV_RAMSTAGE
+/*
+ * The segments of a payload can be loaded on all CPUs in parallel, as long
+ * as no segment is written over another one or over the data of another one.
+ */
+struct segment_job {
+	uint8_t *dest;
+	const uint8_t *src;
+	size_t len;
+	size_t memsz;
+	uint32_t compression;
+	int loaded;
+	uint64_t start;
+	uint64_t end;
+};
+
+/* LZMA needs a scratchpad per decoder, these many run at the same time. */
+#define LZMA_DECODERS	4
+
+static uint8_t lzma_scratchpads[LZMA_DECODERS][ULZMAN_SCRATCHPAD_SIZE];
+
+/* Which of lzma_scratchpads are in use, shared with the APs. */
+static int scratchpad_busy[LZMA_DECODERS];
+
+DECLARE_SPIN_LOCK(scratchpad_lock)
+
+static int get_lzma_scratchpad(void)
+{
+	int i;
+
+	while (1) {
+		spin_lock(&scratchpad_lock);
+		for (i = 0; i < LZMA_DECODERS; i++) {
+			if (!scratchpad_busy[i]) {
+				scratchpad_busy[i] = 1;
+				spin_unlock(&scratchpad_lock);
+				return i;
+			}
+		}
+		spin_unlock(&scratchpad_lock);
+		cpu_relax();
+	}
+}
+
+static void put_lzma_scratchpad(int i)
+{
+	spin_lock(&scratchpad_lock);
+	scratchpad_busy[i] = 0;
+	spin_unlock(&scratchpad_lock);
+}
+
+static void load_segment_job(struct segment_job *job)
+{
+	size_t len = job->len;
+	int i;
+
+	switch (job->compression) {
+	case CBFS_COMPRESS_LZMA:
+		i = get_lzma_scratchpad();
+		len = ulzman_scratch(job->src, len, job->dest, job->memsz,
+				     lzma_scratchpads[i]);
+		put_lzma_scratchpad(i);
+		if (!len)
+			return;
+		break;
+	case CBFS_COMPRESS_LZ4:
+		len = ulz4fn(job->src, len, job->dest, job->memsz);
+		if (!len)
+			return;
+		break;
+	case CBFS_COMPRESS_NONE:
+		memcpy(job->dest, job->src, len);
+		break;
+	default:
+		return;
+	}
+
+	if (len < job->memsz)
+		memset(job->dest + len, 0, job->memsz - len);
+
+	job->loaded = 1;
+}
+
+static void load_segments_worker(void *arg, int index)
+{
+	struct segment_job *job = (struct segment_job *)arg + index;
+
+	job->start = timestamp_get();
+	load_segment_job(job);
+	job->end = timestamp_get();
+}
+
+static int ranges_overlap(const uint8_t *a, size_t a_len, const uint8_t *b,
+			  size_t b_len)
+{
+	if (!a_len || !b_len)
+		return 0;
+
+	return a < b + b_len && b < a + a_len;
+}
+
+static int segment_jobs_overlap(const struct segment_job *jobs, int count)
+{
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < count; j++) {
+			if (i == j)
+				continue;
+			if (ranges_overlap(jobs[i].dest, jobs[i].memsz,
+					   jobs[j].dest, jobs[j].memsz) ||
+			    ranges_overlap(jobs[i].dest, jobs[i].memsz,
+					   jobs[j].src, jobs[j].len))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The timestamps of the segments are only added by the BSP, once they are
+ * all loaded. Keep the table in order, it isn't sorted by the readers.
+ */
+static void add_segment_timestamps(const struct segment_job *jobs, int count)
+{
+	struct timestamp_entry *ts;
+	struct timestamp_entry tmp;
+	int i, j;
+
+	ts = malloc(2 * count * sizeof(*ts));
+	if (ts == NULL)
+		return;
+
+	for (i = 0; i < count; i++) {
+		ts[2 * i].entry_id = TS_START_PAYLOAD_SEGMENT;
+		ts[2 * i].entry_stamp = jobs[i].start;
+		ts[2 * i + 1].entry_id = TS_END_PAYLOAD_SEGMENT;
+		ts[2 * i + 1].entry_stamp = jobs[i].end;
+	}
+
+	for (i = 1; i < 2 * count; i++) {
+		tmp = ts[i];
+		for (j = i; j > 0 && ts[j - 1].entry_stamp > tmp.entry_stamp;
+		     j--)
+			ts[j] = ts[j - 1];
+		ts[j] = tmp;
+	}
+
+	for (i = 0; i < 2 * count; i++)
+		timestamp_add(ts[i].entry_id, ts[i].entry_stamp);
+
+	free(ts);
+}
+
+/*
+ * Returns 0 on success, -1 on error and 1 if the payload has to be loaded
+ * serially instead.
+ */
+static int load_segments_parallel(struct cbfs_payload_segment *cbfssegs,
+				  uintptr_t *entry)
+{
+	struct cbfs_payload_segment *seg, segment;
+	struct segment_job *jobs, *job;
+	int count, i;
+
+	for (count = 0, seg = cbfssegs;; ++seg, ++count) {
+		if (read_be32(&seg->type) == PAYLOAD_SEGMENT_ENTRY)
+			break;
+	}
+
+	if (count < 2)
+		return 1;
+
+	jobs = malloc(count * sizeof(*jobs));
+	if (jobs == NULL)
+		return 1;
+
+	for (i = 0, seg = cbfssegs; i < count; i++, seg++) {
+		cbfs_decode_payload_segment(&segment, seg);
+		job = &jobs[i];
+		job->dest = (uint8_t *)(uintptr_t)segment.load_addr;
+		job->src = (uint8_t *)cbfssegs + segment.offset;
+		job->len = MIN(segment.len, segment.mem_len);
+		job->memsz = segment.mem_len;
+		job->compression = segment.compression;
+		job->loaded = 0;
+
+		switch (segment.type) {
+		case PAYLOAD_SEGMENT_CODE:
+		case PAYLOAD_SEGMENT_DATA:
+			break;
+		case PAYLOAD_SEGMENT_BSS:
+			job->len = 0;
+			job->compression = CBFS_COMPRESS_NONE;
+			break;
+		default:
+			/* Leave the complaining to the serial loader. */
+			free(jobs);
+			return 1;
+		}
+	}
+
+	if (segment_jobs_overlap(jobs, count)) {
+		printk(BIOS_DEBUG, "Payload segments overlap, loading serially\n");
+		free(jobs);
+		return 1;
+	}
+
+	for (i = 0; i < count; i++)
+		printk(BIOS_DEBUG, "Loading Segment: addr: 0x%p memsz: 0x%016zx filesz: 0x%016zx compression: %x\n",
+		       jobs[i].dest, jobs[i].memsz, jobs[i].len,
+		       jobs[i].compression);
+
+	if (mp_run_work_items(load_segments_worker, jobs, count,
+			      100 * USECS_PER_MSEC) < 0)
+		printk(BIOS_WARNING,
+		       "Not all APs accepted to load payload segments\n");
+
+	add_segment_timestamps(jobs, count);
+
+	for (i = 0; i < count; i++) {
+		if (!jobs[i].loaded) {
+			printk(BIOS_ERR, "Failed to load segment to 0x%p\n",
+			       jobs[i].dest);
+			free(jobs);
+			return -1;
+		}
+		prog_segment_loaded((uintptr_t)jobs[i].dest, jobs[i].memsz,
+				    i == count - 1 ? SEG_FINAL : 0);
+	}
+
+	free(jobs);
+
+	cbfs_decode_payload_segment(&segment, seg);
+	printk(BIOS_DEBUG, "  Entry Point 0x%p\n",
+	       (void *)(intptr_t)segment.load_addr);
+	*entry = segment.load_addr;
+
+	return 0;
+}
+#else
+static int load_segments_parallel(struct cbfs_payload_segment *cbfssegs,
+				  uintptr_t *entry)
+{
+	return 1;
+}
+#endif
+
 static int load_payload_segments(struct cbfs_payload_segment *cbfssegs, uintptr_t *entry)
 {
 	uint8_t *dest, *src;
@@ -169,6 +427,11 @@ static int load_payload_segments(struct cbfs_payload_segment *cbfssegs, uintptr_
 	uint32_t compression;
 	struct cbfs_payload_segment *first_segment, *seg, segment;
 	int flags = 0;
+	int ret;
+
+	ret = load_segments_parallel(cbfssegs, entry);
+	if (ret <= 0)
+		return ret;
 
 	for (first_segment = seg = cbfssegs;; ++seg) {
 		printk(BIOS_DEBUG, "Loading segment from ROM address 0x%p\n", seg);
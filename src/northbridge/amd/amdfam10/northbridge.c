@@ -1477,6 +1477,7 @@ static void cpu_bus_scan(struct device *dev)
 						printk(BIOS_DEBUG, "%s\n",dev_path(dev_mc));
 						dev_mc = dev_mc->sibling;
 					}
+					dev_rebuild_index();
 				}
 			}
 		}
@@ -22,6 +22,9 @@
 #include <commonlib/tcpa_log_serialized.h>
 #include <commonlib/region.h>
 #include <vb2_api.h>
+#if CONFIG(VBOOT)
+#include <vb2_sha.h>
+#endif
 
 #define TPM_PCR_MAX_LEN 64
 #define HASH_DATA_CHUNK_SIZE 1024
@@ -58,11 +61,20 @@ void tcpa_log_dump(void *unused);
  * @param digest_len the length of the digest
  * @param name sets additional info where the digest comes from
  * @return TPM_SUCCESS on success. If not a tpm error is returned
+ *
+ * With VBOOT_MEASURED_BOOT_DEFERRED the digest is only queued, and the PCR
+ * extended and the TCPA log entry added by tpm_flush_extends().
  */
 uint32_t tpm_extend_pcr(int pcr, enum vb2_hash_algorithm digest_algo,
 			uint8_t *digest, size_t digest_len,
 			const char *name);
 
+/**
+ * Extend the PCRs with the queued digests, in the order they were queued.
+ * @return TPM_SUCCESS on success. If not a tpm error is returned
+ */
+uint32_t tpm_flush_extends(void);
+
 /**
  * Issue a TPM_Clear and reenable/reactivate the TPM.
  * @return TPM_SUCCESS on success. If not a tpm error is returned
@@ -76,6 +88,43 @@ uint32_t tpm_clear_and_reenable(void);
  */
 uint32_t tpm_setup(int s3flag);
 
+#if CONFIG(VBOOT)
+/* State of a measurement that is passed the data piece by piece. */
+struct tpm_measurement {
+	struct vb2_digest_context ctx;
+	enum vb2_hash_algorithm hash_alg;
+	int hwcrypto;
+};
+
+/**
+ * Start measuring data that is passed in pieces, e.g. while it is loaded.
+ * @param *m Measurement state
+ * @param size Total size of the data
+ * @return TPM error code in case of error otherwise TPM_SUCCESS
+ */
+uint32_t tpm_measure_start(struct tpm_measurement *m, size_t size);
+
+/**
+ * Add the next piece of data to a measurement.
+ * @param *m Measurement state
+ * @param *data Pointer to the data
+ * @param size Size of the data
+ * @return TPM error code in case of error otherwise TPM_SUCCESS
+ */
+uint32_t tpm_measure_update(struct tpm_measurement *m, const void *data,
+			    size_t size);
+
+/**
+ * Finish a measurement and extend given PCR with the result.
+ * @param *m Measurement state
+ * @param pcr Index of the PCR which will be extended by this measure
+ * @param *name Name of the data that is measured
+ * @return TPM error code in case of error otherwise TPM_SUCCESS
+ */
+uint32_t tpm_measure_finish(struct tpm_measurement *m, uint8_t pcr,
+			    const char *name);
+#endif
+
 /**
  * Measure a given region device and extend given PCR with the result.
  * @param *rdev Pointer to the region device to measure
@@ -15,11 +15,13 @@
  * GNU General Public License for more details.
  */
 
+#include <arch/early_variables.h>
 #include <console/cbmem_console.h>
 #include <console/console.h>
 #include <security/tpm/tspi.h>
 #include <security/tpm/tss.h>
 #include <stdlib.h>
+#include <string.h>
 #if CONFIG(VBOOT)
 #include <vb2_api.h>
 #include <vb2_sha.h>
@@ -201,14 +203,12 @@ uint32_t tpm_clear_and_reenable(void)
 	return TPM_SUCCESS;
 }
 
-uint32_t tpm_extend_pcr(int pcr, enum vb2_hash_algorithm digest_algo,
-			uint8_t *digest, size_t digest_len, const char *name)
+static uint32_t extend_pcr_now(int pcr, enum vb2_hash_algorithm digest_algo,
+			       const uint8_t *digest, size_t digest_len,
+			       const char *name)
 {
 	uint32_t result;
 
-	if (!digest)
-		return TPM_E_IOERROR;
-
 	result = tlcl_extend(pcr, digest, NULL);
 	if (result != TPM_SUCCESS)
 		return result;
@@ -220,36 +220,159 @@ uint32_t tpm_extend_pcr(int pcr, enum vb2_hash_algorithm digest_algo,
 	return TPM_SUCCESS;
 }
 
-#if CONFIG(VBOOT)
-uint32_t tpm_measure_region(const struct region_device *rdev, uint8_t pcr,
-			    const char *rname)
+#define TPM_DEFERRED_EXTENDS 8
+
+struct deferred_extend {
+	int pcr;
+	enum vb2_hash_algorithm digest_algo;
+	uint8_t digest[TPM_PCR_MAX_LEN];
+	size_t digest_len;
+	char name[TCPA_PCR_HASH_NAME];
+};
+
+struct deferred_extends {
+	size_t count;
+	struct deferred_extend entries[TPM_DEFERRED_EXTENDS];
+};
+
+static struct deferred_extends deferred_extends CAR_GLOBAL;
+
+uint32_t tpm_flush_extends(void)
 {
-	uint8_t digest[TPM_PCR_MAX_LEN], digest_len;
-	uint8_t buf[HASH_DATA_CHUNK_SIZE];
-	uint32_t result, offset;
-	size_t len;
-	struct vb2_digest_context ctx;
-	enum vb2_hash_algorithm hash_alg;
+	struct deferred_extends *q = car_get_var_ptr(&deferred_extends);
+	struct deferred_extend *e;
+	uint32_t result;
+	size_t i, count;
 
-	if (!rdev || !rname)
+	if (!CONFIG(VBOOT_MEASURED_BOOT_DEFERRED))
+		return TPM_SUCCESS;
+
+	count = q->count;
+	q->count = 0;
+
+	for (i = 0; i < count; i++) {
+		e = &q->entries[i];
+		result = extend_pcr_now(e->pcr, e->digest_algo, e->digest,
+					e->digest_len, e->name);
+		if (result != TPM_SUCCESS) {
+			printk(BIOS_ERR, "TPM: Extending %s into PCR %d failed.\n",
+			       e->name, e->pcr);
+			return result;
+		}
+	}
+
+	return TPM_SUCCESS;
+}
+
+uint32_t tpm_extend_pcr(int pcr, enum vb2_hash_algorithm digest_algo,
+			uint8_t *digest, size_t digest_len, const char *name)
+{
+	struct deferred_extends *q;
+	struct deferred_extend *e;
+	uint32_t result;
+
+	if (!digest)
+		return TPM_E_IOERROR;
+
+	if (!CONFIG(VBOOT_MEASURED_BOOT_DEFERRED))
+		return extend_pcr_now(pcr, digest_algo, digest, digest_len,
+				      name);
+
+	if (!name || digest_len > sizeof(e->digest))
 		return TPM_E_INVALID_ARG;
+
+	q = car_get_var_ptr(&deferred_extends);
+	if (q->count == ARRAY_SIZE(q->entries)) {
+		result = tpm_flush_extends();
+		if (result != TPM_SUCCESS)
+			return result;
+	}
+
+	e = &q->entries[q->count++];
+	e->pcr = pcr;
+	e->digest_algo = digest_algo;
+	memcpy(e->digest, digest, digest_len);
+	e->digest_len = digest_len;
+	strncpy(e->name, name, sizeof(e->name) - 1);
+	e->name[sizeof(e->name) - 1] = '\0';
+
+	return TPM_SUCCESS;
+}
+
+#if CONFIG(VBOOT)
+uint32_t tpm_measure_start(struct tpm_measurement *m, size_t size)
+{
+	uint32_t result;
+
 	result = tlcl_lib_init();
 	if (result != TPM_SUCCESS) {
 		printk(BIOS_ERR, "TPM: Can't initialize library.\n");
 		return result;
 	}
 	if (CONFIG(TPM1)) {
-		hash_alg = VB2_HASH_SHA1;
+		m->hash_alg = VB2_HASH_SHA1;
 	} else { /* CONFIG_TPM2 */
-		hash_alg = VB2_HASH_SHA256;
+		m->hash_alg = VB2_HASH_SHA256;
 	}
 
-	digest_len = vb2_digest_size(hash_alg);
-	assert(digest_len <= sizeof(digest));
-	if (vb2_digest_init(&ctx, hash_alg)) {
+	/* Prefer the platform's hash engine, if it has one for hash_alg. */
+	m->hwcrypto = CONFIG(VBOOT_HWCRYPTO_MEASURE) &&
+		vb2ex_hwcrypto_digest_init(m->hash_alg, size) == VB2_SUCCESS;
+	if (!m->hwcrypto && vb2_digest_init(&m->ctx, m->hash_alg)) {
 		printk(BIOS_ERR, "TPM: Error initializing hash.\n");
 		return TPM_E_HASH_ERROR;
 	}
+
+	return TPM_SUCCESS;
+}
+
+uint32_t tpm_measure_update(struct tpm_measurement *m, const void *data,
+			    size_t size)
+{
+	if (m->hwcrypto ? vb2ex_hwcrypto_digest_extend(data, size) :
+	    vb2_digest_extend(&m->ctx, data, size)) {
+		printk(BIOS_ERR, "TPM: Error extending hash.\n");
+		return TPM_E_HASH_ERROR;
+	}
+
+	return TPM_SUCCESS;
+}
+
+uint32_t tpm_measure_finish(struct tpm_measurement *m, uint8_t pcr,
+			    const char *name)
+{
+	uint8_t digest[TPM_PCR_MAX_LEN], digest_len;
+	uint32_t result;
+
+	digest_len = vb2_digest_size(m->hash_alg);
+	assert(digest_len <= sizeof(digest));
+	if (m->hwcrypto ? vb2ex_hwcrypto_digest_finalize(digest, digest_len) :
+	    vb2_digest_finalize(&m->ctx, digest, digest_len)) {
+		printk(BIOS_ERR, "TPM: Error finalizing hash.\n");
+		return TPM_E_HASH_ERROR;
+	}
+	result = tpm_extend_pcr(pcr, m->hash_alg, digest, digest_len, name);
+	if (result != TPM_SUCCESS) {
+		printk(BIOS_ERR, "TPM: Extending hash into PCR failed.\n");
+		return result;
+	}
+	printk(BIOS_DEBUG, "TPM: Measured %s into PCR %d\n", name, pcr);
+	return TPM_SUCCESS;
+}
+
+uint32_t tpm_measure_region(const struct region_device *rdev, uint8_t pcr,
+			    const char *rname)
+{
+	uint8_t buf[HASH_DATA_CHUNK_SIZE];
+	uint32_t result, offset;
+	size_t len;
+	struct tpm_measurement m;
+
+	if (!rdev || !rname)
+		return TPM_E_INVALID_ARG;
+	result = tpm_measure_start(&m, region_device_sz(rdev));
+	if (result != TPM_SUCCESS)
+		return result;
 	/*
 	 * Though one can mmap the full needed region on x86 this is not the
 	 * case for e.g. ARM. In order to make this code as universal as
@@ -262,21 +385,10 @@ uint32_t tpm_measure_region(const struct region_device *rdev, uint8_t pcr,
 			       rname);
 			return TPM_E_READ_FAILURE;
 		}
-		if (vb2_digest_extend(&ctx, buf, len)) {
-			printk(BIOS_ERR, "TPM: Error extending hash.\n");
-			return TPM_E_HASH_ERROR;
-		}
-	}
-	if (vb2_digest_finalize(&ctx, digest, digest_len)) {
-		printk(BIOS_ERR, "TPM: Error finalizing hash.\n");
-		return TPM_E_HASH_ERROR;
-	}
-	result = tpm_extend_pcr(pcr, hash_alg, digest, digest_len, rname);
-	if (result != TPM_SUCCESS) {
-		printk(BIOS_ERR, "TPM: Extending hash into PCR failed.\n");
-		return result;
+		result = tpm_measure_update(&m, buf, len);
+		if (result != TPM_SUCCESS)
+			return result;
 	}
-	printk(BIOS_DEBUG, "TPM: Measured %s into PCR %d\n", rname, pcr);
-	return TPM_SUCCESS;
+	return tpm_measure_finish(&m, pcr, rname);
 }
 #endif /* VBOOT */
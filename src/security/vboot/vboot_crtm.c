@@ -157,39 +157,134 @@ static bool is_runtime_data(const char *name)
 	return false;
 }
 
-uint32_t vboot_measure_cbfs_hook(struct cbfsf *fh, const char *name)
+static uint32_t cbfs_measurement_pcr(struct cbfsf *fh, const char *name)
 {
-	uint32_t pcr_index;
 	uint32_t cbfs_type;
-	struct region_device rdev;
-	char tcpa_metadata[TCPA_PCR_HASH_NAME];
-
-	if (!vboot_logic_executed())
-		return 0;
 
 	cbfsf_file_type(fh, &cbfs_type);
-	cbfs_file_data(&rdev, fh);
 
 	switch (cbfs_type) {
 	case CBFS_TYPE_MRC:
 	case CBFS_TYPE_MRC_CACHE:
-		pcr_index = TPM_RUNTIME_DATA_PCR;
-		break;
+		return TPM_RUNTIME_DATA_PCR;
 	case CBFS_TYPE_STAGE:
 	case CBFS_TYPE_SELF:
 	case CBFS_TYPE_FIT:
-		pcr_index = TPM_CRTM_PCR;
-		break;
+		return TPM_CRTM_PCR;
 	default:
 		if (is_runtime_data(name))
-			pcr_index = TPM_RUNTIME_DATA_PCR;
+			return TPM_RUNTIME_DATA_PCR;
 		else
-			pcr_index = TPM_CRTM_PCR;
-		break;
+			return TPM_CRTM_PCR;
+	}
+}
+
+/*
+ * Files of these types may be run by whoever looks them up, without going
+ * through prog_run().
+ */
+static bool cbfs_is_executable(struct cbfsf *fh)
+{
+	uint32_t cbfs_type;
+
+	cbfsf_file_type(fh, &cbfs_type);
+
+	switch (cbfs_type) {
+	case CBFS_TYPE_STAGE:
+	case CBFS_TYPE_SELF:
+	case CBFS_TYPE_FIT:
+	case CBFS_TYPE_OPTIONROM:
+	case CBFS_TYPE_VSA:
+	case CBFS_TYPE_MBI:
+	case CBFS_TYPE_MICROCODE:
+	case CBFS_TYPE_FSP:
+	case CBFS_TYPE_MRC:
+	case CBFS_TYPE_EFI:
+		return true;
+	default:
+		return false;
 	}
+}
+
+/* Code has to be measured before it runs, so don't defer its extend. */
+static uint32_t flush_if_executable(uint32_t result, bool executable)
+{
+	if (result || !executable ||
+	    !CONFIG(VBOOT_MEASURED_BOOT_DEFERRED))
+		return result;
+
+	return tpm_flush_extends();
+}
+
+uint32_t vboot_measure_cbfs_hook(struct cbfsf *fh, const char *name)
+{
+	uint32_t pcr_index;
+	struct region_device rdev;
+	char tcpa_metadata[TCPA_PCR_HASH_NAME];
+
+	if (!vboot_logic_executed())
+		return 0;
+
+	pcr_index = cbfs_measurement_pcr(fh, name);
+	cbfs_file_data(&rdev, fh);
 
 	if (create_tcpa_metadata(&rdev, name, tcpa_metadata) < 0)
 		return VB2_ERROR_UNKNOWN;
 
-	return tpm_measure_region(&rdev, pcr_index, tcpa_metadata);
+	return flush_if_executable(tpm_measure_region(&rdev, pcr_index,
+						      tcpa_metadata),
+				   cbfs_is_executable(fh));
+}
+
+uint32_t vboot_measure_cbfs_start(struct vboot_cbfs_measurement *m,
+				  struct cbfsf *fh, const char *name)
+{
+	struct region_device rdev;
+
+	m->active = false;
+
+	if (!vboot_logic_executed())
+		return 0;
+
+	m->pcr = cbfs_measurement_pcr(fh, name);
+	m->executable = cbfs_is_executable(fh);
+	cbfs_file_data(&rdev, fh);
+
+	if (create_tcpa_metadata(&rdev, name, m->tcpa_metadata) < 0)
+		return VB2_ERROR_UNKNOWN;
+
+	if (tpm_measure_start(&m->tpm, region_device_sz(&rdev)))
+		return VB2_ERROR_UNKNOWN;
+
+	m->active = true;
+	return 0;
+}
+
+uint32_t vboot_measure_cbfs_update(struct vboot_cbfs_measurement *m,
+				   const void *data, size_t size)
+{
+	if (!m->active)
+		return 0;
+
+	return tpm_measure_update(&m->tpm, data, size);
+}
+
+uint32_t vboot_measure_cbfs_finish(struct vboot_cbfs_measurement *m)
+{
+	if (!m->active)
+		return 0;
+
+	m->active = false;
+	return flush_if_executable(tpm_measure_finish(&m->tpm, m->pcr,
+						      m->tcpa_metadata),
+				   m->executable);
+}
+
+uint32_t vboot_measure_flush(void)
+{
+	/* Nothing is measured in the stages before verification. */
+	if (!verification_should_run() && !vboot_logic_executed())
+		return 0;
+
+	return tpm_flush_extends();
 }
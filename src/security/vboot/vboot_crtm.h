@@ -54,8 +54,57 @@ uint32_t vboot_init_crtm(void);
  */
 uint32_t vboot_measure_cbfs_hook(struct cbfsf *fh, const char *name);
 
+/*
+ * Measures cbfs data from the bytes it is loaded with, instead of reading
+ * the file separately like vboot_measure_cbfs_hook(). The complete file data
+ * has to be passed to _update(), in order. The PCR is extended by _finish().
+ * All return 0 if successful, else an error.
+ */
+struct vboot_cbfs_measurement {
+	struct tpm_measurement tpm;
+	uint8_t pcr;
+	char tcpa_metadata[TCPA_PCR_HASH_NAME];
+	bool executable;
+	bool active;
+};
+
+uint32_t vboot_measure_cbfs_start(struct vboot_cbfs_measurement *m,
+				  struct cbfsf *fh, const char *name);
+uint32_t vboot_measure_cbfs_update(struct vboot_cbfs_measurement *m,
+				   const void *data, size_t size);
+uint32_t vboot_measure_cbfs_finish(struct vboot_cbfs_measurement *m);
+
+/*
+ * Extend the PCRs with the measurements that have been deferred, see
+ * VBOOT_MEASURED_BOOT_DEFERRED. Executable files are flushed as they are
+ * measured, this catches the rest before the next program runs.
+ */
+uint32_t vboot_measure_flush(void);
+
 #else
 #define vboot_measure_cbfs_hook(fh, name) 0
+#define vboot_measure_flush() 0
+
+struct vboot_cbfs_measurement {
+};
+
+static inline uint32_t vboot_measure_cbfs_start(
+	struct vboot_cbfs_measurement *m, struct cbfsf *fh, const char *name)
+{
+	return 0;
+}
+
+static inline uint32_t vboot_measure_cbfs_update(
+	struct vboot_cbfs_measurement *m, const void *data, size_t size)
+{
+	return 0;
+}
+
+static inline uint32_t vboot_measure_cbfs_finish(
+	struct vboot_cbfs_measurement *m)
+{
+	return 0;
+}
 #endif
 
 #endif /* __VBOOT_VBOOT_CRTM_H__ */
@@ -416,10 +416,35 @@ __weak void soc_power_states_generation(int core_id,
 {
 }
 
+/* Upper bound of the AML generate_cpu_entry() writes for one core. */
+#define CPU_ENTRY_MAX_LEN	2048
+
+static void generate_cpu_entry(int index, void *arg)
+{
+	int cores_per_package = *(int *)arg;
+	int core_id = index % cores_per_package;
+	int pcontrol_blk = ACPI_BASE_ADDRESS, plen = 6;
+
+	/* Only the first core has a P_BLK, unless packages have a single core. */
+	if (cores_per_package > 1 && index > 0) {
+		pcontrol_blk = 0;
+		plen = 0;
+	}
+
+	/* Generate processor \_PR.CPUx */
+	acpigen_write_processor(index, pcontrol_blk, plen);
+
+	/* Generate C-state tables */
+	generate_c_state_entries();
+
+	/* Soc specific power states generation */
+	soc_power_states_generation(core_id, cores_per_package);
+
+	acpigen_pop_len();
+}
+
 void generate_cpu_entries(struct device *device)
 {
-	int core_id, cpu_id, pcontrol_blk = ACPI_BASE_ADDRESS;
-	int plen = 6;
 	int totalcores = dev_count_cpu();
 	int cores_per_package = get_cores_per_package();
 	int numcpus = totalcores / cores_per_package;
@@ -427,26 +452,9 @@ void generate_cpu_entries(struct device *device)
 	printk(BIOS_DEBUG, "Found %d CPU(s) with %d core(s) each.\n",
 	       numcpus, cores_per_package);
 
-	for (cpu_id = 0; cpu_id < numcpus; cpu_id++) {
-		for (core_id = 0; core_id < cores_per_package; core_id++) {
-			if (core_id > 0) {
-				pcontrol_blk = 0;
-				plen = 0;
-			}
-
-			/* Generate processor \_PR.CPUx */
-			acpigen_write_processor((cpu_id) * cores_per_package +
-						core_id, pcontrol_blk, plen);
+	acpigen_write_parallel(generate_cpu_entry, &cores_per_package,
+			       numcpus * cores_per_package, CPU_ENTRY_MAX_LEN);
 
-			/* Generate C-state tables */
-			generate_c_state_entries();
-
-			/* Soc specific power states generation */
-			soc_power_states_generation(core_id, cores_per_package);
-
-			acpigen_pop_len();
-		}
-	}
 	/* PPKG is usually used for thermal management
 	   of the first and only package. */
 	acpigen_write_processor_package("PPKG", 0, cores_per_package);
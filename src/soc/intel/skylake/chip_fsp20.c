@@ -131,6 +131,7 @@ static void pcie_update_device_tree(const struct pcie_entry *pcie_rp_group,
 				" to func 0.\n", i);
 			func0->path.pci.devfn = dev->path.pci.devfn;
 			dev->path.pci.devfn = devfn0;
+			dev_rebuild_index();
 			break;
 		}
 	}
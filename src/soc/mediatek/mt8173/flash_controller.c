@@ -108,15 +108,26 @@ static int sector_erase(int offset)
 	return 0;
 }
 
-static int dma_read(u32 addr, u8 *buf, u32 len, uintptr_t dma_buf,
-		    size_t dma_buf_len)
-{
-	struct stopwatch sw;
+/* The read started by nor_read_start(), if it is done by the DMA. */
+static struct {
+	u8 *buf;
+	u32 len;
+	uintptr_t dma_buf;
+} pending_read;
 
-	assert(IS_ALIGNED((uintptr_t)buf, SFLASH_DMA_ALIGN) &&
-	       IS_ALIGNED(len, SFLASH_DMA_ALIGN) &&
-	       len <= dma_buf_len);
+static void get_dma_buf(uintptr_t *dma_buf, size_t *dma_buf_len)
+{
+	if (ENV_BOOTBLOCK || ENV_VERSTAGE) {
+		*dma_buf = (uintptr_t)_dma_coherent;
+		*dma_buf_len = REGION_SIZE(dma_coherent);
+	} else {
+		*dma_buf = (uintptr_t)_dram_dma;
+		*dma_buf_len = REGION_SIZE(dram_dma);
+	}
+}
 
+static void dma_start(u32 addr, u32 len, uintptr_t dma_buf)
+{
 	/* do dma reset */
 	write32(&mt8173_nor->fdma_ctl, SFLASH_DMA_SW_RESET);
 	write32(&mt8173_nor->fdma_ctl, SFLASH_DMA_WDLE_EN);
@@ -126,6 +137,11 @@ static int dma_read(u32 addr, u8 *buf, u32 len, uintptr_t dma_buf,
 	write32(&mt8173_nor->fdma_end_dadr, (dma_buf + len));
 	/* start dma */
 	write32(&mt8173_nor->fdma_ctl, SFLASH_DMA_TRIGGER | SFLASH_DMA_WDLE_EN);
+}
+
+static int dma_wait(void)
+{
+	struct stopwatch sw;
 
 	stopwatch_init_usecs_expire(&sw, SFLASH_POLLINGREG_US);
 	while ((read32(&mt8173_nor->fdma_ctl) & SFLASH_DMA_TRIGGER) != 0) {
@@ -135,6 +151,20 @@ static int dma_read(u32 addr, u8 *buf, u32 len, uintptr_t dma_buf,
 		}
 	}
 
+	return 0;
+}
+
+static int dma_read(u32 addr, u8 *buf, u32 len, uintptr_t dma_buf,
+		    size_t dma_buf_len)
+{
+	assert(IS_ALIGNED((uintptr_t)buf, SFLASH_DMA_ALIGN) &&
+	       IS_ALIGNED(len, SFLASH_DMA_ALIGN) &&
+	       len <= dma_buf_len);
+
+	dma_start(addr, len, dma_buf);
+	if (dma_wait())
+		return -1;
+
 	memcpy(buf, (const void *)dma_buf, len);
 	return 0;
 }
@@ -169,13 +199,7 @@ static int nor_read(const struct spi_flash *flash, u32 addr, size_t len,
 		done += next;
 	}
 
-	if (ENV_BOOTBLOCK || ENV_VERSTAGE) {
-		dma_buf = (uintptr_t)_dma_coherent;
-		dma_buf_len = REGION_SIZE(dma_coherent);
-	} else {
-		dma_buf = (uintptr_t)_dram_dma;
-		dma_buf_len = REGION_SIZE(dram_dma);
-	}
+	get_dma_buf(&dma_buf, &dma_buf_len);
 
 	while (len - done >= SFLASH_DMA_ALIGN) {
 		next = MIN(dma_buf_len, ALIGN_DOWN(len - done,
@@ -191,6 +215,45 @@ static int nor_read(const struct spi_flash *flash, u32 addr, size_t len,
 	return 0;
 }
 
+/*
+ * Let the DMA read into the bounce buffer in the background, the data is
+ * copied out when waiting for it. Reads that don't fit into the bounce
+ * buffer in one go are done right away.
+ */
+static int nor_read_start(const struct spi_flash *flash, u32 addr,
+			  size_t len, void *buf)
+{
+	uintptr_t dma_buf;
+	size_t dma_buf_len;
+
+	pending_read.len = 0;
+
+	get_dma_buf(&dma_buf, &dma_buf_len);
+	if (!len || !IS_ALIGNED(len, SFLASH_DMA_ALIGN) || len > dma_buf_len)
+		return nor_read(flash, addr, len, buf);
+
+	dma_start(addr, len, dma_buf);
+	pending_read.buf = buf;
+	pending_read.len = len;
+	pending_read.dma_buf = dma_buf;
+	return 0;
+}
+
+static int nor_read_wait(const struct spi_flash *flash)
+{
+	u32 len = pending_read.len;
+
+	if (!len)
+		return 0;
+
+	pending_read.len = 0;
+	if (dma_wait())
+		return -1;
+
+	memcpy(pending_read.buf, (const void *)pending_read.dma_buf, len);
+	return 0;
+}
+
 static int nor_write(const struct spi_flash *flash, u32 addr, size_t len,
 		const void *buf)
 {
@@ -230,6 +293,8 @@ static int nor_erase(const struct spi_flash *flash, u32 offset, size_t len)
 
 const struct spi_flash_ops spi_flash_ops = {
 	.read = nor_read,
+	.read_start = nor_read_start,
+	.read_wait = nor_read_wait,
 	.write = nor_write,
 	.erase = nor_erase,
 };
@@ -302,6 +302,8 @@ static void pch_pcie_devicetree_update(
 		}
 	}
 
+	dev_rebuild_index();
+
 	/* Copy the updated map back to its place */
 	memcpy(config->pcie_hotplug_map, new_hotplug_map,
 	       sizeof(new_hotplug_map));
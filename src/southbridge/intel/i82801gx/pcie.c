@@ -174,6 +174,7 @@ static void ich_pcie_device_set_func(int index, int pci_func)
 		       PCI_SLOT(new_devfn), PCI_FUNC(new_devfn));
 
 		dev->path.pci.devfn = new_devfn;
+		dev_rebuild_index();
 	}
 }
 
@@ -22,8 +22,9 @@
 #include <vb2_api.h>
 
 /* cbfstool will fail when trying to build a cbfs_file header that's larger
- * than MAX_CBFS_FILE_HEADER_BUFFER. 1K should give plenty of room. */
-#define MAX_CBFS_FILE_HEADER_BUFFER 1024
+ * than MAX_CBFS_FILE_HEADER_BUFFER. The microcode index is the largest
+ * attribute, 16K holds one for over 800 updates. */
+#define MAX_CBFS_FILE_HEADER_BUFFER (16 * 1024)
 
 /* create a magic number in host-byte order.
  * b3 is the high order byte.
@@ -106,6 +107,7 @@ struct cbfs_file_attribute {
 #define CBFS_FILE_ATTR_TAG_POSITION 0x42435350 /* PSCB */
 #define CBFS_FILE_ATTR_TAG_ALIGNMENT 0x42434c41 /* ALCB */
 #define CBFS_FILE_ATTR_TAG_PADDING 0x47444150 /* PDNG */
+#define CBFS_FILE_ATTR_TAG_MICROCODE_INDEX 0x58494355 /* UCIX */
 
 struct cbfs_file_attr_compression {
 	uint32_t tag;
@@ -135,6 +137,38 @@ struct cbfs_file_attr_align {
 	uint32_t alignment;
 } __packed;
 
+/* Index of the updates in a microcode blob, which cbfstool adds to files of
+ * type microcode so that the update for a CPU can be found without walking
+ * the whole blob. Offsets are relative to the start of the file data. */
+struct cbfs_file_attr_microcode_index_entry {
+	uint32_t sig;
+	uint32_t pf;
+	uint32_t rev;
+	uint32_t offset;
+	uint32_t size;
+} __packed;
+
+struct cbfs_file_attr_microcode_index {
+	uint32_t tag;
+	uint32_t len;
+	/* entries fill the rest of len */
+	struct cbfs_file_attr_microcode_index_entry entries[];
+} __packed;
+
+/* Intel microcode update header, in host order */
+struct microcode_header {
+	uint32_t version;
+	uint32_t revision;
+	uint32_t date;
+	uint32_t processor_signature;
+	uint32_t checksum;
+	uint32_t loader_revision;
+	uint32_t processor_flags;
+	uint32_t data_size;
+	uint32_t total_size;
+	uint8_t  reserved[12];
+} __packed;
+
 struct cbfs_stage {
 	uint32_t compression;
 	uint64_t entry;
@@ -218,10 +218,236 @@ void cbfs_get_header(struct cbfs_header *header, void *src)
 	header->architecture = xdr_be.get32(&outheader);
 }
 
+/*
+ * Free-space index
+ *
+ * Placing a file used to merge all empty entries and then walk the whole CBFS
+ * for every cbfs_locate_entry() and cbfs_add_entry() call. Instead, the empty
+ * entries ("extents") of a CBFS are collected once, kept sorted both by
+ * address and by size, and updated in place by cbfs_add_entry() and
+ * cbfs_remove_entry(). Indices are keyed by the buffer holding the CBFS, so
+ * they survive across the commands of a batch run; everything else that
+ * rewrites a CBFS must drop them with cbfs_invalidate_free_space().
+ */
+
+struct cbfs_free_extent {
+	uint32_t addr;
+	uint32_t end;
+};
+
+struct cbfs_free_index {
+	/* Identifies the CBFS: its buffer and the address of its first entry */
+	const char *data;
+	size_t size;
+	uint32_t first;
+
+	size_t count;
+	size_t capacity;
+	struct cbfs_free_extent *by_addr;
+	struct cbfs_free_extent *by_size;
+
+	struct cbfs_free_index *next;
+};
+
+static struct cbfs_free_index *free_indices;
+
+static uint32_t extent_size(const struct cbfs_free_extent *e)
+{
+	return e->end - e->addr;
+}
+
+static int compare_extent_addr(const struct cbfs_free_extent *a,
+			       const struct cbfs_free_extent *b)
+{
+	if (a->addr != b->addr)
+		return a->addr < b->addr ? -1 : 1;
+	return 0;
+}
+
+/* Ties are broken by address so that best fit picks the lowest extent. */
+static int compare_extent_size(const struct cbfs_free_extent *a,
+			       const struct cbfs_free_extent *b)
+{
+	if (extent_size(a) != extent_size(b))
+		return extent_size(a) < extent_size(b) ? -1 : 1;
+	return compare_extent_addr(a, b);
+}
+
+/* Returns the position of the first extent in list not ordered before key. */
+static size_t extent_lower_bound(const struct cbfs_free_extent *list,
+	size_t count, const struct cbfs_free_extent *key,
+	int (*compare)(const struct cbfs_free_extent *,
+		       const struct cbfs_free_extent *))
+{
+	size_t low = 0, high = count;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (compare(&list[mid], key) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+static int free_index_insert(struct cbfs_free_index *index, uint32_t addr,
+			     uint32_t end)
+{
+	struct cbfs_free_extent e = { .addr = addr, .end = end };
+	size_t pos;
+
+	if (index->count == index->capacity) {
+		size_t capacity = index->capacity ? index->capacity * 2 : 32;
+		struct cbfs_free_extent *by_addr, *by_size;
+
+		by_addr = realloc(index->by_addr, capacity * sizeof(e));
+		if (!by_addr)
+			return -1;
+		index->by_addr = by_addr;
+		by_size = realloc(index->by_size, capacity * sizeof(e));
+		if (!by_size)
+			return -1;
+		index->by_size = by_size;
+		index->capacity = capacity;
+	}
+
+	pos = extent_lower_bound(index->by_addr, index->count, &e,
+				 compare_extent_addr);
+	memmove(&index->by_addr[pos + 1], &index->by_addr[pos],
+		(index->count - pos) * sizeof(e));
+	index->by_addr[pos] = e;
+
+	pos = extent_lower_bound(index->by_size, index->count, &e,
+				 compare_extent_size);
+	memmove(&index->by_size[pos + 1], &index->by_size[pos],
+		(index->count - pos) * sizeof(e));
+	index->by_size[pos] = e;
+
+	index->count++;
+	return 0;
+}
+
+static void free_index_erase(struct cbfs_free_index *index,
+			     struct cbfs_free_extent e)
+{
+	size_t pos;
+
+	pos = extent_lower_bound(index->by_addr, index->count, &e,
+				 compare_extent_addr);
+	assert(pos < index->count && index->by_addr[pos].end == e.end);
+	memmove(&index->by_addr[pos], &index->by_addr[pos + 1],
+		(index->count - pos - 1) * sizeof(e));
+
+	pos = extent_lower_bound(index->by_size, index->count, &e,
+				 compare_extent_size);
+	assert(pos < index->count && index->by_size[pos].addr == e.addr);
+	memmove(&index->by_size[pos], &index->by_size[pos + 1],
+		(index->count - pos - 1) * sizeof(e));
+
+	index->count--;
+}
+
+/* Returns the extent starting at or covering addr, or NULL. */
+static const struct cbfs_free_extent *free_index_find(
+	const struct cbfs_free_index *index, uint32_t addr)
+{
+	struct cbfs_free_extent key = { .addr = addr, .end = addr };
+	size_t pos = extent_lower_bound(index->by_addr, index->count, &key,
+					compare_extent_addr);
+
+	if (pos < index->count && index->by_addr[pos].addr == addr)
+		return &index->by_addr[pos];
+	if (pos > 0 && index->by_addr[pos - 1].end > addr)
+		return &index->by_addr[pos - 1];
+	return NULL;
+}
+
+/* Adds all empty entries found in [start, end) to the index. */
+static int free_index_scan(struct cbfs_image *image,
+			   struct cbfs_free_index *index,
+			   uint32_t start, uint32_t end)
+{
+	struct cbfs_file *entry, *next;
+	uint32_t addr;
+
+	for (entry = (struct cbfs_file *)(image->buffer.data + start);
+	     (addr = cbfs_get_entry_addr(image, entry)) < end &&
+	     cbfs_is_valid_entry(image, entry);
+	     entry = next) {
+		next = cbfs_find_next_entry(image, entry);
+		if (ntohl(entry->type) != CBFS_COMPONENT_NULL)
+			continue;
+		if (free_index_insert(index, addr,
+				      cbfs_get_entry_addr(image, next)))
+			return -1;
+	}
+	return 0;
+}
+
+static void free_index_delete(struct cbfs_free_index *index)
+{
+	free(index->by_addr);
+	free(index->by_size);
+	free(index);
+}
+
+/* Returns the free-space index of image, building it if necessary. */
+static struct cbfs_free_index *free_index_get(struct cbfs_image *image)
+{
+	struct cbfs_free_index *index;
+	uint32_t first = cbfs_get_entry_addr(image,
+					     cbfs_find_first_entry(image));
+
+	for (index = free_indices; index; index = index->next) {
+		if (index->data == image->buffer.data &&
+		    index->size == image->buffer.size && index->first == first)
+			return index;
+	}
+
+	index = calloc(1, sizeof(*index));
+	if (!index) {
+		ERROR("Out of memory indexing free CBFS space.\n");
+		return NULL;
+	}
+	index->data = image->buffer.data;
+	index->size = image->buffer.size;
+	index->first = first;
+
+	// Merge empty entries so that each extent is as large as possible.
+	cbfs_walk(image, cbfs_merge_empty_entry, NULL);
+	if (free_index_scan(image, index, first, image->buffer.size)) {
+		ERROR("Out of memory indexing free CBFS space.\n");
+		free_index_delete(index);
+		return NULL;
+	}
+
+	index->next = free_indices;
+	free_indices = index;
+	return index;
+}
+
+void cbfs_invalidate_free_space(const struct buffer *region)
+{
+	struct cbfs_free_index **link = &free_indices;
+	const char *start = region->data, *end = region->data + region->size;
+
+	while (*link) {
+		struct cbfs_free_index *index = *link;
+		if (index->data < end && start < index->data + index->size) {
+			*link = index->next;
+			free_index_delete(index);
+		} else {
+			link = &index->next;
+		}
+	}
+}
+
 int cbfs_image_create(struct cbfs_image *image, size_t entries_size)
 {
 	assert(image);
 	assert(image->buffer.data);
+	cbfs_invalidate_free_space(&image->buffer);
 
 	size_t empty_header_len = cbfs_calculate_file_header_size("");
 	uint32_t entries_offset = 0;
@@ -279,6 +505,7 @@ int cbfs_legacy_image_create(struct cbfs_image *image,
 	assert(image);
 	assert(image->buffer.data);
 	assert(bootblock);
+	cbfs_invalidate_free_space(&image->buffer);
 
 	int32_t *rel_offset;
 	uint32_t cbfs_len;
@@ -393,6 +620,7 @@ int cbfs_image_from_buffer(struct cbfs_image *out, struct buffer *in,
 int cbfs_copy_instance(struct cbfs_image *image, struct buffer *dst)
 {
 	assert(image);
+	cbfs_invalidate_free_space(dst);
 
 	struct cbfs_file *src_entry, *dst_entry;
 	size_t align;
@@ -448,6 +676,7 @@ int cbfs_expand_to_region(struct buffer *region)
 {
 	if (buffer_get(region) == NULL)
 		return 1;
+	cbfs_invalidate_free_space(region);
 
 	struct cbfs_image image;
 	memset(&image, 0, sizeof(image));
@@ -487,6 +716,7 @@ int cbfs_truncate_space(struct buffer *region, uint32_t *size)
 {
 	if (buffer_get(region) == NULL)
 		return 1;
+	cbfs_invalidate_free_space(region);
 
 	struct cbfs_image image;
 	memset(&image, 0, sizeof(image));
@@ -539,6 +769,7 @@ static size_t cbfs_file_entry_size(const struct cbfs_file *f)
 int cbfs_compact_instance(struct cbfs_image *image)
 {
 	assert(image);
+	cbfs_invalidate_free_space(&image->buffer);
 
 	struct cbfs_file *prev;
 	struct cbfs_file *cur;
@@ -747,9 +978,10 @@ int cbfs_add_entry(struct cbfs_image *image, struct buffer *buffer,
 
 	const char *name = header->filename;
 
-	uint32_t entry_type;
-	uint32_t addr, addr_next;
-	struct cbfs_file *entry, *next;
+	struct cbfs_free_index *index;
+	struct cbfs_free_extent space;
+	const struct cbfs_free_extent *found = NULL;
+	struct cbfs_file *entry;
 	uint32_t need_size;
 	uint32_t header_size = ntohl(header->offset);
 
@@ -757,65 +989,52 @@ int cbfs_add_entry(struct cbfs_image *image, struct buffer *buffer,
 	DEBUG("cbfs_add_entry('%s'@0x%x) => need_size = %u+%zu=%u\n",
 	      name, content_offset, header_size, buffer->size, need_size);
 
-	// Merge empty entries.
-	DEBUG("(trying to merge empty entries...)\n");
-	cbfs_walk(image, cbfs_merge_empty_entry, NULL);
-
-	for (entry = cbfs_find_first_entry(image);
-	     entry && cbfs_is_valid_entry(image, entry);
-	     entry = cbfs_find_next_entry(image, entry)) {
-
-		entry_type = ntohl(entry->type);
-		if (entry_type != CBFS_COMPONENT_NULL)
-			continue;
-
-		addr = cbfs_get_entry_addr(image, entry);
-		next = cbfs_find_next_entry(image, entry);
-		addr_next = cbfs_get_entry_addr(image, next);
-
-		DEBUG("cbfs_add_entry: space at 0x%x+0x%x(%d) bytes\n",
-		      addr, addr_next - addr, addr_next - addr);
-
-		/* Will the file fit? Don't yet worry if we have space for a new
-		 * "empty" entry. We take care of that later.
-		 */
-		if (addr + need_size > addr_next)
-			continue;
+	index = free_index_get(image);
+	if (!index)
+		return -1;
 
-		// Test for complicated cases
-		if (content_offset > 0) {
-			if (addr_next < content_offset) {
-				DEBUG("Not for specified offset yet");
-				continue;
-			} else if (addr > content_offset) {
-				DEBUG("Exceed specified content_offset.");
-				break;
-			} else if (addr + header_size > content_offset) {
-				ERROR("Not enough space for header.\n");
-				break;
-			} else if (content_offset + buffer->size > addr_next) {
-				ERROR("Not enough space for content.\n");
-				break;
-			}
+	if (content_offset == 0) {
+		/* Best fit: the smallest empty entry that holds the file. */
+		struct cbfs_free_extent key = { .addr = 0, .end = need_size };
+		size_t pos = extent_lower_bound(index->by_size, index->count,
+						&key, compare_extent_size);
+		if (pos < index->count)
+			found = &index->by_size[pos];
+	} else {
+		found = free_index_find(index, content_offset);
+		if (!found) {
+			DEBUG("No empty entry at specified content_offset.\n");
+		} else if (found->addr + header_size > content_offset) {
+			ERROR("Not enough space for header.\n");
+			found = NULL;
+		} else if (content_offset + buffer->size > found->end) {
+			ERROR("Not enough space for content.\n");
+			found = NULL;
 		}
+	}
 
-		// TODO there are more few tricky cases that we may
-		// want to fit by altering offset.
-
-		if (content_offset == 0) {
-			// we tested every condition earlier under which
-			// placing the file there might fail
-			content_offset = addr + header_size;
-		}
+	if (found) {
+		space = *found;
+		if (content_offset == 0)
+			content_offset = space.addr + header_size;
 
 		DEBUG("section 0x%x+0x%x for content_offset 0x%x.\n",
-		      addr, addr_next - addr, content_offset);
+		      space.addr, extent_size(&space), content_offset);
 
+		entry = (struct cbfs_file *)(image->buffer.data + space.addr);
+		assert(ntohl(entry->type) == CBFS_COMPONENT_NULL);
 		if (cbfs_add_entry_at(image, entry, buffer->data,
 				      content_offset, header) == 0) {
+			/* Index whatever is left of the empty entry. */
+			free_index_erase(index, space);
+			if (free_index_scan(image, index, space.addr,
+					    space.end)) {
+				cbfs_invalidate_free_space(&image->buffer);
+				ERROR("Out of memory indexing free CBFS space.\n");
+				return -1;
+			}
 			return 0;
 		}
-		break;
 	}
 
 	ERROR("Could not add [%s, %zd bytes (%zd KB)@0x%x]; too big?\n",
@@ -1370,16 +1589,41 @@ int cbfs_export_entry(struct cbfs_image *image, const char *entry_name,
 
 int cbfs_remove_entry(struct cbfs_image *image, const char *name)
 {
+	struct cbfs_free_index *index;
+	const struct cbfs_free_extent *prev;
 	struct cbfs_file *entry;
+	uint32_t addr, end;
+
+	index = free_index_get(image);
+	if (!index)
+		return -1;
+
 	entry = cbfs_get_entry(image, name);
 	if (!entry) {
 		ERROR("CBFS file %s not found.\n", name);
 		return -1;
 	}
-	DEBUG("cbfs_remove_entry: Removed %s @ 0x%x\n",
-	      entry->filename, cbfs_get_entry_addr(image, entry));
+	addr = cbfs_get_entry_addr(image, entry);
+	DEBUG("cbfs_remove_entry: Removed %s @ 0x%x\n", entry->filename, addr);
 	entry->type = htonl(CBFS_COMPONENT_DELETED);
-	cbfs_walk(image, cbfs_merge_empty_entry, NULL);
+
+	/* Join with the empty entries right before and after this one. */
+	prev = addr ? free_index_find(index, addr - 1) : NULL;
+	if (prev && prev->end == addr) {
+		addr = prev->addr;
+		entry = (struct cbfs_file *)(image->buffer.data + addr);
+	}
+	cbfs_merge_empty_entry(image, entry, NULL);
+	end = cbfs_get_entry_addr(image, cbfs_find_next_entry(image, entry));
+
+	while ((prev = free_index_find(index, addr)) ||
+	       (prev = free_index_find(index, end - 1)))
+		free_index_erase(index, *prev);
+	if (free_index_insert(index, addr, end)) {
+		cbfs_invalidate_free_space(&image->buffer);
+		ERROR("Out of memory indexing free CBFS space.\n");
+		return -1;
+	}
 	return 0;
 }
 
@@ -1400,6 +1644,32 @@ int cbfs_print_header_info(struct cbfs_image *image)
 	return 0;
 }
 
+static int cbfs_print_microcode_index(struct cbfs_file *entry, FILE *fp)
+{
+	struct cbfs_file_attribute *attr;
+	struct cbfs_file_attr_microcode_index *index;
+	size_t i, count;
+
+	for (attr = cbfs_file_first_attr(entry); attr;
+	     attr = cbfs_file_next_attr(entry, attr)) {
+		if (ntohl(attr->tag) != CBFS_FILE_ATTR_TAG_MICROCODE_INDEX)
+			continue;
+
+		index = (struct cbfs_file_attr_microcode_index *)attr;
+		count = (ntohl(index->len) - sizeof(*index)) /
+			sizeof(index->entries[0]);
+		for (i = 0; i < count; i++)
+			fprintf(fp, "    sig: 0x%x, pf: 0x%x, rev: 0x%x, "
+				"offset: 0x%x, size: %d\n",
+				ntohl(index->entries[i].sig),
+				ntohl(index->entries[i].pf),
+				ntohl(index->entries[i].rev),
+				ntohl(index->entries[i].offset),
+				ntohl(index->entries[i].size));
+	}
+	return 0;
+}
+
 static int cbfs_print_stage_info(struct cbfs_stage *stage, FILE* fp)
 {
 	fprintf(fp,
@@ -1557,6 +1827,10 @@ int cbfs_print_entry_info(struct cbfs_image *image, struct cbfs_file *entry,
 				payload ++;
 			}
 			break;
+
+		case CBFS_COMPONENT_MICROCODE:
+			cbfs_print_microcode_index(entry, fp);
+			break;
 		default:
 			break;
 	}
@@ -1598,12 +1872,74 @@ static int cbfs_print_parseable_entry_info(struct cbfs_image *image,
 	return 0;
 }
 
+struct cbfs_free_space_info {
+	size_t total;
+	size_t largest;
+	size_t extents;
+	/* Start of the current run of empty entries, if any */
+	bool in_run;
+	uint32_t run_start;
+	/* Address following the last entry walked */
+	uint32_t end;
+};
+
+static void cbfs_end_free_run(struct cbfs_free_space_info *info, uint32_t end)
+{
+	size_t size = end - info->run_start;
+
+	info->total += size;
+	info->largest = MAX(info->largest, size);
+	info->extents++;
+	info->in_run = false;
+}
+
+static int cbfs_collect_free_space(struct cbfs_image *image,
+				   struct cbfs_file *entry, void *arg)
+{
+	struct cbfs_free_space_info *info = arg;
+	uint32_t type = ntohl(entry->type);
+	uint32_t addr = cbfs_get_entry_addr(image, entry);
+
+	/* Empty entries aren't merged here as print must not modify the
+	   image, so count runs of adjacent empty entries as one extent. */
+	if (type == CBFS_COMPONENT_NULL || type == CBFS_COMPONENT_DELETED) {
+		if (!info->in_run) {
+			info->in_run = true;
+			info->run_start = addr;
+		}
+	} else if (info->in_run) {
+		cbfs_end_free_run(info, addr);
+	}
+	info->end = cbfs_get_entry_addr(image,
+					cbfs_find_next_entry(image, entry));
+	return 0;
+}
+
+static void cbfs_print_free_space(struct cbfs_image *image)
+{
+	struct cbfs_free_space_info info;
+
+	memset(&info, 0, sizeof(info));
+	cbfs_walk(image, cbfs_collect_free_space, &info);
+	if (info.in_run)
+		cbfs_end_free_run(&info, info.end);
+
+	printf("\nFree space: %zd bytes in %zd extent%s, largest %zd bytes",
+	       info.total, info.extents, info.extents == 1 ? "" : "s",
+	       info.largest);
+	if (info.total)
+		printf(" (%zd%% fragmented)",
+		       100 - info.largest * 100 / info.total);
+	printf("\n");
+}
+
 int cbfs_print_directory(struct cbfs_image *image)
 {
 	if (cbfs_is_legacy_cbfs(image))
 		cbfs_print_header_info(image);
 	printf("%-30s %-10s %-12s   Size   Comp\n", "Name", "Offset", "Type");
 	cbfs_walk(image, cbfs_print_entry_info, NULL);
+	cbfs_print_free_space(image);
 	return 0;
 }
 
@@ -1654,8 +1990,12 @@ int cbfs_merge_empty_entry(struct cbfs_image *image, struct cbfs_file *entry,
 		/* Nothing to empty */
 		return 0;
 
-	/* We can return here if we find only a single empty entry.
-	   For simplicity, we just proceed (and make it empty again). */
+	/* A single NULL entry is already as merged as it gets. Leave it alone
+	   rather than clearing all of its (possibly large) space again. */
+	if (ntohl(entry->type) == CBFS_COMPONENT_NULL &&
+	    next_addr == cbfs_get_entry_addr(image,
+					     cbfs_find_next_entry(image, entry)))
+		return 0;
 
 	/* We're creating one empty entry for combined empty spaces */
 	uint32_t addr = cbfs_get_entry_addr(image, entry);
@@ -1927,6 +2267,69 @@ int cbfs_add_file_hash(struct cbfs_file *header, struct buffer *buffer,
 	return 0;
 }
 
+/* Fills entries, if not NULL, from the microcode updates in buffer and
+ * returns how many there are. */
+static size_t microcode_index_entries(const struct buffer *buffer,
+	struct cbfs_file_attr_microcode_index_entry *entries)
+{
+	const struct microcode_header *mcu;
+	size_t offset = 0, count = 0;
+	uint32_t size;
+
+	while (buffer->size - offset >= sizeof(*mcu)) {
+		mcu = (const struct microcode_header *)(buffer->data + offset);
+
+		/* Newer microcode updates include a size field, whereas older
+		 * containers set it at 0 and are exactly 2048 bytes long */
+		size = mcu->total_size ? mcu->total_size : 2048;
+		if (size < sizeof(*mcu) || size > buffer->size - offset)
+			break;
+
+		if (entries) {
+			entries[count].sig = htonl(mcu->processor_signature);
+			entries[count].pf = htonl(mcu->processor_flags);
+			entries[count].rev = htonl(mcu->revision);
+			entries[count].offset = htonl(offset);
+			entries[count].size = htonl(size);
+		}
+		count++;
+		offset += size;
+	}
+
+	return count;
+}
+
+uint32_t cbfs_microcode_index_size(const struct buffer *buffer)
+{
+	size_t count = microcode_index_entries(buffer, NULL);
+
+	if (!count)
+		return 0;
+
+	return sizeof(struct cbfs_file_attr_microcode_index) +
+		count * sizeof(struct cbfs_file_attr_microcode_index_entry);
+}
+
+int cbfs_add_microcode_index(struct cbfs_file *header,
+	const struct buffer *buffer)
+{
+	uint32_t size = cbfs_microcode_index_size(buffer);
+
+	if (!size)
+		return 0;
+
+	struct cbfs_file_attr_microcode_index *attrs =
+		(struct cbfs_file_attr_microcode_index *)cbfs_add_file_attr(
+			header, CBFS_FILE_ATTR_TAG_MICROCODE_INDEX, size);
+
+	if (attrs == NULL)
+		return -1;
+
+	microcode_index_entries(buffer, attrs->entries);
+
+	return 0;
+}
+
 /* Finds a place to hold whole data in same memory page. */
 static int is_in_same_page(uint32_t start, uint32_t size, uint32_t page)
 {
@@ -1957,8 +2360,9 @@ static size_t absolute_align(const struct cbfs_image *image, size_t val,
 int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
 			  size_t page_size, size_t align, size_t metadata_size)
 {
-	struct cbfs_file *entry;
-	size_t need_len;
+	struct cbfs_free_index *index;
+	struct cbfs_free_extent key;
+	size_t need_len, pos;
 	size_t addr, addr_next, addr2, addr3, offset;
 
 	/* Default values: allow fitting anywhere in ROM. */
@@ -1980,8 +2384,9 @@ int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
 
 	need_len = metadata_size + size;
 
-	// Merge empty entries to build get max available space.
-	cbfs_walk(image, cbfs_merge_empty_entry, NULL);
+	index = free_index_get(image);
+	if (!index)
+		return -1;
 
 	/* Three cases of content location on memory page:
 	 * case 1.
@@ -2003,20 +2408,17 @@ int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
 	 * commands (will be re-calculated and positioned by cbfs_add_entry_at).
 	 * For stage targets, the address is also used to re-link stage before
 	 * being added into CBFS.
+	 *
+	 * Empty entries are tried from the smallest one that can hold need_len
+	 * upwards, so the first match is the best fit.
 	 */
-	for (entry = cbfs_find_first_entry(image);
-	     entry && cbfs_is_valid_entry(image, entry);
-	     entry = cbfs_find_next_entry(image, entry)) {
-
-		uint32_t type = ntohl(entry->type);
-		if (type != CBFS_COMPONENT_NULL)
-			continue;
-
-		addr = cbfs_get_entry_addr(image, entry);
-		addr_next = cbfs_get_entry_addr(image, cbfs_find_next_entry(
-				image, entry));
-		if (addr_next - addr < need_len)
-			continue;
+	key.addr = 0;
+	key.end = need_len;
+	for (pos = extent_lower_bound(index->by_size, index->count, &key,
+				      compare_extent_size);
+	     pos < index->count; pos++) {
+		addr = index->by_size[pos].addr;
+		addr_next = index->by_size[pos].end;
 
 		offset = absolute_align(image, addr + metadata_size, align);
 		if (is_in_same_page(offset, size, page_size) &&
@@ -2044,3 +2446,218 @@ int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
 	}
 	return -1;
 }
+
+/* A file taken out of the CBFS by cbfs_pack_instance() to be placed again. */
+struct cbfs_pack_file {
+	struct cbfs_file *header;
+	struct buffer data;
+	uint32_t addr;
+	uint32_t align;
+	size_t rank;
+};
+
+/* Returns the value of the attribute with given tag, or 0 if there is none. */
+static uint32_t cbfs_file_get_attr_u32(struct cbfs_file *entry, uint32_t tag)
+{
+	struct cbfs_file_attribute *attr;
+
+	for (attr = cbfs_file_first_attr(entry); attr;
+	     attr = cbfs_file_next_attr(entry, attr)) {
+		if (ntohl(attr->tag) == tag &&
+		    ntohl(attr->len) >= sizeof(*attr) + sizeof(uint32_t))
+			return ntohl(*(uint32_t *)attr->data);
+	}
+	return 0;
+}
+
+/* Returns the size of the header, name and attributes of entry, excluding
+ * any padding that was added to align its content. */
+static size_t cbfs_file_real_metadata_size(struct cbfs_file *entry)
+{
+	struct cbfs_file_attribute *attr, *next;
+	size_t size = cbfs_calculate_file_header_size(entry->filename);
+
+	next = cbfs_file_first_attr(entry);
+	while ((attr = next)) {
+		next = cbfs_file_next_attr(entry, attr);
+		size = MAX(size, (size_t)((uint8_t *)attr - (uint8_t *)entry) +
+				 ntohl(attr->len));
+	}
+	return MIN(size, (size_t)ntohl(entry->offset));
+}
+
+/* Tells whether entry must stay where it is. */
+static bool cbfs_pack_is_pinned(struct cbfs_file *entry, uint64_t xip_base)
+{
+	/*
+	 * Padding between the metadata and the content means the file was
+	 * placed with -b or aligned with -a, which doesn't always leave an
+	 * attribute behind.
+	 */
+	if (ntohl(entry->offset) > cbfs_file_real_metadata_size(entry))
+		return true;
+
+	switch (ntohl(entry->type)) {
+	case CBFS_COMPONENT_BOOTBLOCK:
+	case CBFS_COMPONENT_CBFSHEADER:
+	case CBFS_COMPONENT_FSP:
+	case CBFS_COMPONENT_MRC:
+	case CBFS_COMPONENT_MRC_CACHE:
+		return true;
+	case CBFS_COMPONENT_STAGE:
+		if (ntohl(entry->len) >= sizeof(struct cbfs_stage)) {
+			/* The stage metadata is in little endian. */
+			struct buffer reader;
+			buffer_init(&reader, NULL, CBFS_SUBHEADER(entry),
+				    sizeof(struct cbfs_stage));
+			xdr_le.get32(&reader);
+			xdr_le.get64(&reader);
+			uint64_t load = xdr_le.get64(&reader);
+			/* Linked to run from the memory mapped flash. */
+			if (load >= xip_base && load < 0x100000000ULL)
+				return true;
+		}
+		break;
+	}
+
+	return cbfs_file_get_attr_u32(entry, CBFS_FILE_ATTR_TAG_POSITION) != 0;
+}
+
+/* Orders hot files by rank, then the rest by decreasing size. */
+static int compare_pack_files(const void *a, const void *b)
+{
+	const struct cbfs_pack_file *fa = a, *fb = b;
+	size_t size_a = ntohl(fa->header->offset) + fa->data.size;
+	size_t size_b = ntohl(fb->header->offset) + fb->data.size;
+
+	if (fa->rank != fb->rank)
+		return fa->rank < fb->rank ? -1 : 1;
+	if (size_a != size_b)
+		return size_a > size_b ? -1 : 1;
+	return fa->addr < fb->addr ? -1 : fa->addr > fb->addr;
+}
+
+/* Returns the lowest content offset that fits, or -1. */
+static int32_t cbfs_pack_first_fit(struct cbfs_image *image,
+				   const struct cbfs_free_index *index,
+				   const struct cbfs_pack_file *file)
+{
+	size_t metadata_size = ntohl(file->header->offset);
+
+	for (size_t i = 0; i < index->count; i++) {
+		const struct cbfs_free_extent *e = &index->by_addr[i];
+		size_t offset = e->addr + metadata_size;
+
+		if (file->align)
+			offset = absolute_align(image, offset, file->align);
+		if (offset + file->data.size <= e->end)
+			return offset;
+	}
+	return -1;
+}
+
+int cbfs_pack_instance(struct cbfs_image *image, const char * const hot[],
+		       size_t hot_count, uint64_t xip_base)
+{
+	struct cbfs_pack_file *files = NULL;
+	struct cbfs_free_index *index;
+	struct cbfs_file *entry;
+	size_t count = 0, capacity = 0, i;
+	int ret = 1;
+
+	assert(image);
+	cbfs_invalidate_free_space(&image->buffer);
+
+	/* Take out every file that may move, leaving the pinned ones. */
+	for (entry = cbfs_find_first_entry(image);
+	     entry && cbfs_is_valid_entry(image, entry);
+	     entry = cbfs_find_next_entry(image, entry)) {
+		uint32_t type = ntohl(entry->type);
+		struct cbfs_pack_file *file;
+		size_t metadata_size;
+
+		if (type == CBFS_COMPONENT_NULL ||
+		    type == CBFS_COMPONENT_DELETED)
+			continue;
+		if (cbfs_pack_is_pinned(entry, xip_base)) {
+			DEBUG("pack: '%s' stays at 0x%x\n", entry->filename,
+			      cbfs_get_entry_addr(image, entry));
+			continue;
+		}
+
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 32;
+			file = realloc(files, capacity * sizeof(*files));
+			if (!file) {
+				ERROR("Out of memory packing CBFS.\n");
+				goto done;
+			}
+			files = file;
+		}
+		file = &files[count];
+		memset(file, 0, sizeof(*file));
+
+		metadata_size = cbfs_file_real_metadata_size(entry);
+		/* Attributes like a microcode index can be of any size. */
+		file->header = malloc(metadata_size);
+		if (!file->header || buffer_create(&file->data,
+				ntohl(entry->len), entry->filename)) {
+			free(file->header);
+			ERROR("Out of memory packing CBFS.\n");
+			goto done;
+		}
+		count++;
+		memcpy(file->header, entry, metadata_size);
+		file->header->offset = htonl(metadata_size);
+		memcpy(file->data.data, CBFS_SUBHEADER(entry), file->data.size);
+		file->addr = cbfs_get_entry_addr(image, entry);
+		file->align = cbfs_file_get_attr_u32(entry,
+					CBFS_FILE_ATTR_TAG_ALIGNMENT);
+		for (file->rank = 0; file->rank < hot_count; file->rank++)
+			if (strcasecmp(hot[file->rank], entry->filename) == 0)
+				break;
+
+		entry->type = htonl(CBFS_COMPONENT_DELETED);
+	}
+
+	/* Building the index merges everything that was taken out. */
+	index = free_index_get(image);
+	if (!index)
+		goto done;
+
+	/*
+	 * Hot files go to the lowest address they fit at, in the order they
+	 * are used, so that walking the CBFS finds them after as few other
+	 * headers as possible. The rest goes in largest first, each into the
+	 * smallest space that holds it, to fill the holes around pinned files
+	 * and keep the remaining free space in one piece.
+	 */
+	qsort(files, count, sizeof(*files), compare_pack_files);
+	for (i = 0; i < count; i++) {
+		struct cbfs_pack_file *file = &files[i];
+		int32_t offset = 0;
+
+		if (file->rank < hot_count)
+			offset = cbfs_pack_first_fit(image, index, file);
+		else if (file->align)
+			offset = cbfs_locate_entry(image, file->data.size, 0,
+					file->align, ntohl(file->header->offset));
+		DEBUG("pack: placing '%s' (was at 0x%x)\n",
+		      file->header->filename, file->addr);
+		if (offset < 0 || cbfs_add_entry(image, &file->data, offset,
+						 file->header)) {
+			ERROR("Could not place '%s' while packing.\n",
+			      file->header->filename);
+			goto done;
+		}
+	}
+	ret = 0;
+
+done:
+	for (i = 0; i < count; i++) {
+		free(files[i].header);
+		buffer_delete(&files[i].data);
+	}
+	free(files);
+	return ret;
+}
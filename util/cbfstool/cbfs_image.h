@@ -80,6 +80,17 @@ int cbfs_copy_instance(struct cbfs_image *image, struct buffer *dst);
  * beginning of the image. Returns 0 on success, otherwise non-zero.  */
 int cbfs_compact_instance(struct cbfs_image *image);
 
+/* Re-place the movable files of a CBFS image to reduce fragmentation.
+ * Files with a position attribute, bootblocks, master headers, FSP and MRC
+ * binaries and stages linked at or above xip_base (execute-in-place from
+ * memory mapped flash) stay where they are. The files named in hot[] are
+ * placed first, in that order, at the lowest addresses they fit. All other
+ * files follow, largest first, each in the smallest gap that holds it.
+ * Alignment attributes are honored. Returns 0 on success, otherwise
+ * non-zero (in which case the image is left in an undefined state). */
+int cbfs_pack_instance(struct cbfs_image *image, const char * const hot[],
+		       size_t hot_count, uint64_t xip_base);
+
 /* Expand a CBFS image inside an fmap region to the entire region's space.
    Returns 0 on success, otherwise non-zero. */
 int cbfs_expand_to_region(struct buffer *region);
@@ -89,6 +100,11 @@ int cbfs_expand_to_region(struct buffer *region);
    size in the size argument. */
 int cbfs_truncate_space(struct buffer *region, uint32_t *size);
 
+/* Drops the cached free-space index of every CBFS overlapping region. Must be
+ * called after modifying a CBFS other than through cbfs_add_entry() and
+ * cbfs_remove_entry(). */
+void cbfs_invalidate_free_space(const struct buffer *region);
+
 /* Releases the CBFS image. Returns 0 on success, otherwise non-zero. */
 int cbfs_image_delete(struct cbfs_image *image);
 
@@ -102,7 +118,8 @@ int cbfs_export_entry(struct cbfs_image *image, const char *entry_name,
 		      const char *filename, uint32_t arch, bool do_processing);
 
 /* Adds an entry to CBFS image by given name and type. If content_offset is
- * non-zero, try to align "content" (CBFS_SUBHEADER(p)) at content_offset.
+ * non-zero, try to align "content" (CBFS_SUBHEADER(p)) at content_offset,
+ * otherwise the smallest empty space that can hold the entry is used.
  * Never pass this function a top-aligned address: convert it to an offset.
  * Returns 0 on success, otherwise non-zero. */
 int cbfs_add_entry(struct cbfs_image *image, struct buffer *buffer,
@@ -124,6 +141,7 @@ int cbfs_create_empty_entry(struct cbfs_file *entry, int type,
 /* Finds a location to put given content by specified criteria:
  *  "page_size" limits the content to fit on same memory page, and
  *  "align" specifies starting address alignment.
+ * The smallest empty space meeting these criteria is chosen (best fit).
  * Returns a valid offset, or -1 on failure. */
 int32_t cbfs_locate_entry(struct cbfs_image *image, size_t size,
 			  size_t page_size, size_t align, size_t metadata_size);
@@ -204,4 +222,14 @@ struct cbfs_file_attribute *cbfs_add_file_attr(struct cbfs_file *header,
  * Returns 0 on success, -1 on error. */
 int cbfs_add_file_hash(struct cbfs_file *header, struct buffer *buffer,
 	enum vb2_hash_algorithm hash_type);
+
+/* Returns the size of the index attribute for the microcode updates in
+ * buffer, or 0 if there are none. */
+uint32_t cbfs_microcode_index_size(const struct buffer *buffer);
+
+/* Adds an extended attribute to header, containing an index of the microcode
+ * updates in buffer.
+ * Returns 0 on success, -1 on error. */
+int cbfs_add_microcode_index(struct cbfs_file *header,
+	const struct buffer *buffer);
 #endif
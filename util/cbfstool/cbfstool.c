@@ -620,6 +620,20 @@ static int cbfstool_convert_raw(struct buffer *buffer,
 	return 0;
 }
 
+static int cbfstool_convert_microcode(struct buffer *buffer,
+	uint32_t *offset, struct cbfs_file *header)
+{
+	/* The index points into the uncompressed updates. */
+	if (param.compression == CBFS_COMPRESS_NONE &&
+	    cbfs_add_microcode_index(header, buffer)) {
+		ERROR("The microcode index of %u bytes doesn't fit in the file header.\n",
+		      cbfs_microcode_index_size(buffer));
+		return -1;
+	}
+
+	return cbfstool_convert_raw(buffer, offset, header);
+}
+
 static int cbfstool_convert_fsp(struct buffer *buffer,
 				uint32_t *offset, struct cbfs_file *header)
 {
@@ -810,11 +824,23 @@ static int cbfs_add(void)
 	} else if (param.stage_xip) {
 		ERROR("cbfs add supports xip only for FSP component type\n");
 		return 1;
+	} else if (param.type == CBFS_COMPONENT_MICROCODE) {
+		convert = cbfstool_convert_microcode;
 	}
 
 	if (param.alignment) {
 		/* CBFS compression file attribute is unconditionally added. */
 		size_t metadata_sz = sizeof(struct cbfs_file_attr_compression);
+		if (convert == cbfstool_convert_microcode && param.filename &&
+		    param.compression == CBFS_COMPRESS_NONE) {
+			struct buffer buffer;
+			if (buffer_from_file(&buffer, param.filename) != 0) {
+				ERROR("Cannot load %s.\n", param.filename);
+				return 1;
+			}
+			metadata_sz += cbfs_microcode_index_size(&buffer);
+			buffer_delete(&buffer);
+		}
 		if (do_cbfs_locate(&address, metadata_sz, 0))
 			return 1;
 		local_baseaddress = address;
@@ -1173,6 +1199,8 @@ static int cbfs_write(void)
 	memcpy(param.image_region->data + offset, new_content.data,
 							new_content.size);
 	buffer_delete(&new_content);
+	/* With -F, this may have overwritten a CBFS */
+	cbfs_invalidate_free_space(param.image_region);
 	return 0;
 }
 
@@ -1271,6 +1299,77 @@ static int cbfs_compact(void)
 	return cbfs_compact_instance(&image);
 }
 
+/* Boot path files, roughly in the order in which they are loaded. */
+static const char * const default_hot_files[] = {
+	"fallback/romstage",
+	"cpu_microcode_blob.bin",
+	"fallback/postcar",
+	"fallback/ramstage",
+	"fallback/dsdt.aml",
+	"fallback/payload",
+	"normal/romstage",
+	"normal/postcar",
+	"normal/ramstage",
+	"normal/dsdt.aml",
+	"normal/payload",
+};
+
+static int cbfs_pack(void)
+{
+	struct cbfs_image image;
+	struct buffer profile;
+	const char * const *hot = default_hot_files;
+	size_t hot_count = ARRAY_SIZE(default_hot_files);
+	const char **names = NULL;
+	char *text = NULL, *line;
+	int ret = 1;
+
+	if (cbfs_image_from_buffer(&image, param.image_region,
+							param.headeroffset))
+		return 1;
+
+	/* The profile lists CBFS file names in the order they are accessed,
+	 * e.g. as recorded from a boot log, one per line. */
+	if (param.filename) {
+		if (buffer_from_file(&profile, param.filename))
+			return 1;
+		text = malloc(profile.size + 1);
+		names = malloc((profile.size / 2 + 1) * sizeof(*names));
+		if (!text || !names) {
+			ERROR("Out of memory reading profile.\n");
+			buffer_delete(&profile);
+			goto done;
+		}
+		memcpy(text, profile.data, profile.size);
+		text[profile.size] = '\0';
+		buffer_delete(&profile);
+
+		hot_count = 0;
+		for (line = strtok(text, "\r\n"); line;
+		     line = strtok(NULL, "\r\n")) {
+			char *end = line + strlen(line);
+
+			while (isspace((unsigned char)*line))
+				line++;
+			while (end > line && isspace((unsigned char)end[-1]))
+				*--end = '\0';
+			if (*line == '\0' || *line == '#')
+				continue;
+			names[hot_count++] = line;
+		}
+		hot = names;
+	}
+
+	/* Stages linked into the top 4 GiB window where the image is mapped
+	 * execute in place and can't be moved. */
+	ret = cbfs_pack_instance(&image, hot, hot_count, 0x100000000ULL -
+				 partitioned_file_total_size(param.image_file));
+done:
+	free(names);
+	free(text);
+	return ret;
+}
+
 static int cbfs_expand(void)
 {
 	struct buffer src_buf;
@@ -1317,6 +1416,7 @@ static const struct command commands[] = {
 	{"create", "M:r:s:B:b:H:o:m:vh?", cbfs_create, true, true},
 	{"extract", "H:r:m:n:f:Uvh?", cbfs_extract, true, false},
 	{"layout", "wvh?", cbfs_layout, false, false},
+	{"pack", "H:r:f:vh?", cbfs_pack, true, true},
 	{"print", "H:r:vkh?", cbfs_print, true, false},
 	{"read", "r:f:vh?", cbfs_read, true, false},
 	{"remove", "H:r:n:vh?", cbfs_remove, true, true},
@@ -1462,6 +1562,10 @@ static void usage(char *name)
 			"Remove a component\n"
 	     " compact -r image,regions                                    "
 			"Defragment CBFS image.\n"
+	     " pack [-r image,regions] [-f profile]                        "
+			"Reorder files to cut fragmentation and seeks\n"
+	     "                                                         "
+	     "    profile: file names in boot order, one per line     \n"
 	     " copy -r image,regions -R source-region                      "
 			"Create a copy (duplicate) cbfs instance in fmap\n"
 	     " create -m ARCH -s size [-b bootblock offset] \\\n"
@@ -1486,6 +1590,10 @@ static void usage(char *name)
 			"Truncate CBFS and print new size on stdout\n"
 	     " expand [-r fmap-region]                                     "
 			"Expand CBFS to span entire region\n"
+	     " batch [SCRIPT]                                              "
+			"Run the commands in SCRIPT (or stdin) on the image\n"
+	     "                                                         "
+	     "    one per line, writing the image only once at the end\n"
 	     " update-fit [-r image,regions] -n MICROCODE_BLOB_NAME \\\n"
 	     "        -x EMTPY_FIT_ENTRIES \\                         \n"
 	     "        [-j topswap-size [-q ucode-region](Intel CPUs only)] "
@@ -1527,263 +1635,503 @@ static void usage(char *name)
 	     );
 }
 
-int main(int argc, char **argv)
+/*
+ * Parses the options of one command into param. Also used for the command
+ * lines of a batch script, in which case argv[0] is the command name.
+ */
+static int parse_command_options(char *prog, int argc, char **argv,
+				 const struct command *command)
 {
-	size_t i;
 	int c;
 
-	if (argc < 3) {
-		usage(argv[0]);
-		return 1;
-	}
+	while (1) {
+		char *suffix = NULL;
+		int option_index = 0;
 
-	char *image_name = argv[1];
-	char *cmd = argv[2];
-	optind += 2;
-
-	for (i = 0; i < ARRAY_SIZE(commands); i++) {
-		if (strcmp(cmd, commands[i].name) != 0)
-			continue;
+		c = getopt_long(argc, argv, command->optstring,
+					long_options, &option_index);
+		if (c == -1) {
+			if (optind < argc) {
+				ERROR("%s: excessive argument -- '%s'\n",
+				      prog, argv[optind]);
+				return 1;
+			}
+			break;
+		}
 
-		while (1) {
-			char *suffix = NULL;
-			int option_index = 0;
+		/* Filter out illegal long options */
+		if (strchr(command->optstring, c) == NULL) {
+			/* TODO maybe print actual long option instead */
+			ERROR("%s: invalid option -- '%c'\n", prog, c);
+			c = '?';
+		}
 
-			c = getopt_long(argc, argv, commands[i].optstring,
-						long_options, &option_index);
-			if (c == -1) {
-				if (optind < argc) {
-					ERROR("%s: excessive argument -- '%s'"
-						"\n", argv[0], argv[optind]);
-					return 1;
-				}
+		switch(c) {
+		case 'n':
+			param.name = optarg;
+			break;
+		case 't':
+			if (intfiletype(optarg) != ((uint64_t) - 1))
+				param.type = intfiletype(optarg);
+			else
+				param.type = strtoul(optarg, NULL, 0);
+			if (param.type == 0)
+				WARN("Unknown type '%s' ignored\n",
+						optarg);
+			break;
+		case 'c': {
+			if (strcmp(optarg, "precompression") == 0) {
+				param.precompression = 1;
 				break;
 			}
-
-			/* Filter out illegal long options */
-			if (strchr(commands[i].optstring, c) == NULL) {
-				/* TODO maybe print actual long option instead */
-				ERROR("%s: invalid option -- '%c'\n",
-				      argv[0], c);
-				c = '?';
+			int algo = cbfs_parse_comp_algo(optarg);
+			if (algo >= 0)
+				param.compression = algo;
+			else
+				WARN("Unknown compression '%s' ignored.\n",
+								optarg);
+			break;
+		}
+		case 'A': {
+			int algo = cbfs_parse_hash_algo(optarg);
+			if (algo >= 0)
+				param.hash = algo;
+			else {
+				ERROR("Unknown hash algorithm '%s'.\n",
+					optarg);
+				return 1;
 			}
-
-			switch(c) {
-			case 'n':
-				param.name = optarg;
-				break;
-			case 't':
-				if (intfiletype(optarg) != ((uint64_t) - 1))
-					param.type = intfiletype(optarg);
-				else
-					param.type = strtoul(optarg, NULL, 0);
-				if (param.type == 0)
-					WARN("Unknown type '%s' ignored\n",
-							optarg);
-				break;
-			case 'c': {
-				if (strcmp(optarg, "precompression") == 0) {
-					param.precompression = 1;
-					break;
-				}
-				int algo = cbfs_parse_comp_algo(optarg);
-				if (algo >= 0)
-					param.compression = algo;
-				else
-					WARN("Unknown compression '%s' ignored.\n",
-									optarg);
-				break;
+			break;
+		}
+		case 'M':
+			param.fmap = optarg;
+			break;
+		case 'r':
+			param.region_name = optarg;
+			break;
+		case 'R':
+			param.source_region = optarg;
+			break;
+		case 'b':
+			param.baseaddress = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid base address '%s'.\n",
+					optarg);
+				return 1;
 			}
-			case 'A': {
-				int algo = cbfs_parse_hash_algo(optarg);
-				if (algo >= 0)
-					param.hash = algo;
-				else {
-					ERROR("Unknown hash algorithm '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
+			// baseaddress may be zero on non-x86, so we
+			// need an explicit "baseaddress_assigned".
+			param.baseaddress_assigned = 1;
+			break;
+		case 'l':
+			param.loadaddress = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid load address '%s'.\n",
+					optarg);
+				return 1;
 			}
-			case 'M':
-				param.fmap = optarg;
-				break;
-			case 'r':
-				param.region_name = optarg;
-				break;
-			case 'R':
-				param.source_region = optarg;
-				break;
-			case 'b':
-				param.baseaddress = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid base address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				// baseaddress may be zero on non-x86, so we
-				// need an explicit "baseaddress_assigned".
-				param.baseaddress_assigned = 1;
-				break;
-			case 'l':
-				param.loadaddress = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid load address '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'e':
-				param.entrypoint = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid entry point '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 's':
-				param.size = strtoul(optarg, &suffix, 0);
-				if (!*optarg) {
-					ERROR("Empty size specified.\n");
-					return 1;
-				}
-				switch (tolower((int)suffix[0])) {
-				case 'k':
-					param.size *= 1024;
-					break;
-				case 'm':
-					param.size *= 1024 * 1024;
-					break;
-				case '\0':
-					break;
-				default:
-					ERROR("Invalid suffix for size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'B':
-				param.bootblock = optarg;
-				break;
-			case 'H':
-				param.headeroffset = strtoul(
-						optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid header offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.headeroffset_assigned = 1;
-				break;
-			case 'a':
-				param.alignment = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid alignment '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'p':
-				param.padding = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid pad size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'P':
-				param.pagesize = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid page size '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'o':
-				param.cbfsoffset = strtoul(optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid cbfs offset '%s'.\n",
-						optarg);
-					return 1;
-				}
-				param.cbfsoffset_assigned = 1;
-				break;
-			case 'f':
-				param.filename = optarg;
-				break;
-			case 'F':
-				param.force = 1;
-				break;
-			case 'i':
-				param.u64val = strtoull(optarg, &suffix, 0);
-				param.u64val_assigned = 1;
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid int parameter '%s'.\n",
-						optarg);
-					return 1;
-				}
-				break;
-			case 'u':
-				param.fill_partial_upward = true;
-				break;
-			case 'd':
-				param.fill_partial_downward = true;
-				break;
-			case 'w':
-				param.show_immutable = true;
-				break;
-			case 'x':
-				param.fit_empty_entries = strtol(
-						optarg, &suffix, 0);
-				if (!*optarg || (suffix && *suffix)) {
-					ERROR("Invalid number of fit entries "
-						"'%s'.\n", optarg);
-					return 1;
-				}
-				break;
-			case 'j':
-				param.topswap_size = strtol(optarg, NULL, 0);
-				if (!is_valid_topswap())
-					return 1;
-				break;
-			case 'q':
-				param.ucode_region = optarg;
-				break;
-			case 'v':
-				verbose++;
+			break;
+		case 'e':
+			param.entrypoint = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid entry point '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			param.size = strtoul(optarg, &suffix, 0);
+			if (!*optarg) {
+				ERROR("Empty size specified.\n");
+				return 1;
+			}
+			switch (tolower((int)suffix[0])) {
+			case 'k':
+				param.size *= 1024;
 				break;
 			case 'm':
-				param.arch = string_to_arch(optarg);
-				break;
-			case 'I':
-				param.initrd = optarg;
-				break;
-			case 'C':
-				param.cmdline = optarg;
-				break;
-			case 'S':
-				param.ignore_section = optarg;
-				break;
-			case 'y':
-				param.stage_xip = true;
+				param.size *= 1024 * 1024;
 				break;
-			case 'g':
-				param.autogen_attr = true;
+			case '\0':
 				break;
-			case 'k':
-				param.machine_parseable = true;
-				break;
-			case 'U':
-				param.unprocessed = true;
-				break;
-			case 'h':
-			case '?':
-				usage(argv[0]);
-				return 1;
 			default:
+				ERROR("Invalid suffix for size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'B':
+			param.bootblock = optarg;
+			break;
+		case 'H':
+			param.headeroffset = strtoul(
+					optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid header offset '%s'.\n",
+					optarg);
+				return 1;
+			}
+			param.headeroffset_assigned = 1;
+			break;
+		case 'a':
+			param.alignment = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid alignment '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			param.padding = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid pad size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'P':
+			param.pagesize = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid page size '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'o':
+			param.cbfsoffset = strtoul(optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid cbfs offset '%s'.\n",
+					optarg);
+				return 1;
+			}
+			param.cbfsoffset_assigned = 1;
+			break;
+		case 'f':
+			param.filename = optarg;
+			break;
+		case 'F':
+			param.force = 1;
+			break;
+		case 'i':
+			param.u64val = strtoull(optarg, &suffix, 0);
+			param.u64val_assigned = 1;
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid int parameter '%s'.\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			param.fill_partial_upward = true;
+			break;
+		case 'd':
+			param.fill_partial_downward = true;
+			break;
+		case 'w':
+			param.show_immutable = true;
+			break;
+		case 'x':
+			param.fit_empty_entries = strtol(
+					optarg, &suffix, 0);
+			if (!*optarg || (suffix && *suffix)) {
+				ERROR("Invalid number of fit entries "
+					"'%s'.\n", optarg);
+				return 1;
+			}
+			break;
+		case 'j':
+			param.topswap_size = strtol(optarg, NULL, 0);
+			if (!is_valid_topswap())
+				return 1;
+			break;
+		case 'q':
+			param.ucode_region = optarg;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case 'm':
+			param.arch = string_to_arch(optarg);
+			break;
+		case 'I':
+			param.initrd = optarg;
+			break;
+		case 'C':
+			param.cmdline = optarg;
+			break;
+		case 'S':
+			param.ignore_section = optarg;
+			break;
+		case 'y':
+			param.stage_xip = true;
+			break;
+		case 'g':
+			param.autogen_attr = true;
+			break;
+		case 'k':
+			param.machine_parseable = true;
+			break;
+		case 'U':
+			param.unprocessed = true;
+			break;
+		case 'h':
+		case '?':
+			usage(prog);
+			return 1;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Runs a command whose options have been parsed on every region in the -r
+ * list of the already opened param.image_file.
+ */
+static int run_command(const struct command *command)
+{
+	unsigned num_regions = 1;
+	for (const char *list = strchr(param.region_name, ','); list;
+					list = strchr(list + 1, ','))
+		++num_regions;
+
+	// If the action needs to read an image region, as indicated by
+	// having accesses_region set in its command struct, that
+	// region's buffer struct will be stored here and the client
+	// will receive a pointer to it via param.image_region. It
+	// need not write the buffer back to the image file itself,
+	// since this behavior can be requested via its modifies_region
+	// field. Additionally, it should never free the region buffer,
+	// as that is performed automatically once it completes.
+	struct buffer image_regions[num_regions];
+	memset(image_regions, 0, sizeof(image_regions));
+
+	bool seen_primary_cbfs = false;
+	char region_name_scratch[strlen(param.region_name) + 1];
+	strcpy(region_name_scratch, param.region_name);
+	param.region_name = strtok(region_name_scratch, ",");
+	for (unsigned region = 0; region < num_regions; ++region) {
+		if (!param.region_name) {
+			ERROR("Encountered illegal degenerate region name in -r list\n");
+			ERROR("The image will be left unmodified.\n");
+			return 1;
+		}
+
+		if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS) == 0)
+			seen_primary_cbfs = true;
+
+		param.image_region = image_regions + region;
+		if (dispatch_command(*command))
+			return 1;
+
+		param.region_name = strtok(NULL, ",");
+	}
+
+	if (command->function == cbfs_create && !seen_primary_cbfs) {
+		ERROR("The creation -r list must include the mandatory '%s' section.\n",
+					SECTION_NAME_PRIMARY_CBFS);
+		ERROR("The image will be left unmodified.\n");
+		return 1;
+	}
+
+	if (command->modifies_region) {
+		assert(param.image_file);
+		for (unsigned region = 0; region < num_regions; ++region) {
+			if (!partitioned_file_write_region(param.image_file,
+						image_regions + region))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+#define BATCH_MAX_ARGS	64
+
+/*
+ * Makes getopt_long() start over on a new argument vector. glibc and musl
+ * only drop the position inside a grouped option like "-vn" when optind is 0,
+ * the BSDs and macOS need optreset instead and expect optind to be 1.
+ */
+static void reset_getopt(void)
+{
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+	defined(__OpenBSD__) || defined(__DragonFly__)
+	optreset = 1;
+	optind = 1;
+#else
+	optind = 0;
+#endif
+}
+
+/*
+ * Splits a batch script line into arguments in place. Arguments are
+ * separated by whitespace and may be quoted with '' or "". A '#' outside of
+ * quotes starts a comment. Returns the number of arguments or -1 on error.
+ */
+static int split_batch_line(char *line, char **args, int max_args)
+{
+	int argc = 0;
+	char *in = line, *out = line;
+
+	while (1) {
+		while (isspace((unsigned char)*in))
+			++in;
+		if (!*in || *in == '#')
+			break;
+		if (argc == max_args - 1) {
+			ERROR("Too many arguments\n");
+			return -1;
+		}
+
+		args[argc++] = out;
+		char quote = 0;
+		for (; *in; ++in) {
+			if (quote) {
+				if (*in == quote)
+					quote = 0;
+				else
+					*out++ = *in;
+			} else if (*in == '\'' || *in == '"') {
+				quote = *in;
+			} else if (isspace((unsigned char)*in)) {
 				break;
+			} else {
+				*out++ = *in;
 			}
 		}
+		if (quote) {
+			ERROR("Unterminated quote\n");
+			return -1;
+		}
+		if (*in)
+			++in;
+		*out++ = '\0';
+	}
+	args[argc] = NULL;
+	return argc;
+}
+
+/*
+ * Applies the commands in a script (or stdin) to an image that is loaded and
+ * written back only once. Each line takes the same form as a regular
+ * invocation without the image name, e.g. "add -f foo.bin -n foo -t raw".
+ * Region writes are deferred until the whole script has succeeded, so a
+ * failing command leaves the image on disk untouched.
+ */
+static int cbfs_batch(char *prog, const char *image_name, int argc,
+		      char **argv)
+{
+	FILE *script = stdin;
+	const char *script_name = "<stdin>";
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned lineno = 0;
+	int ret = 0;
+
+	if (argc > 1) {
+		ERROR("batch takes at most one script file argument\n");
+		return 1;
+	}
+	if (argc == 1 && strcmp(argv[0], "-") != 0) {
+		script_name = argv[0];
+		script = fopen(script_name, "r");
+		if (!script) {
+			perror(script_name);
+			return 1;
+		}
+	}
+
+	param.image_file = partitioned_file_reopen(image_name, true);
+	if (!param.image_file) {
+		if (script != stdin)
+			fclose(script);
+		return 1;
+	}
+	partitioned_file_defer_writes(param.image_file);
+
+	const struct param defaults = param;
+	const int default_verbose = verbose;
+
+	while (getline(&line, &line_size, script) != -1) {
+		char *args[BATCH_MAX_ARGS];
+		const struct command *command = NULL;
+
+		++lineno;
+		int nargs = split_batch_line(line, args, ARRAY_SIZE(args));
+		if (nargs < 0) {
+			ret = 1;
+			break;
+		}
+		if (nargs == 0)
+			continue;
+
+		for (size_t i = 0; i < ARRAY_SIZE(commands); i++) {
+			if (strcmp(args[0], commands[i].name) == 0)
+				command = commands + i;
+		}
+		if (!command) {
+			ERROR("Unknown command '%s'.\n", args[0]);
+			ret = 1;
+			break;
+		}
+		if (command->function == cbfs_create) {
+			ERROR("'create' is not supported in batch mode.\n");
+			ret = 1;
+			break;
+		}
+
+		param = defaults;
+		verbose = default_verbose;
+		reset_getopt();
+		if (parse_command_options(prog, nargs, args, command) ||
+						run_command(command)) {
+			ret = 1;
+			break;
+		}
+	}
+
+	if (ret) {
+		ERROR("%s:%u: batch aborted, the image will be left unmodified.\n",
+						script_name, lineno);
+	} else if (ferror(script)) {
+		ERROR("Failed to read %s\n", script_name);
+		ret = 1;
+	} else if (!partitioned_file_flush(param.image_file)) {
+		ret = 1;
+	}
+
+	free(line);
+	if (script != stdin)
+		fclose(script);
+	partitioned_file_close(param.image_file);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	size_t i;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	char *image_name = argv[1];
+	char *cmd = argv[2];
+	optind += 2;
+
+	if (strcmp(cmd, "batch") == 0)
+		return cbfs_batch(argv[0], image_name, argc - 3, argv + 3);
+
+	for (i = 0; i < ARRAY_SIZE(commands); i++) {
+		if (strcmp(cmd, commands[i].name) != 0)
+			continue;
+
+		if (parse_command_options(argv[0], argc, argv, &commands[i]))
+			return 1;
 
 		if (commands[i].function == cbfs_create) {
 			if (param.fmap) {
@@ -1810,72 +2158,9 @@ int main(int argc, char **argv)
 		if (!param.image_file)
 			return 1;
 
-		unsigned num_regions = 1;
-		for (const char *list = strchr(param.region_name, ','); list;
-						list = strchr(list + 1, ','))
-			++num_regions;
-
-		// If the action needs to read an image region, as indicated by
-		// having accesses_region set in its command struct, that
-		// region's buffer struct will be stored here and the client
-		// will receive a pointer to it via param.image_region. It
-		// need not write the buffer back to the image file itself,
-		// since this behavior can be requested via its modifies_region
-		// field. Additionally, it should never free the region buffer,
-		// as that is performed automatically once it completes.
-		struct buffer image_regions[num_regions];
-		memset(image_regions, 0, sizeof(image_regions));
-
-		bool seen_primary_cbfs = false;
-		char region_name_scratch[strlen(param.region_name) + 1];
-		strcpy(region_name_scratch, param.region_name);
-		param.region_name = strtok(region_name_scratch, ",");
-		for (unsigned region = 0; region < num_regions; ++region) {
-			if (!param.region_name) {
-				ERROR("Encountered illegal degenerate region name in -r list\n");
-				ERROR("The image will be left unmodified.\n");
-				partitioned_file_close(param.image_file);
-				return 1;
-			}
-
-			if (strcmp(param.region_name, SECTION_NAME_PRIMARY_CBFS)
-									== 0)
-				seen_primary_cbfs = true;
-
-			param.image_region = image_regions + region;
-			if (dispatch_command(commands[i])) {
-				partitioned_file_close(param.image_file);
-				return 1;
-			}
-
-			param.region_name = strtok(NULL, ",");
-		}
-
-		if (commands[i].function == cbfs_create && !seen_primary_cbfs) {
-			ERROR("The creation -r list must include the mandatory '%s' section.\n",
-						SECTION_NAME_PRIMARY_CBFS);
-			ERROR("The image will be left unmodified.\n");
-			partitioned_file_close(param.image_file);
-			return 1;
-		}
-
-		if (commands[i].modifies_region) {
-			assert(param.image_file);
-			for (unsigned region = 0; region < num_regions;
-								++region) {
-
-				if (!partitioned_file_write_region(
-							param.image_file,
-						image_regions + region)) {
-					partitioned_file_close(
-							param.image_file);
-					return 1;
-				}
-			}
-		}
-
+		int ret = run_command(&commands[i]);
 		partitioned_file_close(param.image_file);
-		return 0;
+		return ret;
 	}
 
 	ERROR("Unknown command '%s'.\n", cmd);
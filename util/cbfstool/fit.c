@@ -44,19 +44,6 @@ struct fit_table {
 	struct fit_entry entries[];
 } __packed;
 
-struct microcode_header {
-	uint32_t version;
-	uint32_t revision;
-	uint32_t date;
-	uint32_t processor_signature;
-	uint32_t checksum;
-	uint32_t loader_revision;
-	uint32_t processor_flags;
-	uint32_t data_size;
-	uint32_t total_size;
-	uint8_t  reserved[12];
-} __packed;
-
 struct microcode_entry {
 	int offset;
 	int size;
@@ -21,12 +21,122 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#define HAVE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct dirty_range {
+	size_t offset;
+	size_t size;
+};
+
 struct partitioned_file {
 	struct fmap *fmap;
 	struct buffer buffer;
 	FILE *stream;
+	// buffer.data is a private (copy-on-write) mapping of the file rather
+	// than a heap copy, so changes only reach the file when written back.
+	bool mapped;
+	// For mapped files opened for writing: a read-only shared mapping of
+	// the file, used to write back only the pages that actually changed.
+	char *view;
+	// Set by partitioned_file_defer_writes(): region writes only record
+	// the dirty range here until partitioned_file_flush() is called.
+	bool defer_writes;
+	struct dirty_range *dirty;
+	size_t num_dirty;
+	size_t dirty_capacity;
 };
 
+static bool record_dirty_range(struct partitioned_file *file, size_t offset,
+								size_t size)
+{
+	if (file->num_dirty == file->dirty_capacity) {
+		size_t capacity = file->dirty_capacity ?
+					file->dirty_capacity * 2 : 16;
+		struct dirty_range *dirty = realloc(file->dirty,
+						capacity * sizeof(*dirty));
+		if (!dirty) {
+			ERROR("Failed to allocate dirty range list\n");
+			return false;
+		}
+		file->dirty = dirty;
+		file->dirty_capacity = capacity;
+	}
+	file->dirty[file->num_dirty].offset = offset;
+	file->dirty[file->num_dirty].size = size;
+	++file->num_dirty;
+	return true;
+}
+
+static int compare_dirty_ranges(const void *a, const void *b)
+{
+	const struct dirty_range *ra = a, *rb = b;
+
+	if (ra->offset != rb->offset)
+		return ra->offset < rb->offset ? -1 : 1;
+	return 0;
+}
+
+static bool write_bytes(struct partitioned_file *file, size_t offset,
+								size_t size)
+{
+	if (fseek(file->stream, offset, SEEK_SET)) {
+		ERROR("Failed to seek within image file\n");
+		return false;
+	}
+	if (size && !fwrite(file->buffer.data + offset, size, 1,
+							file->stream)) {
+		ERROR("Failed to write to image file\n");
+		return false;
+	}
+	return true;
+}
+
+static bool write_range(struct partitioned_file *file, size_t offset,
+								size_t size)
+{
+	if (!file->view)
+		return write_bytes(file, offset, size);
+
+#ifdef HAVE_MMAP
+	// Compare the private mapping against the file page by page and only
+	// write back the runs of pages that differ.
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t end = offset + size;
+	size_t run_start = 0;
+	bool in_run = false;
+
+	for (size_t pos = offset; pos < end;) {
+		size_t next = MIN(end, (pos / page + 1) * page);
+		bool dirty = memcmp(file->buffer.data + pos, file->view + pos,
+							next - pos) != 0;
+
+		if (dirty && !in_run) {
+			run_start = pos;
+			in_run = true;
+		} else if (!dirty && in_run) {
+			if (!write_bytes(file, run_start, pos - run_start))
+				return false;
+			in_run = false;
+		}
+		pos = next;
+	}
+	if (in_run && !write_bytes(file, run_start, end - run_start))
+		return false;
+
+	// Make the view reflect what has been written.
+	if (fflush(file->stream)) {
+		ERROR("Failed to write to image file\n");
+		return false;
+	}
+#endif
+	return true;
+}
+
 static bool fill_ones_through(struct partitioned_file *file)
 {
 	assert(file);
@@ -49,6 +159,50 @@ static unsigned count_selected_fmap_entries(const struct fmap *fmap,
 	return count;
 }
 
+/*
+ * Maps the file instead of reading it into memory, so commands only page in
+ * the parts of the image they actually look at. Returns false if the file
+ * can't be mapped, in which case the caller falls back to reading it.
+ */
+static bool map_file(struct partitioned_file *file, const char *filename,
+							bool write_access)
+{
+#ifdef HAVE_MMAP
+	int fd = fileno(file->stream);
+	struct stat st;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+		return false;
+
+	size_t size = st.st_size;
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+								fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+
+	if (write_access) {
+		void *view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (view == MAP_FAILED) {
+			munmap(data, size);
+			return false;
+		}
+		file->view = view;
+	}
+
+	file->buffer.name = strdup(filename);
+	file->buffer.data = data;
+	file->buffer.offset = 0;
+	file->buffer.size = size;
+	file->mapped = true;
+	return true;
+#else
+	(void)file;
+	(void)filename;
+	(void)write_access;
+	return false;
+#endif
+}
+
 static partitioned_file_t *reopen_flat_file(const char *filename,
 					    bool write_access)
 {
@@ -61,16 +215,17 @@ static partitioned_file_t *reopen_flat_file(const char *filename,
 		return NULL;
 	}
 
-	if (buffer_from_file(&file->buffer, filename)) {
-		free(file);
-		return NULL;
-	}
-
 	access_mode = write_access ?  "rb+" : "rb";
 	file->stream = fopen(filename, access_mode);
 
 	if (!file->stream) {
 		perror(filename);
+		free(file);
+		return NULL;
+	}
+
+	if (!map_file(file, filename, write_access) &&
+				buffer_from_file(&file->buffer, filename)) {
 		partitioned_file_close(file);
 		return NULL;
 	}
@@ -227,15 +382,52 @@ bool partitioned_file_write_region(partitioned_file_t *file,
 		return false;
 	}
 
-	if (fseek(file->stream, buffer->offset, SEEK_SET)) {
-		ERROR("Failed to seek within image file\n");
-		return false;
+	if (file->defer_writes)
+		return record_dirty_range(file, buffer->offset, buffer->size);
+	return write_range(file, buffer->offset, buffer->size);
+}
+
+void partitioned_file_defer_writes(partitioned_file_t *file)
+{
+	assert(file);
+
+	file->defer_writes = true;
+}
+
+bool partitioned_file_flush(partitioned_file_t *file)
+{
+	assert(file);
+	assert(file->stream);
+
+	if (!file->num_dirty)
+		return true;
+
+	qsort(file->dirty, file->num_dirty, sizeof(*file->dirty),
+							compare_dirty_ranges);
+
+	// Coalesce overlapping and adjacent ranges, so that every byte is
+	// written at most once and in file order.
+	size_t start = file->dirty[0].offset;
+	size_t end = start + file->dirty[0].size;
+	for (size_t i = 1; i < file->num_dirty; ++i) {
+		const struct dirty_range *range = file->dirty + i;
+
+		if (range->offset <= end) {
+			if (range->offset + range->size > end)
+				end = range->offset + range->size;
+			continue;
+		}
+		if (!write_range(file, start, end - start))
+			return false;
+		start = range->offset;
+		end = start + range->size;
 	}
-	if (!fwrite(buffer->data, buffer->size, 1, file->stream)) {
-		ERROR("Failed to write to image file\n");
+	if (!write_range(file, start, end - start))
 		return false;
-	}
-	return true;
+
+	DEBUG("Flushed %zu region writes to image file\n", file->num_dirty);
+	file->num_dirty = 0;
+	return fflush(file->stream) == 0;
 }
 
 bool partitioned_file_read_region(struct buffer *dest,
@@ -276,6 +468,15 @@ void partitioned_file_close(partitioned_file_t *file)
 		return;
 
 	file->fmap = NULL;
+	free(file->dirty);
+#ifdef HAVE_MMAP
+	if (file->view)
+		munmap(file->view, file->buffer.size);
+	if (file->mapped) {
+		munmap(file->buffer.data, file->buffer.size);
+		file->buffer.data = NULL;
+	}
+#endif
 	buffer_delete(&file->buffer);
 	if (file->stream) {
 		fclose(file->stream);
@@ -91,6 +91,27 @@ partitioned_file_t *partitioned_file_reopen(const char *filename,
 bool partitioned_file_write_region(partitioned_file_t *file,
 						const struct buffer *buffer);
 
+/**
+ * Stop writing regions back to the backing file immediately.
+ * After this call, partitioned_file_write_region() only records which part of
+ * the image has changed; the data is written out by partitioned_file_flush().
+ * This lets a sequence of operations modify the same region many times while
+ * touching the backing file only once per dirty range. Closing the file
+ * without flushing it discards all deferred writes.
+ *
+ * @param file Partitioned file whose writes should be deferred
+ */
+void partitioned_file_defer_writes(partitioned_file_t *file);
+
+/**
+ * Write all deferred region writes to the backing file.
+ * Overlapping and adjacent dirty ranges are merged and written in file order.
+ *
+ * @param file Partitioned file to flush
+ * @return     Whether all dirty ranges were written successfully
+ */
+bool partitioned_file_flush(partitioned_file_t *file);
+
 /**
  * Obtain one particular region of a segmented file.
  * The result is owned by the partitioned_file_t and shared among every caller
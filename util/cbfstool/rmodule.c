@@ -462,6 +462,64 @@ add_section(struct elf_writer *ew, struct buffer *data, const char *name,
 	return ret;
 }
 
+static size_t put_uleb128(const struct rmod_context *ctx, struct buffer *b,
+			  uint32_t val)
+{
+	size_t n = 0;
+	uint8_t byte;
+
+	do {
+		byte = val & 0x7f;
+		val >>= 7;
+		if (val)
+			byte |= 0x80;
+		if (b != NULL)
+			ctx->xdr->put8(b, byte);
+		n++;
+	} while (val);
+
+	return n;
+}
+
+/*
+ * Encode the sorted relocations as described for RMODULE_VERSION_2 into b,
+ * or only compute the size of the stream if b is NULL.
+ */
+static int encode_relocations(const struct rmod_context *ctx, int bit64,
+			      struct buffer *b, size_t *size)
+{
+	const Elf64_Addr *relocs = ctx->emitted_relocs;
+	Elf64_Xword ptr_size = bit64 ? sizeof(Elf64_Addr) : sizeof(Elf32_Addr);
+	Elf64_Addr prev = 0;
+	Elf64_Addr delta;
+	size_t i, run;
+
+	*size = 0;
+
+	for (i = 0; i < ctx->nrelocs; i += run + 1) {
+		/* Pointers right after each other are sent as a run. */
+		for (run = 0; i + run + 1 < ctx->nrelocs; run++) {
+			if (relocs[i + run + 1] - relocs[i + run] != ptr_size)
+				break;
+		}
+
+		delta = relocs[i] - prev;
+		if (relocs[i] < prev || delta > UINT32_MAX >> 1) {
+			ERROR("Can't encode relocation at 0x%" PRIx64 ".\n",
+			      relocs[i]);
+			return -1;
+		}
+
+		*size += put_uleb128(ctx, b, delta << 1 | !!run);
+		if (run)
+			*size += put_uleb128(ctx, b, run);
+
+		prev = relocs[i + run];
+	}
+
+	return 0;
+}
+
 static int
 write_elf(const struct rmod_context *ctx, const struct buffer *in,
           struct buffer *out)
@@ -475,6 +533,7 @@ write_elf(const struct rmod_context *ctx, const struct buffer *in,
 	struct buffer rmod_header;
 	struct buffer program;
 	struct buffer relocs;
+	size_t relocs_size;
 	Elf64_Xword total_size;
 	Elf64_Addr addr;
 	Elf64_Ehdr ehdr;
@@ -493,11 +552,9 @@ write_elf(const struct rmod_context *ctx, const struct buffer *in,
 	 */
 
 	/* Create buffer for header and relocations. */
-	rmod_data_size = sizeof(struct rmodule_header);
-	if (bit64)
-		rmod_data_size += ctx->nrelocs * sizeof(Elf64_Addr);
-	else
-		rmod_data_size += ctx->nrelocs * sizeof(Elf32_Addr);
+	if (encode_relocations(ctx, bit64, NULL, &relocs_size))
+		return -1;
+	rmod_data_size = sizeof(struct rmodule_header) + relocs_size;
 
 	if (buffer_create(&rmod_data, rmod_data_size, "rmod"))
 		return -1;
@@ -526,7 +583,7 @@ write_elf(const struct rmod_context *ctx, const struct buffer *in,
 
 	/* Write out rmodule_header. */
 	ctx->xdr->put16(&rmod_header, RMODULE_MAGIC);
-	ctx->xdr->put8(&rmod_header, RMODULE_VERSION_1);
+	ctx->xdr->put8(&rmod_header, RMODULE_VERSION_2);
 	ctx->xdr->put8(&rmod_header, 0);
 	/* payload_begin_offset */
 	loc = sizeof(struct rmodule_header);
@@ -537,10 +594,7 @@ write_elf(const struct rmod_context *ctx, const struct buffer *in,
 	/* relocations_begin_offset */
 	ctx->xdr->put32(&rmod_header, loc);
 	/* relocations_end_offset */
-	if (bit64)
-		loc += ctx->nrelocs * sizeof(Elf64_Addr);
-	else
-		loc += ctx->nrelocs * sizeof(Elf32_Addr);
+	loc += relocs_size;
 	ctx->xdr->put32(&rmod_header, loc);
 	/* module_link_start_address */
 	ctx->xdr->put32(&rmod_header, ctx->phdr->p_vaddr);
@@ -563,12 +617,7 @@ write_elf(const struct rmod_context *ctx, const struct buffer *in,
 	ctx->xdr->put32(&rmod_header, 0);
 
 	/* Write the relocations. */
-	for (unsigned i = 0; i < ctx->nrelocs; i++) {
-		if (bit64)
-			ctx->xdr->put64(&relocs, ctx->emitted_relocs[i]);
-		else
-			ctx->xdr->put32(&relocs, ctx->emitted_relocs[i]);
-	}
+	encode_relocations(ctx, bit64, &relocs, &relocs_size);
 
 	total_size = 0;
 	addr = 0;
@@ -735,6 +784,52 @@ static void rmod_deserialize(struct rmodule_header *rmod, struct buffer *buff,
 	rmod->padding[3] = xdr->get32(buff);
 }
 
+static int add_relocation_stream(const struct rmodule_header *rmod,
+				 struct elf_writer *ew,
+				 const struct buffer *stream, int bit64,
+				 const char *section_name)
+{
+	const uint8_t *p = buffer_get(stream);
+	const uint8_t *end = p + buffer_size(stream);
+	Elf64_Xword ptr_size = bit64 ? sizeof(Elf64_Addr) : sizeof(Elf32_Addr);
+	Elf64_Addr addr = 0;
+	uint32_t val, run;
+	size_t n;
+
+	while (p < end) {
+		n = rmodule_read_uleb128(p, end, &val);
+		if (!n)
+			goto truncated;
+		p += n;
+
+		run = 0;
+		if (val & 1) {
+			n = rmodule_read_uleb128(p, end, &run);
+			if (!n)
+				goto truncated;
+			p += n;
+		}
+
+		for (addr += val >> 1;; addr += ptr_size) {
+			/* Skip any relocations that are below the link address. */
+			if (addr >= rmod->module_link_start_address &&
+			    elf_writer_add_rel(ew, section_name, addr)) {
+				ERROR("Relocation addition failure.\n");
+				return -1;
+			}
+
+			if (!run--)
+				break;
+		}
+	}
+
+	return 0;
+
+truncated:
+	ERROR("Truncated relocation stream.\n");
+	return -1;
+}
+
 int rmodule_stage_to_elf(Elf64_Ehdr *ehdr, struct buffer *buff)
 {
 	struct buffer reader;
@@ -758,7 +853,8 @@ int rmodule_stage_to_elf(Elf64_Ehdr *ehdr, struct buffer *buff)
 	/* Indicate that file is not an rmodule if initial checks fail. */
 	if (rmod.magic != RMODULE_MAGIC)
 		return 1;
-	if (rmod.version != RMODULE_VERSION_1)
+	if (rmod.version != RMODULE_VERSION_1 &&
+	    rmod.version != RMODULE_VERSION_2)
 		return 1;
 
 	if (rmod.payload_begin_offset > input_sz ||
@@ -845,7 +941,15 @@ int rmodule_stage_to_elf(Elf64_Ehdr *ehdr, struct buffer *buff)
 	ssize_t relocs_sz = rmod.relocations_end_offset;
 	relocs_sz -= rmod.relocations_begin_offset;
 	buffer_splice(&reader, buff, rmod.relocations_begin_offset, relocs_sz);
-	while (relocs_sz > 0) {
+	if (rmod.version == RMODULE_VERSION_2) {
+		if (add_relocation_stream(&rmod, ew, &reader, bit64,
+					  section_name)) {
+			elf_writer_destroy(ew);
+			return -1;
+		}
+	}
+
+	while (rmod.version == RMODULE_VERSION_1 && relocs_sz > 0) {
 		Elf64_Addr addr;
 
 		if (bit64) {
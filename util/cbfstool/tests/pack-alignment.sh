@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+
+#
+# This file is part of the coreboot project.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; version 2 of the License.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+
+# Check that 'cbfstool pack' moves files into the free space in front of
+# them, but leaves files that were added with an alignment where they are.
+#
+# usage: pack-alignment.sh [path to cbfstool]
+
+set -e
+
+cbfstool="$(readlink -f "${1:-$(dirname "$0")/../cbfstool}")"
+tmpdir="$(mktemp -d)"
+trap 'rm -rf "${tmpdir}"' EXIT
+cd "${tmpdir}"
+
+# Prints the offset of the content of a file.
+content_offset() {
+	local offset metadata_size
+
+	read -r offset metadata_size < <("${cbfstool}" image.bin print -k |
+		awk -F '\t' -v name="$1" '$1 == name { print $2, $4 }')
+	echo $(( offset + metadata_size ))
+}
+
+head -c 70000 /dev/urandom > big
+head -c 3000 /dev/urandom > small
+
+"${cbfstool}" image.bin create -s 0x100000 -m x86 > /dev/null
+"${cbfstool}" image.bin add -f big -n big -t raw
+"${cbfstool}" image.bin add -f small -n aligned -t raw -a 0x10000
+"${cbfstool}" image.bin add -f small -n movable -t raw
+"${cbfstool}" image.bin remove -n big
+
+before="$(content_offset movable)"
+"${cbfstool}" image.bin pack
+
+if [ $(( $(content_offset aligned) % 0x10000 )) -ne 0 ]; then
+	echo "FAIL: pack broke the alignment of 'aligned'"
+	exit 1
+fi
+if [ "$(content_offset movable)" -ge "${before}" ]; then
+	echo "FAIL: pack didn't move 'movable'"
+	exit 1
+fi
+echo "PASS"
@@ -0,0 +1,542 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "libcbmem.h"
+
+#define HISTORY_MAGIC		0x48544243	/* "CBTH" */
+#define HISTORY_FORMAT		1
+
+#define ALIGN4(x)		(((x) + 3) & ~(size_t)3)
+
+/*
+ * A history file is a header followed by one record per boot. A record holds
+ * the firmware version and the timestamps in microseconds relative to the base
+ * time, all in host byte order. Records are only ever appended, so a boot
+ * interrupted while writing leaves at most a truncated last record.
+ */
+struct history_header {
+	uint32_t magic;
+	uint32_t format;
+} __packed;
+
+struct history_record {
+	uint32_t size;		/* Of the whole record, a multiple of 4 */
+	uint16_t version_len;	/* Length of the version, not terminated */
+	uint16_t num_entries;
+	uint64_t base_time;	/* In microseconds */
+	/* Followed by the version padded to 4 bytes, then the entries. */
+} __packed;
+
+struct history_entry {
+	uint32_t id;
+	uint32_t time;		/* In microseconds since base_time */
+} __packed;
+
+struct boot {
+	char *version;
+	uint64_t base_time;
+	size_t num_entries;
+	const struct history_entry *entries;
+};
+
+struct history {
+	char *data;
+	size_t valid_size;	/* Up to the end of the last complete record */
+	size_t num_boots;
+	struct boot *boots;
+};
+
+/* Time spent in one stage, one sample per boot */
+struct stage {
+	uint32_t id;
+	size_t count;
+	uint64_t *samples;
+	size_t last_boot;
+};
+
+struct stage_set {
+	size_t num_boots;
+	size_t num_stages;
+	struct stage *stages;
+	struct stage total;
+};
+
+struct stage_stats {
+	uint64_t min;
+	uint64_t median;
+	uint64_t p95;
+	uint64_t p99;
+};
+
+static void *xzalloc(size_t size)
+{
+	void *p = calloc(1, size ? size : 1);
+
+	if (!p) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p) {
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void history_free(struct history *h)
+{
+	size_t i;
+
+	for (i = 0; i < h->num_boots; i++)
+		free(h->boots[i].version);
+	free(h->boots);
+	free(h->data);
+}
+
+/* Read a history file and index its records. Returns 0 on success. */
+static int history_load(const char *path, struct history *h)
+{
+	const struct history_header *header;
+	size_t size, offset, capacity = 0;
+	long file_size;
+	FILE *f;
+
+	memset(h, 0, sizeof(*h));
+
+	f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "Could not open %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	if (fseek(f, 0, SEEK_END) || (file_size = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET)) {
+		fprintf(stderr, "Could not get size of %s: %s\n", path,
+			strerror(errno));
+		fclose(f);
+		return -1;
+	}
+	size = file_size;
+
+	h->data = xzalloc(size);
+	if (fread(h->data, 1, size, f) != size) {
+		fprintf(stderr, "Could not read %s\n", path);
+		fclose(f);
+		history_free(h);
+		return -1;
+	}
+	fclose(f);
+
+	header = (const void *)h->data;
+	if (size < sizeof(*header) || header->magic != HISTORY_MAGIC ||
+	    header->format != HISTORY_FORMAT) {
+		fprintf(stderr, "%s is not a cbmem history file.\n", path);
+		history_free(h);
+		return -1;
+	}
+
+	offset = sizeof(*header);
+	while (offset < size) {
+		const struct history_record *record;
+		size_t entries_offset;
+		struct boot *boot;
+
+		record = (const void *)(h->data + offset);
+		if (size - offset < sizeof(*record)) {
+			fprintf(stderr, "Ignoring truncated record at offset "
+				"%zu of %s.\n", offset, path);
+			break;
+		}
+
+		entries_offset = sizeof(*record) + ALIGN4(record->version_len);
+		if (record->size > size - offset || record->size <
+		    entries_offset + record->num_entries *
+		    sizeof(struct history_entry)) {
+			fprintf(stderr, "Ignoring truncated record at offset "
+				"%zu of %s.\n", offset, path);
+			break;
+		}
+
+		if (h->num_boots == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			h->boots = xrealloc(h->boots,
+					    capacity * sizeof(*h->boots));
+		}
+
+		boot = &h->boots[h->num_boots++];
+		boot->version = strndup((const char *)(record + 1),
+					record->version_len);
+		if (!boot->version) {
+			fprintf(stderr, "Out of memory.\n");
+			exit(1);
+		}
+		boot->base_time = record->base_time;
+		boot->num_entries = record->num_entries;
+		boot->entries = (const void *)(h->data + offset +
+					       entries_offset);
+
+		offset += record->size;
+	}
+	h->valid_size = offset;
+
+	return 0;
+}
+
+static int same_boot(const struct boot *boot,
+		     const struct history_record *record)
+{
+	const char *version = (const char *)(record + 1);
+	const char *entries = version + ALIGN4(record->version_len);
+
+	return boot->base_time == record->base_time &&
+	       boot->num_entries == record->num_entries &&
+	       strlen(boot->version) == record->version_len &&
+	       !memcmp(boot->version, version, record->version_len) &&
+	       !memcmp(boot->entries, entries,
+		       boot->num_entries * sizeof(struct history_entry));
+}
+
+int history_append(const char *path, const char *version,
+		   const struct timestamp_table *tst,
+		   unsigned long tick_freq_mhz)
+{
+	struct history_header header = {
+		.magic = HISTORY_MAGIC,
+		.format = HISTORY_FORMAT,
+	};
+	struct history_record *record;
+	struct history_entry *entries;
+	size_t version_len, size, i;
+	struct history h;
+	FILE *f;
+	int ret = -1;
+
+	if (tst->num_entries > UINT16_MAX) {
+		fprintf(stderr, "Too many timestamps for history.\n");
+		return -1;
+	}
+
+	version_len = strnlen(version, UINT16_MAX);
+	size = sizeof(*record) + ALIGN4(version_len) +
+	       tst->num_entries * sizeof(*entries);
+
+	record = xzalloc(size);
+	record->size = size;
+	record->version_len = version_len;
+	record->num_entries = tst->num_entries;
+	record->base_time = tst->base_time / tick_freq_mhz;
+	memcpy(record + 1, version, version_len);
+
+	entries = (void *)((char *)record + sizeof(*record) +
+			   ALIGN4(version_len));
+	for (i = 0; i < tst->num_entries; i++) {
+		uint64_t time = tst->entries[i].entry_stamp / tick_freq_mhz;
+
+		entries[i].id = tst->entries[i].entry_id;
+		entries[i].time = time > UINT32_MAX ? UINT32_MAX : time;
+	}
+
+	f = fopen(path, "ab");
+	if (!f || fseek(f, 0, SEEK_END) || ftell(f) < 0) {
+		fprintf(stderr, "Could not open %s: %s\n", path,
+			strerror(errno));
+		goto out;
+	}
+
+	if (ftell(f) == 0) {
+		if (fwrite(&header, sizeof(header), 1, f) != 1)
+			goto write_error;
+	} else {
+		/* Appending from a boot script may run more than once. */
+		if (history_load(path, &h))
+			goto out;
+		if (h.num_boots && same_boot(&h.boots[h.num_boots - 1],
+					     record)) {
+			history_free(&h);
+			ret = 0;
+			goto out;
+		}
+		/* Drop a record truncated by an earlier interrupted append. */
+		if ((long)h.valid_size < ftell(f) &&
+		    ftruncate(fileno(f), h.valid_size)) {
+			history_free(&h);
+			goto write_error;
+		}
+		history_free(&h);
+	}
+
+	if (fwrite(record, size, 1, f) != 1)
+		goto write_error;
+
+	ret = 0;
+	goto out;
+
+write_error:
+	fprintf(stderr, "Could not write to %s: %s\n", path, strerror(errno));
+out:
+	if (f && fclose(f) && !ret) {
+		fprintf(stderr, "Could not write to %s: %s\n", path,
+			strerror(errno));
+		ret = -1;
+	}
+	free(record);
+	return ret;
+}
+
+static void stage_add(struct stage *stage, size_t boot, uint64_t time)
+{
+	if (stage->count && stage->last_boot == boot) {
+		/* Stages recorded more than once per boot are summed up. */
+		stage->samples[stage->count - 1] += time;
+		return;
+	}
+
+	stage->samples[stage->count++] = time;
+	stage->last_boot = boot;
+}
+
+static struct stage *stage_find(const struct stage_set *set, uint32_t id)
+{
+	size_t i;
+
+	for (i = 0; i < set->num_stages; i++) {
+		if (set->stages[i].id == id)
+			return &set->stages[i];
+	}
+	return NULL;
+}
+
+/*
+ * Collect the time spent in each stage by all boots of a firmware version, or
+ * by all boots if version is NULL. The time of a stage is the time since the
+ * previous timestamp, as printed by cbmem -t.
+ */
+static void stages_collect(const struct history *h, const char *version,
+			   struct stage_set *set)
+{
+	size_t i, j;
+
+	memset(set, 0, sizeof(*set));
+	set->stages = xzalloc(0);
+	set->total.samples = xzalloc(h->num_boots * sizeof(uint64_t));
+
+	for (i = 0; i < h->num_boots; i++) {
+		const struct boot *boot = &h->boots[i];
+		uint32_t prev_time = 0;
+
+		if (version && strcmp(boot->version, version))
+			continue;
+
+		for (j = 0; j < boot->num_entries; j++) {
+			const struct history_entry *entry = &boot->entries[j];
+			struct stage *stage;
+
+			stage = stage_find(set, entry->id);
+			if (!stage) {
+				set->stages = xrealloc(set->stages,
+					(set->num_stages + 1) * sizeof(*stage));
+				stage = &set->stages[set->num_stages++];
+				memset(stage, 0, sizeof(*stage));
+				stage->id = entry->id;
+				stage->samples = xzalloc(h->num_boots *
+							 sizeof(uint64_t));
+			}
+
+			stage_add(stage, i, entry->time - prev_time);
+			prev_time = entry->time;
+		}
+
+		stage_add(&set->total, i, prev_time);
+		set->num_boots++;
+	}
+}
+
+static void stages_free(struct stage_set *set)
+{
+	size_t i;
+
+	for (i = 0; i < set->num_stages; i++)
+		free(set->stages[i].samples);
+	free(set->stages);
+	free(set->total.samples);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of sorted samples */
+static uint64_t percentile(const uint64_t *samples, size_t count,
+			   unsigned int p)
+{
+	size_t rank = (count * p + 99) / 100;
+
+	return samples[rank ? rank - 1 : 0];
+}
+
+static void stage_stats(struct stage *stage, struct stage_stats *stats)
+{
+	qsort(stage->samples, stage->count, sizeof(uint64_t), compare_u64);
+
+	stats->min = stage->samples[0];
+	stats->median = percentile(stage->samples, stage->count, 50);
+	stats->p95 = percentile(stage->samples, stage->count, 95);
+	stats->p99 = percentile(stage->samples, stage->count, 99);
+}
+
+/*
+ * A stage regressed if its median exceeds the baseline p95 by more than 5%,
+ * which keeps ordinary boot-to-boot noise from being flagged.
+ */
+static int stage_regressed(const struct stage_stats *stats,
+			   const struct stage_stats *baseline)
+{
+	return stats->median * 100 > baseline->p95 * 105;
+}
+
+/* Print the statistics of a stage. Returns 1 if it regressed. */
+static int print_stage(const char *label, struct stage *stage,
+		       struct stage *baseline)
+{
+	struct stage_stats stats, baseline_stats;
+	int regressed = 0;
+
+	if (!stage->count)
+		return 0;
+
+	stage_stats(stage, &stats);
+	printf("%-55s %5zu %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+	       " %10" PRIu64, label, stage->count, stats.min, stats.median,
+	       stats.p95, stats.p99);
+
+	if (baseline && baseline->count) {
+		stage_stats(baseline, &baseline_stats);
+		regressed = stage_regressed(&stats, &baseline_stats);
+		printf(" %10" PRIu64 "%s\n", baseline_stats.p95,
+		       regressed ? "  REGRESSED" : "");
+	} else {
+		printf(" %10s\n", "-");
+	}
+
+	return regressed;
+}
+
+static const char *version_name(const char *version)
+{
+	return *version ? version : "<unknown>";
+}
+
+int history_report(const char *path, const char *baseline_path)
+{
+	struct history h, baseline_h;
+	struct stage_set current, baseline;
+	const struct history *baseline_src = NULL;
+	const char *version, *baseline_version = NULL;
+	char label[64];
+	int regressed = 0;
+	size_t i;
+
+	if (history_load(path, &h))
+		return -1;
+
+	if (!h.num_boots) {
+		fprintf(stderr, "No boots recorded in %s.\n", path);
+		history_free(&h);
+		return -1;
+	}
+
+	/* Report on the firmware booted last. */
+	version = h.boots[h.num_boots - 1].version;
+
+	if (baseline_path) {
+		if (history_load(baseline_path, &baseline_h)) {
+			history_free(&h);
+			return -1;
+		}
+		baseline_src = &baseline_h;
+	} else {
+		for (i = h.num_boots; i-- > 0;) {
+			if (strcmp(h.boots[i].version, version)) {
+				baseline_version = h.boots[i].version;
+				baseline_src = &h;
+				break;
+			}
+		}
+	}
+
+	stages_collect(&h, version, &current);
+	if (baseline_src)
+		stages_collect(baseline_src, baseline_version, &baseline);
+
+	printf("Boot time history of %zu boots in %s\n\n", h.num_boots, path);
+	printf("Firmware: %s (%zu boot%s)\n", version_name(version),
+	       current.num_boots, current.num_boots == 1 ? "" : "s");
+	if (baseline_path)
+		printf("Baseline: %s (%zu boot%s)\n", baseline_path,
+		       baseline.num_boots, baseline.num_boots == 1 ? "" : "s");
+	else if (baseline_version)
+		printf("Baseline: %s (%zu boot%s)\n",
+		       version_name(baseline_version), baseline.num_boots,
+		       baseline.num_boots == 1 ? "" : "s");
+	else
+		printf("Baseline: none, no boots of other firmware versions\n");
+
+	printf("\nTimes in microseconds. A stage regressed if its median is "
+	       "more than 5%% above the baseline p95.\n\n");
+	printf("%-55s %5s %10s %10s %10s %10s %10s\n", "  ID:NAME", "BOOTS",
+	       "MIN", "MEDIAN", "P95", "P99", "BASE P95");
+
+	for (i = 0; i < current.num_stages; i++) {
+		struct stage *stage = &current.stages[i];
+
+		snprintf(label, sizeof(label), "%4u:%s", stage->id,
+			 cbmem_timestamp_name(stage->id));
+		regressed += print_stage(label, stage, baseline_src ?
+					 stage_find(&baseline, stage->id) :
+					 NULL);
+	}
+	regressed += print_stage("     Total Time", &current.total,
+				 baseline_src ? &baseline.total : NULL);
+
+	if (baseline_src)
+		printf("\n%d stage%s regressed.\n", regressed,
+		       regressed == 1 ? "" : "s");
+
+	stages_free(&current);
+	if (baseline_src)
+		stages_free(&baseline);
+	if (baseline_path)
+		history_free(&baseline_h);
+	history_free(&h);
+
+	return regressed;
+}
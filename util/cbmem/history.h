@@ -0,0 +1,35 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef CBMEM_HISTORY_H
+#define CBMEM_HISTORY_H
+
+#include <commonlib/timestamp_serialized.h>
+
+/*
+ * Append the timestamps of the current boot to a history file, unless they
+ * are already its last record. Returns 0 on success.
+ */
+int history_append(const char *path, const char *version,
+		   const struct timestamp_table *tst,
+		   unsigned long tick_freq_mhz);
+
+/*
+ * Print per-stage statistics of the boots in a history file for the firmware
+ * version booted last, and compare them to a baseline: the boots in
+ * baseline_path if given, or else the boots of the previous firmware version
+ * in path. Returns < 0 on error, otherwise the number of regressed stages.
+ */
+int history_report(const char *path, const char *baseline_path);
+
+#endif /* CBMEM_HISTORY_H */
@@ -0,0 +1,1067 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <commonlib/cbmem_id.h>
+#include <commonlib/coreboot_tables.h>
+
+#ifdef __OpenBSD__
+#include <sys/param.h>
+#include <sys/sysctl.h>
+#endif
+
+#include "libcbmem.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+struct mapping {
+	void *virt;
+	size_t offset;
+	size_t virt_size;
+	unsigned long long phys;
+	size_t size;
+};
+
+/* Mapping of memory outside the CBMEM area, kept until cbmem_close(). */
+struct extra_mapping {
+	struct mapping mapping;
+	struct extra_mapping *next;
+};
+
+struct cbmem_ctx {
+	/* File handle used to access /dev/mem */
+	int mem_fd;
+	struct mapping lbtable_mapping;
+	/* The whole CBMEM area, if it could be mapped */
+	struct mapping area_mapping;
+	struct extra_mapping *extra_mappings;
+
+	struct lb_cbmem_ref timestamps;
+	struct lb_cbmem_ref console;
+	struct lb_cbmem_ref tcpa_log;
+	struct lb_memory_range cbmem;
+
+	char version[64];
+	char extra_version[64];
+	char full_version[128];
+};
+
+struct cbmem_console {
+	u32 size;
+	u32 cursor;
+	u8  body[0];
+}  __attribute__ ((__packed__));
+
+#define CBMC_CURSOR_MASK ((1 << 28) - 1)
+#define CBMC_OVERFLOW (1 << 31)
+
+/* verbose output? */
+static int verbose = 0;
+#define debug(x...) if(verbose) printf(x)
+
+/* Return < 0 on error, 0 on success. */
+static int parse_cbtable(struct cbmem_ctx *ctx, u64 address,
+			 size_t table_size);
+
+static unsigned long long system_page_size(void)
+{
+	static unsigned long long page_size;
+
+	if (!page_size)
+		page_size = getpagesize();
+
+	return page_size;
+}
+
+static inline size_t size_to_mib(size_t sz)
+{
+	return sz >> 20;
+}
+
+/* Return mapping of physical address requested. */
+static const void *mapping_virt(const struct mapping *mapping)
+{
+	const char *v = mapping->virt;
+
+	if (v == NULL)
+		return NULL;
+
+	return v + mapping->offset;
+}
+
+/* Returns virtual address on success, NULL on error. mapping is filled in. */
+static const void *map_memory(struct cbmem_ctx *ctx, struct mapping *mapping,
+			      unsigned long long phys, size_t sz)
+{
+	void *v;
+	unsigned long long page_size;
+
+	page_size = system_page_size();
+
+	mapping->virt = NULL;
+	mapping->offset = phys % page_size;
+	mapping->virt_size = sz + mapping->offset;
+	mapping->size = sz;
+	mapping->phys = phys;
+
+	if (size_to_mib(mapping->virt_size) == 0) {
+		debug("Mapping %zuB of physical memory at 0x%llx (requested 0x%llx).\n",
+			mapping->virt_size, phys - mapping->offset, phys);
+	} else {
+		debug("Mapping %zuMB of physical memory at 0x%llx (requested 0x%llx).\n",
+			size_to_mib(mapping->virt_size), phys - mapping->offset,
+			phys);
+	}
+
+	v = mmap(NULL, mapping->virt_size, PROT_READ, MAP_SHARED, ctx->mem_fd,
+			phys - mapping->offset);
+
+	if (v == MAP_FAILED) {
+		debug("Mapping failed %zuB of physical memory at 0x%llx.\n",
+			mapping->virt_size, phys - mapping->offset);
+		return NULL;
+	}
+
+	mapping->virt = v;
+
+	if (mapping->offset != 0)
+		debug("  ... padding virtual address with 0x%zx bytes.\n",
+			mapping->offset);
+
+	return mapping_virt(mapping);
+}
+
+/* Returns 0 on success, < 0 on error. mapping is cleared if successful. */
+static int unmap_memory(struct mapping *mapping)
+{
+	if (mapping->virt == NULL)
+		return -1;
+
+	munmap(mapping->virt, mapping->virt_size);
+	mapping->virt = NULL;
+	mapping->offset = 0;
+	mapping->virt_size = 0;
+
+	return 0;
+}
+
+/* Return size of physical address mapping requested. */
+static size_t mapping_size(const struct mapping *mapping)
+{
+	if (mapping->virt == NULL)
+		return 0;
+
+	return mapping->size;
+}
+
+/* Returns the part of mapping covering [phys, phys + size), or NULL. */
+static const void *mapping_lookup(const struct mapping *mapping, u64 phys,
+				  size_t size)
+{
+	const u8 *v = mapping_virt(mapping);
+
+	if (v == NULL || phys < mapping->phys || size > mapping->size ||
+	    phys - mapping->phys > mapping->size - size)
+		return NULL;
+
+	return v + (phys - mapping->phys);
+}
+
+const void *cbmem_map(struct cbmem_ctx *ctx, uint64_t phys, size_t size)
+{
+	struct extra_mapping *extra;
+	const void *v;
+
+	v = mapping_lookup(&ctx->area_mapping, phys, size);
+	if (v)
+		return v;
+
+	for (extra = ctx->extra_mappings; extra; extra = extra->next) {
+		v = mapping_lookup(&extra->mapping, phys, size);
+		if (v)
+			return v;
+	}
+
+	extra = calloc(1, sizeof(*extra));
+	if (!extra)
+		return NULL;
+	v = map_memory(ctx, &extra->mapping, phys, size);
+	if (!v) {
+		free(extra);
+		return NULL;
+	}
+	extra->next = ctx->extra_mappings;
+	ctx->extra_mappings = extra;
+	return v;
+}
+
+/*
+ * Some architectures map /dev/mem memory in a way that doesn't support
+ * unaligned accesses. Most normal libc memcpy()s aren't safe to use in this
+ * case, so build our own which makes sure to never do unaligned accesses on
+ * *src (*dest is fine since we never map /dev/mem for writing).
+ */
+void *cbmem_memcpy(void *dest, const void *src, size_t n)
+{
+	u8 *d = dest;
+	const volatile u8 *s = src;	/* volatile to prevent optimization */
+
+	while ((uintptr_t)s & (sizeof(size_t) - 1)) {
+		if (n-- == 0)
+			return dest;
+		*d++ = *s++;
+	}
+
+	while (n >= sizeof(size_t)) {
+		*(size_t *)d = *(const volatile size_t *)s;
+		d += sizeof(size_t);
+		s += sizeof(size_t);
+		n -= sizeof(size_t);
+	}
+
+	while (n-- > 0)
+		*d++ = *s++;
+
+	return dest;
+}
+
+/*
+ * calculate ip checksum (16 bit quantities) on a passed in buffer. In case
+ * the buffer length is odd last byte is excluded from the calculation
+ */
+static u16 ipchcksum(const void *addr, unsigned size)
+{
+	const u16 *p = addr;
+	unsigned i, n = size / 2; /* don't expect odd sized blocks */
+	u32 sum = 0;
+
+	for (i = 0; i < n; i++)
+		sum += p[i];
+
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+	sum = ~sum & 0xffff;
+	return (u16) sum;
+}
+
+int cbmem_walk_entries(struct cbmem_ctx *ctx, cbmem_entry_callback callback,
+		       void *arg)
+{
+	const uint8_t *table;
+	size_t offset;
+	int count = 0;
+
+	table = mapping_virt(&ctx->lbtable_mapping);
+
+	if (table == NULL)
+		return 0;
+
+	offset = 0;
+
+	while (offset < mapping_size(&ctx->lbtable_mapping)) {
+		const struct lb_record *lbr;
+		const struct lb_cbmem_entry *lbe;
+
+		lbr = (const void *)(table + offset);
+		offset += lbr->size;
+
+		if (lbr->tag != LB_TAG_CBMEM_ENTRY)
+			continue;
+
+		lbe = (const void *)lbr;
+		count++;
+		if (callback(lbe->id, lbe->address, lbe->entry_size, arg))
+			break;
+	}
+
+	return count;
+}
+
+struct find_entry_arg {
+	uint32_t id;
+	uint64_t addr;
+	uint64_t size;
+	int found;
+};
+
+static int find_entry(uint32_t id, uint64_t address, uint64_t size, void *arg)
+{
+	struct find_entry_arg *find = arg;
+
+	if (id != find->id)
+		return 0;
+
+	find->addr = address;
+	find->size = size;
+	find->found = 1;
+	return 1;
+}
+
+/* Find the first cbmem entry filling in the details. */
+int cbmem_find_entry(struct cbmem_ctx *ctx, uint32_t id, uint64_t *addr,
+		     uint64_t *size)
+{
+	struct find_entry_arg find = { .id = id };
+
+	cbmem_walk_entries(ctx, find_entry, &find);
+	if (!find.found)
+		return -1;
+
+	*addr = find.addr;
+	*size = find.size;
+	return 0;
+}
+
+int cbmem_get_area(struct cbmem_ctx *ctx, uint64_t *start, uint64_t *size)
+{
+	if (ctx->cbmem.type != LB_MEM_TABLE)
+		return -1;
+
+	*start = unpack_lb64(ctx->cbmem.start);
+	*size = unpack_lb64(ctx->cbmem.size);
+	return 0;
+}
+
+const char *cbmem_get_version(struct cbmem_ctx *ctx)
+{
+	snprintf(ctx->full_version, sizeof(ctx->full_version), "%s%s",
+		 ctx->version, ctx->extra_version);
+	return ctx->full_version;
+}
+
+struct cbmem_id_to_name {
+	uint32_t id;
+	const char *name;
+};
+static const struct cbmem_id_to_name cbmem_ids[] = { CBMEM_ID_TO_NAME_TABLE };
+
+#define MAX_STAGEx 10
+const char *cbmem_entry_name(uint32_t id, char *buf, size_t len)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(cbmem_ids); i++) {
+		if (cbmem_ids[i].id == id)
+			return cbmem_ids[i].name;
+	}
+
+	if (id >= CBMEM_ID_STAGEx_META &&
+		id < CBMEM_ID_STAGEx_META + MAX_STAGEx) {
+		snprintf(buf, len, "STAGE%d META",
+			(id - CBMEM_ID_STAGEx_META));
+		return buf;
+	}
+	if (id >= CBMEM_ID_STAGEx_CACHE &&
+		id < CBMEM_ID_STAGEx_CACHE + MAX_STAGEx) {
+		snprintf(buf, len, "STAGE%d $  ",
+			(id - CBMEM_ID_STAGEx_CACHE));
+		return buf;
+	}
+
+	return NULL;
+}
+
+/* This is a work-around for a nasty problem introduced by initially having
+ * pointer sized entries in the lb_cbmem_ref structures. This caused problems
+ * on 64bit x86 systems because coreboot is 32bit on those systems.
+ * When the problem was found, it was corrected, but there are a lot of
+ * systems out there with a firmware that does not produce the right
+ * lb_cbmem_ref structure. Hence we try to autocorrect this issue here.
+ */
+static struct lb_cbmem_ref parse_cbmem_ref(const struct lb_cbmem_ref *cbmem_ref)
+{
+	struct lb_cbmem_ref ret;
+
+	cbmem_memcpy(&ret, cbmem_ref, sizeof(ret));
+
+	if (cbmem_ref->size < sizeof(*cbmem_ref))
+		ret.cbmem_addr = (uint32_t)ret.cbmem_addr;
+
+	debug("      cbmem_addr = %" PRIx64 "\n", ret.cbmem_addr);
+
+	return ret;
+}
+
+static void parse_memory_tags(struct cbmem_ctx *ctx,
+			      const struct lb_memory *mem)
+{
+	int num_entries;
+	int i;
+
+	/* Peel off the header size and calculate the number of entries. */
+	num_entries = (mem->size - sizeof(*mem)) / sizeof(mem->map[0]);
+
+	for (i = 0; i < num_entries; i++) {
+		if (mem->map[i].type != LB_MEM_TABLE)
+			continue;
+		debug("      LB_MEM_TABLE found.\n");
+		/* The last one found is CBMEM */
+		cbmem_memcpy(&ctx->cbmem, &mem->map[i], sizeof(ctx->cbmem));
+	}
+}
+
+static void parse_string(char *dest, size_t len, const struct lb_string *str)
+{
+	size_t size = 0;
+
+	if (str->size > sizeof(*str))
+		size = str->size - sizeof(*str);
+	if (size >= len)
+		size = len - 1;
+
+	cbmem_memcpy(dest, str->string, size);
+	dest[size] = '\0';
+}
+
+/* Return < 0 on error, 0 on success, 1 if forwarding table entry found. */
+static int parse_cbtable_entries(struct cbmem_ctx *ctx,
+				 const struct mapping *table_mapping)
+{
+	size_t i;
+	const struct lb_record *lbr_p;
+	size_t table_size = mapping_size(table_mapping);
+	const void *lbtable = mapping_virt(table_mapping);
+	int forwarding_table_found = 0;
+
+	for (i = 0; i < table_size; i += lbr_p->size) {
+		lbr_p = lbtable + i;
+		debug("  coreboot table entry 0x%02x\n", lbr_p->tag);
+		switch (lbr_p->tag) {
+		case LB_TAG_MEMORY:
+			debug("    Found memory map.\n");
+			parse_memory_tags(ctx, lbtable + i);
+			continue;
+		case LB_TAG_VERSION:
+			parse_string(ctx->version, sizeof(ctx->version),
+				     lbtable + i);
+			continue;
+		case LB_TAG_EXTRA_VERSION:
+			parse_string(ctx->extra_version,
+				     sizeof(ctx->extra_version), lbtable + i);
+			continue;
+		case LB_TAG_TIMESTAMPS: {
+			debug("    Found timestamp table.\n");
+			ctx->timestamps =
+			    parse_cbmem_ref((struct lb_cbmem_ref *)lbr_p);
+			continue;
+		}
+		case LB_TAG_CBMEM_CONSOLE: {
+			debug("    Found cbmem console.\n");
+			ctx->console =
+			    parse_cbmem_ref((struct lb_cbmem_ref *)lbr_p);
+			continue;
+		}
+		case LB_TAG_TCPA_LOG: {
+			debug("    Found tcpa log table.\n");
+			ctx->tcpa_log =
+			    parse_cbmem_ref((struct lb_cbmem_ref *)lbr_p);
+			continue;
+		}
+		case LB_TAG_FORWARD: {
+			int ret;
+			/*
+			 * This is a forwarding entry - repeat the
+			 * search at the new address.
+			 */
+			struct lb_forward lbf_p =
+			    *(const struct lb_forward *)lbr_p;
+			debug("    Found forwarding entry.\n");
+			ret = parse_cbtable(ctx, lbf_p.forward, 0);
+
+			/* Assume the forwarding entry is valid. If this fails
+			 * then there's a total failure. */
+			if (ret < 0)
+				return -1;
+			forwarding_table_found = 1;
+		}
+		default:
+			break;
+		}
+	}
+
+	return forwarding_table_found;
+}
+
+/* Return < 0 on error, 0 on success. */
+static int parse_cbtable(struct cbmem_ctx *ctx, u64 address,
+			 size_t table_size)
+{
+	const void *buf;
+	struct mapping header_mapping;
+	size_t req_size;
+	size_t i;
+
+	req_size = table_size;
+	/* Default to 4 KiB search space. */
+	if (req_size == 0)
+		req_size = 4 * 1024;
+
+	debug("Looking for coreboot table at %" PRIx64 " %zd bytes.\n",
+		address, req_size);
+
+	buf = map_memory(ctx, &header_mapping, address, req_size);
+
+	if (!buf)
+		return -1;
+
+	/* look at every 16 bytes */
+	for (i = 0; i <= req_size - sizeof(struct lb_header); i += 16) {
+		int ret;
+		const struct lb_header *lbh;
+		struct mapping table_mapping;
+
+		lbh = buf + i;
+		if (memcmp(lbh->signature, "LBIO", sizeof(lbh->signature)) ||
+		    !lbh->header_bytes ||
+		    ipchcksum(lbh, sizeof(*lbh))) {
+			continue;
+		}
+
+		/* Map in the whole table to parse. */
+		if (!map_memory(ctx, &table_mapping,
+				address + i + lbh->header_bytes,
+				lbh->table_bytes)) {
+			debug("Couldn't map in table\n");
+			continue;
+		}
+
+		if (ipchcksum(mapping_virt(&table_mapping), lbh->table_bytes) !=
+		    lbh->table_checksum) {
+			debug("Signature found, but wrong checksum.\n");
+			unmap_memory(&table_mapping);
+			continue;
+		}
+
+		debug("Found!\n");
+
+		ret = parse_cbtable_entries(ctx, &table_mapping);
+
+		/* Table parsing failed. */
+		if (ret < 0) {
+			unmap_memory(&table_mapping);
+			continue;
+		}
+
+		/* Succeeded in parsing the table. Header not needed anymore. */
+		unmap_memory(&header_mapping);
+
+		/*
+		 * Table parsing succeeded. If forwarding table not found update
+		 * coreboot table mapping for future use.
+		 */
+		if (ret == 0)
+			ctx->lbtable_mapping = table_mapping;
+		else
+			unmap_memory(&table_mapping);
+
+		return 0;
+	}
+
+	unmap_memory(&header_mapping);
+
+	return -1;
+}
+
+#if defined(__arm__) || defined(__aarch64__)
+static void dt_update_cells(const char *name, int *addr_cells_ptr,
+			    int *size_cells_ptr)
+{
+	if (*addr_cells_ptr >= 0 && *size_cells_ptr >= 0)
+		return;
+
+	int buffer;
+	size_t nlen = strlen(name);
+	char *prop = alloca(nlen + sizeof("/#address-cells"));
+	strcpy(prop, name);
+
+	if (*addr_cells_ptr < 0) {
+		strcpy(prop + nlen, "/#address-cells");
+		int fd = open(prop, O_RDONLY);
+		if (fd < 0 && errno != ENOENT) {
+			perror(prop);
+		} else if (fd >= 0) {
+			if (read(fd, &buffer, sizeof(int)) < 0)
+				perror(prop);
+			else
+				*addr_cells_ptr = ntohl(buffer);
+			close(fd);
+		}
+	}
+
+	if (*size_cells_ptr < 0) {
+		strcpy(prop + nlen, "/#size-cells");
+		int fd = open(prop, O_RDONLY);
+		if (fd < 0 && errno != ENOENT) {
+			perror(prop);
+		} else if (fd >= 0) {
+			if (read(fd, &buffer, sizeof(int)) < 0)
+				perror(prop);
+			else
+				*size_cells_ptr = ntohl(buffer);
+			close(fd);
+		}
+	}
+}
+
+static char *dt_find_compat(const char *parent, const char *compat,
+			    int *addr_cells_ptr, int *size_cells_ptr)
+{
+	char *ret = NULL;
+	struct dirent *entry;
+	DIR *dir;
+
+	if (!(dir = opendir(parent))) {
+		perror(parent);
+		return NULL;
+	}
+
+	/* Loop through all files in the directory (DT node). */
+	while ((entry = readdir(dir))) {
+		/* We only care about compatible props or subnodes. */
+		if (entry->d_name[0] == '.' || !((entry->d_type & DT_DIR) ||
+		    !strcmp(entry->d_name, "compatible")))
+			continue;
+
+		/* Assemble the file name (on the stack, for speed). */
+		size_t plen = strlen(parent);
+		char *name = alloca(plen + strlen(entry->d_name) + 2);
+
+		strcpy(name, parent);
+		name[plen] = '/';
+		strcpy(name + plen + 1, entry->d_name);
+
+		/* If it's a subnode, recurse. */
+		if (entry->d_type & DT_DIR) {
+			ret = dt_find_compat(name, compat, addr_cells_ptr,
+					     size_cells_ptr);
+
+			/* There is only one matching node to find, abort. */
+			if (ret) {
+				/* Gather cells values on the way up. */
+				dt_update_cells(parent, addr_cells_ptr,
+						size_cells_ptr);
+				break;
+			}
+			continue;
+		}
+
+		/* If it's a compatible string, see if it's the right one. */
+		int fd = open(name, O_RDONLY);
+		int clen = strlen(compat);
+		char *buffer = alloca(clen + 1);
+
+		if (fd < 0) {
+			perror(name);
+			continue;
+		}
+
+		if (read(fd, buffer, clen + 1) < 0) {
+			perror(name);
+			close(fd);
+			continue;
+		}
+		close(fd);
+
+		if (!strcmp(compat, buffer)) {
+			/* Initialize these to "unset" for the way up. */
+			*addr_cells_ptr = *size_cells_ptr = -1;
+
+			/* Can't leave string on the stack or we'll lose it! */
+			ret = strdup(parent);
+			break;
+		}
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/* Return < 0 on error, 0 on success. */
+static int find_cbtable(struct cbmem_ctx *ctx)
+{
+	int addr_cells, size_cells;
+	char *coreboot_node = dt_find_compat("/proc/device-tree", "coreboot",
+					     &addr_cells, &size_cells);
+
+	if (!coreboot_node) {
+		fprintf(stderr, "Could not find 'coreboot' compatible node!\n");
+		return -1;
+	}
+
+	if (addr_cells < 0) {
+		fprintf(stderr, "Warning: no #address-cells node in tree!\n");
+		addr_cells = 1;
+	}
+
+	int nlen = strlen(coreboot_node);
+	char *reg = alloca(nlen + sizeof("/reg"));
+
+	strcpy(reg, coreboot_node);
+	strcpy(reg + nlen, "/reg");
+	free(coreboot_node);
+
+	int fd = open(reg, O_RDONLY);
+	if (fd < 0) {
+		perror(reg);
+		return -1;
+	}
+
+	int i;
+	size_t size_to_read = addr_cells * 4 + size_cells * 4;
+	u8 *dtbuffer = alloca(size_to_read);
+	if (read(fd, dtbuffer, size_to_read) < 0) {
+		perror(reg);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	/* No variable-length byte swap function anywhere in C... how sad. */
+	u64 baseaddr = 0;
+	for (i = 0; i < addr_cells * 4; i++) {
+		baseaddr <<= 8;
+		baseaddr |= *dtbuffer;
+		dtbuffer++;
+	}
+	u64 cb_table_size = 0;
+	for (i = 0; i < size_cells * 4; i++) {
+		cb_table_size <<= 8;
+		cb_table_size |= *dtbuffer;
+		dtbuffer++;
+	}
+
+	return parse_cbtable(ctx, baseaddr, cb_table_size);
+}
+#else
+/* Return < 0 on error, 0 on success. */
+static int find_cbtable(struct cbmem_ctx *ctx)
+{
+	int j;
+	unsigned long long possible_base_addresses[] = { 0, 0xf0000 };
+
+	/* Find and parse coreboot table */
+	for (j = 0; j < ARRAY_SIZE(possible_base_addresses); j++) {
+		if (!parse_cbtable(ctx, possible_base_addresses[j], 0))
+			return 0;
+	}
+
+	return -1;
+}
+#endif /* defined(__arm__) || defined(__aarch64__) */
+
+struct cbmem_ctx *cbmem_open(int verbose_output)
+{
+	struct cbmem_ctx *ctx;
+	uint64_t start, size;
+
+	verbose = verbose_output;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		fprintf(stderr, "Not enough memory for cbmem context.\n");
+		return NULL;
+	}
+
+	ctx->mem_fd = open("/dev/mem", O_RDONLY, 0);
+	if (ctx->mem_fd < 0) {
+		fprintf(stderr, "Failed to gain memory access: %s\n",
+			strerror(errno));
+		free(ctx);
+		return NULL;
+	}
+
+	find_cbtable(ctx);
+	if (mapping_virt(&ctx->lbtable_mapping) == NULL) {
+		fprintf(stderr, "Table not found.\n");
+		cbmem_close(ctx);
+		return NULL;
+	}
+
+	/* Map all of CBMEM once instead of mapping each object on its own.
+	   If that fails, cbmem_map() still maps objects individually. */
+	if (!cbmem_get_area(ctx, &start, &size) && size)
+		map_memory(ctx, &ctx->area_mapping, start, size);
+
+	return ctx;
+}
+
+void cbmem_close(struct cbmem_ctx *ctx)
+{
+	struct extra_mapping *extra;
+
+	if (!ctx)
+		return;
+
+	while ((extra = ctx->extra_mappings)) {
+		ctx->extra_mappings = extra->next;
+		unmap_memory(&extra->mapping);
+		free(extra);
+	}
+	unmap_memory(&ctx->area_mapping);
+	unmap_memory(&ctx->lbtable_mapping);
+	close(ctx->mem_fd);
+	free(ctx);
+}
+
+#if defined(linux) && (defined(__i386__) || defined(__x86_64__))
+/*
+ * read CPU frequency from a sysfs file, return an frequency in Megahertz as
+ * an int or 0 on any error.
+ */
+static unsigned long arch_tick_frequency(void)
+{
+	FILE *cpuf;
+	char freqs[100];
+	int  size;
+	char *endp;
+	u64 rv;
+
+	const char* freq_file =
+		"/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq";
+
+	cpuf = fopen(freq_file, "r");
+	if (!cpuf) {
+		fprintf(stderr, "Could not open %s: %s\n",
+			freq_file, strerror(errno));
+		return 0;
+	}
+
+	memset(freqs, 0, sizeof(freqs));
+	size = fread(freqs, 1, sizeof(freqs), cpuf);
+	fclose(cpuf);
+	if (!size || (size == sizeof(freqs))) {
+		fprintf(stderr, "Wrong number of bytes(%d) read from %s\n",
+			size, freq_file);
+		return 0;
+	}
+	rv = strtoull(freqs, &endp, 10);
+
+	if (*endp == '\0' || *endp == '\n')
+	/* cpuinfo_max_freq is in kHz. Convert it to MHz. */
+		return rv / 1000;
+	fprintf(stderr, "Wrong formatted value ^%s^ read from %s\n",
+		freqs, freq_file);
+	return 0;
+}
+#elif defined(__OpenBSD__) && (defined(__i386__) || defined(__x86_64__))
+static unsigned long arch_tick_frequency(void)
+{
+	int mib[2] = { CTL_HW, HW_CPUSPEED };
+	static int value = 0;
+	size_t value_len = sizeof(value);
+
+	/* Return 1 MHz when sysctl fails. */
+	if ((value == 0) && (sysctl(mib, 2, &value, &value_len, NULL, 0) == -1))
+		return 1;
+
+	return value;
+}
+#else
+static unsigned long arch_tick_frequency(void)
+{
+	/* 1 MHz = 1us. */
+	return 1;
+}
+#endif
+
+unsigned long cbmem_timestamp_tick_freq(const struct timestamp_table *tst)
+{
+	/* Honor table frequency if present. */
+	if (tst->tick_freq_mhz)
+		return tst->tick_freq_mhz;
+
+	return arch_tick_frequency();
+}
+
+const char *cbmem_timestamp_name(uint32_t id)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(timestamp_ids); i++) {
+		if (timestamp_ids[i].id == id)
+			return timestamp_ids[i].name;
+	}
+	return "<unknown>";
+}
+
+static int compare_timestamp_entries(const void *a, const void *b)
+{
+	const struct timestamp_entry *tse_a = (struct timestamp_entry *)a;
+	const struct timestamp_entry *tse_b = (struct timestamp_entry *)b;
+
+	if (tse_a->entry_stamp > tse_b->entry_stamp)
+		return 1;
+	else if (tse_a->entry_stamp < tse_b->entry_stamp)
+		return -1;
+
+	return 0;
+}
+
+struct timestamp_table *cbmem_get_timestamps(struct cbmem_ctx *ctx)
+{
+	const struct timestamp_table *tst_p;
+	struct timestamp_table *sorted_tst_p;
+	size_t size;
+
+	if (ctx->timestamps.tag != LB_TAG_TIMESTAMPS) {
+		fprintf(stderr, "No timestamps found in coreboot table.\n");
+		return NULL;
+	}
+
+	size = sizeof(*tst_p);
+	tst_p = cbmem_map(ctx, ctx->timestamps.cbmem_addr, size);
+	if (!tst_p) {
+		fprintf(stderr, "Unable to map timestamp header\n");
+		return NULL;
+	}
+
+	size += tst_p->num_entries * sizeof(tst_p->entries[0]);
+	tst_p = cbmem_map(ctx, ctx->timestamps.cbmem_addr, size);
+	if (!tst_p) {
+		fprintf(stderr, "Unable to map full timestamp table\n");
+		return NULL;
+	}
+
+	sorted_tst_p = malloc(size);
+	if (!sorted_tst_p) {
+		fprintf(stderr, "Failed to allocate memory");
+		return NULL;
+	}
+	cbmem_memcpy(sorted_tst_p, tst_p, size);
+
+	qsort(&sorted_tst_p->entries[0], sorted_tst_p->num_entries,
+	      sizeof(struct timestamp_entry), compare_timestamp_entries);
+
+	return sorted_tst_p;
+}
+
+struct tcpa_table *cbmem_get_tcpa_log(struct cbmem_ctx *ctx)
+{
+	const struct tcpa_table *tclt_p;
+	struct tcpa_table *copy;
+	size_t size;
+
+	if (ctx->tcpa_log.tag != LB_TAG_TCPA_LOG) {
+		fprintf(stderr, "No tcpa log found in coreboot table.\n");
+		return NULL;
+	}
+
+	size = sizeof(*tclt_p);
+	tclt_p = cbmem_map(ctx, ctx->tcpa_log.cbmem_addr, size);
+	if (!tclt_p) {
+		fprintf(stderr, "Unable to map tcpa log header\n");
+		return NULL;
+	}
+
+	size += tclt_p->num_entries * sizeof(tclt_p->entries[0]);
+	tclt_p = cbmem_map(ctx, ctx->tcpa_log.cbmem_addr, size);
+	if (!tclt_p) {
+		fprintf(stderr, "Unable to map full tcpa log table\n");
+		return NULL;
+	}
+
+	copy = malloc(size);
+	if (!copy) {
+		fprintf(stderr, "Failed to allocate memory");
+		return NULL;
+	}
+	return cbmem_memcpy(copy, tclt_p, size);
+}
+
+char *cbmem_get_console(struct cbmem_ctx *ctx, struct cbmem_console_info *info)
+{
+	const struct cbmem_console *console_p;
+	struct cbmem_console_info dummy;
+	char *console_c;
+	size_t size, cursor;
+
+	if (!info)
+		info = &dummy;
+	memset(info, 0, sizeof(*info));
+
+	if (ctx->console.tag != LB_TAG_CBMEM_CONSOLE) {
+		fprintf(stderr, "No console found in coreboot table.\n");
+		return NULL;
+	}
+
+	console_p = cbmem_map(ctx, ctx->console.cbmem_addr,
+			      sizeof(*console_p));
+	if (!console_p) {
+		fprintf(stderr, "Unable to map console object.\n");
+		return NULL;
+	}
+
+	cursor = console_p->cursor & CBMC_CURSOR_MASK;
+	if (!(console_p->cursor & CBMC_OVERFLOW) && cursor < console_p->size)
+		size = cursor;
+	else
+		size = console_p->size;
+
+	info->address = ctx->console.cbmem_addr;
+	info->size = console_p->size;
+	info->used = size;
+	info->overflow = !!(console_p->cursor & CBMC_OVERFLOW);
+
+	console_c = malloc(size + 1);
+	if (!console_c) {
+		fprintf(stderr, "Not enough memory for console.\n");
+		return NULL;
+	}
+	console_c[size] = '\0';
+
+	console_p = cbmem_map(ctx, ctx->console.cbmem_addr,
+			      size + sizeof(*console_p));
+	if (!console_p) {
+		fprintf(stderr, "Unable to map full console object.\n");
+		free(console_c);
+		return NULL;
+	}
+
+	if (console_p->cursor & CBMC_OVERFLOW) {
+		if (cursor >= size) {
+			info->corrupt = 1;
+			cursor = 0;
+		}
+		cbmem_memcpy(console_c, console_p->body + cursor,
+			     size - cursor);
+		cbmem_memcpy(console_c + size - cursor,
+			     console_p->body, cursor);
+	} else {
+		cbmem_memcpy(console_c, console_p->body, size);
+	}
+
+	/* Slight memory corruption may occur between reboots and give us a few
+	   unprintable characters like '\0'. Replace them with '?' on output. */
+	for (cursor = 0; cursor < size; cursor++)
+		if (!isprint(console_c[cursor]) && !isspace(console_c[cursor]))
+			console_c[cursor] = '?';
+
+	return console_c;
+}
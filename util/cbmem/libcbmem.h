@@ -0,0 +1,95 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef LIBCBMEM_H
+#define LIBCBMEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <commonlib/timestamp_serialized.h>
+#include <commonlib/tcpa_log_serialized.h>
+
+/*
+ * Access to the coreboot tables and CBMEM of the running system through
+ * /dev/mem. The CBMEM area is mapped once when the context is opened and
+ * every object inside it is accessed through that mapping. Errors are
+ * reported on stderr.
+ */
+struct cbmem_ctx;
+
+/* Finds and parses the coreboot table. Returns NULL on error. */
+struct cbmem_ctx *cbmem_open(int verbose);
+
+/* Releases all mappings of ctx and ctx itself. */
+void cbmem_close(struct cbmem_ctx *ctx);
+
+/* Returns a read-only view of physical memory [phys, phys + size), or NULL.
+ * The view stays valid until cbmem_close(). Some architectures don't allow
+ * unaligned accesses to it, so copy data out with cbmem_memcpy(). */
+const void *cbmem_map(struct cbmem_ctx *ctx, uint64_t phys, size_t size);
+
+/* memcpy() that never makes unaligned accesses to src. */
+void *cbmem_memcpy(void *dest, const void *src, size_t n);
+
+/* Gets the location of the CBMEM area. Returns 0 on success, < 0 if the
+ * coreboot table doesn't describe one. */
+int cbmem_get_area(struct cbmem_ctx *ctx, uint64_t *start, uint64_t *size);
+
+/* Returns the coreboot version and extra version from the coreboot table,
+ * or an empty string. */
+const char *cbmem_get_version(struct cbmem_ctx *ctx);
+
+/* Callback for cbmem_walk_entries(). Returns non-zero to stop the walk. */
+typedef int (*cbmem_entry_callback)(uint32_t id, uint64_t address,
+				    uint64_t size, void *arg);
+
+/* Calls callback for every CBMEM entry listed in the coreboot table, in
+ * table order. Returns the number of entries visited. */
+int cbmem_walk_entries(struct cbmem_ctx *ctx, cbmem_entry_callback callback,
+		       void *arg);
+
+/* Finds the first CBMEM entry with given id. Returns 0 on success. */
+int cbmem_find_entry(struct cbmem_ctx *ctx, uint32_t id, uint64_t *addr,
+		     uint64_t *size);
+
+/* Returns the name of a CBMEM id, formatted into buf if necessary, or NULL
+ * if the id is unknown. */
+const char *cbmem_entry_name(uint32_t id, char *buf, size_t len);
+
+/* Returns a copy of the timestamp table with its entries sorted by time, or
+ * NULL. The caller frees it. */
+struct timestamp_table *cbmem_get_timestamps(struct cbmem_ctx *ctx);
+
+/* Returns the timestamp tick frequency in MHz, or 0 if it is unknown. */
+unsigned long cbmem_timestamp_tick_freq(const struct timestamp_table *tst);
+
+/* Returns the name of a timestamp id. */
+const char *cbmem_timestamp_name(uint32_t id);
+
+/* Returns a copy of the TCPA log, or NULL. The caller frees it. */
+struct tcpa_table *cbmem_get_tcpa_log(struct cbmem_ctx *ctx);
+
+struct cbmem_console_info {
+	uint64_t address;
+	size_t size;		/* Size of the console buffer */
+	size_t used;		/* Bytes of text currently in it */
+	int overflow;		/* Older text was overwritten */
+	int corrupt;		/* Cursor is out of bounds */
+};
+
+/* Returns the console text in chronological order as a NUL-terminated string,
+ * with unprintable characters replaced by '?', or NULL. The caller frees it.
+ * If info is not NULL, it is filled in as well. */
+char *cbmem_get_console(struct cbmem_ctx *ctx, struct cbmem_console_info *info);
+
+#endif /* LIBCBMEM_H */
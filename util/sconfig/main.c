@@ -15,6 +15,7 @@
  */
 
 #include <ctype.h>
+#include <stdint.h>
 #include "sconfig.h"
 #include "sconfig.tab.h"
 
@@ -848,6 +849,12 @@ static void pass1(FILE *fil, struct device *ptr, struct device *next)
 			chip_ins->chip->name_underscore, chip_ins->id);
 	if (next)
 		fprintf(fil, "\t.next=&%s,\n", next->name);
+	if (ptr->next_same_type)
+		fprintf(fil, "\t.next_same_type=&%s,\n",
+			ptr->next_same_type->name);
+	if (ptr->next_in_bucket)
+		fprintf(fil, "\t.next_in_bucket=&%s,\n",
+			ptr->next_in_bucket->name);
 	if (ptr->smbios_slot_type || ptr->smbios_slot_data_width ||
 	    ptr->smbios_slot_designation || ptr->smbios_slot_length) {
 		fprintf(fil, "#if !DEVTREE_EARLY\n");
@@ -914,6 +921,143 @@ static void walk_device_tree(FILE *fil, struct device *ptr,
 	}
 }
 
+/*
+ * Device index, see device/device.h. Devices are added in the same order as
+ * they are chained through .next, so that lookups return the same device as a
+ * walk of all_devices would.
+ */
+#define DEV_INDEX_BUCKET_BITS	6
+#define DEV_INDEX_BUCKETS	(1 << DEV_INDEX_BUCKET_BITS)
+
+static const struct {
+	int bustype;
+	const char *name;
+} path_types[] = {
+	{ 0, "DEVICE_PATH_ROOT" },
+	{ PCI, "DEVICE_PATH_PCI" },
+	{ PNP, "DEVICE_PATH_PNP" },
+	{ I2C, "DEVICE_PATH_I2C" },
+	{ APIC, "DEVICE_PATH_APIC" },
+	{ CPU_CLUSTER, "DEVICE_PATH_CPU_CLUSTER" },
+	{ CPU, "DEVICE_PATH_CPU" },
+	{ DOMAIN, "DEVICE_PATH_DOMAIN" },
+	{ IOAPIC, "DEVICE_PATH_IOAPIC" },
+	{ GENERIC, "DEVICE_PATH_GENERIC" },
+	{ SPI, "DEVICE_PATH_SPI" },
+	{ USB, "DEVICE_PATH_USB" },
+	{ MMIO, "DEVICE_PATH_MMIO" },
+};
+
+#define PATH_TYPE_COUNT ((int)(sizeof(path_types) / sizeof(path_types[0])))
+
+static struct device *type_first[PATH_TYPE_COUNT];
+static struct device *type_last[PATH_TYPE_COUNT];
+static struct device *bucket_first[DEV_INDEX_BUCKETS];
+static struct device *bucket_last[DEV_INDEX_BUCKETS];
+
+static int path_type(struct device *dev)
+{
+	int i;
+
+	if (dev == &base_root_dev)
+		return 0;
+
+	for (i = 1; i < PATH_TYPE_COUNT; i++) {
+		if (path_types[i].bustype == dev->bustype)
+			return i;
+	}
+
+	fprintf(stderr, "ERROR: Unknown bus type of device %s\n", dev->name);
+	exit(1);
+}
+
+/* Has to match dev_index_bucket() and dev_path_bucket() in coreboot. */
+static int path_bucket(struct device *dev)
+{
+	uint32_t key;
+
+	if (dev == &base_root_dev)
+		return -1;
+
+	switch (dev->bustype) {
+	case PCI:
+		key = ((dev->path_a & 0x1f) << 3) | (dev->path_b & 0x7);
+		break;
+	case PNP:
+		key = (uint32_t)dev->path_a ^ ((uint32_t)dev->path_b << 16);
+		break;
+	case I2C:
+		key = dev->path_a;
+		break;
+	default:
+		return -1;
+	}
+
+	return (uint32_t)(key * 0x9e3779b1) >> (32 - DEV_INDEX_BUCKET_BITS);
+}
+
+static void index_device(FILE *fil, struct device *ptr, struct device *next)
+{
+	int type = path_type(ptr);
+	int bucket = path_bucket(ptr);
+
+	if (type_last[type])
+		type_last[type]->next_same_type = ptr;
+	else
+		type_first[type] = ptr;
+	type_last[type] = ptr;
+
+	if (bucket < 0)
+		return;
+
+	if (bucket_last[bucket])
+		bucket_last[bucket]->next_in_bucket = ptr;
+	else
+		bucket_first[bucket] = ptr;
+	bucket_last[bucket] = ptr;
+}
+
+static void emit_dev_index(FILE *fil)
+{
+	int i;
+
+	fprintf(fil, "DEVTREE_CONST struct device * DEVTREE_CONST "
+		"dev_type_first[DEVICE_PATH_COUNT] = {\n");
+	for (i = 0; i < PATH_TYPE_COUNT; i++) {
+		if (type_first[i])
+			fprintf(fil, "\t[%s] = &%s,\n", path_types[i].name,
+				type_first[i]->name);
+	}
+	fprintf(fil, "};\n");
+
+	fprintf(fil, "DEVTREE_CONST struct device * DEVTREE_CONST "
+		"dev_bucket_first[DEV_INDEX_BUCKETS] = {\n");
+	for (i = 0; i < DEV_INDEX_BUCKETS; i++) {
+		if (bucket_first[i])
+			fprintf(fil, "\t[%d] = &%s,\n", i,
+				bucket_first[i]->name);
+	}
+	fprintf(fil, "};\n");
+
+	/* The tails are only needed by alloc_dev() in ramstage. */
+	fprintf(fil, "#if !DEVTREE_EARLY\n");
+	fprintf(fil, "struct device *dev_type_last[DEVICE_PATH_COUNT] = {\n");
+	for (i = 0; i < PATH_TYPE_COUNT; i++) {
+		if (type_last[i])
+			fprintf(fil, "\t[%s] = &%s,\n", path_types[i].name,
+				type_last[i]->name);
+	}
+	fprintf(fil, "};\n");
+	fprintf(fil, "struct device *dev_bucket_last[DEV_INDEX_BUCKETS] = {\n");
+	for (i = 0; i < DEV_INDEX_BUCKETS; i++) {
+		if (bucket_last[i])
+			fprintf(fil, "\t[%d] = &%s,\n", i,
+				bucket_last[i]->name);
+	}
+	fprintf(fil, "};\n");
+	fprintf(fil, "#endif\n");
+}
+
 static void emit_chip_headers(FILE *fil, struct chip *chip)
 {
 	struct chip *tmp = chip;
@@ -1374,10 +1518,13 @@ int main(int argc, char **argv)
 	emit_chips(autogen);
 
 	walk_device_tree(autogen, &base_root_dev, inherit_subsystem_ids);
+	walk_device_tree(autogen, &base_root_dev, index_device);
 	fprintf(autogen, "\n/* pass 0 */\n");
 	walk_device_tree(autogen, &base_root_dev, pass0);
 	fprintf(autogen, "\n/* pass 1 */\n");
 	walk_device_tree(autogen, &base_root_dev, pass1);
+	fprintf(autogen, "\n/* device index */\n");
+	emit_dev_index(autogen);
 
 	fclose(autogen);
 
@@ -131,6 +131,12 @@ struct device {
 	/* Pointer to next child under the same parent. */
 	struct device *sibling;
 
+	/* Pointer to next device with the same path type. */
+	struct device *next_same_type;
+
+	/* Pointer to next device in the same bucket of the device index. */
+	struct device *next_in_bucket;
+
 	/* Pointer to resources for this device. */
 	struct resource *res;
 
@@ -0,0 +1,170 @@
+/*
+ * This file is part of the coreboot project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Compare the SHA-256 implementation using the x86 SHA extensions, which
+ * vboot uses with CONFIG_VBOOT_SHA_NI, to the vboot C implementation: check
+ * that the digests match for all sizes around the block boundaries and
+ * measure the throughput for a firmware sized buffer.
+ */
+
+#include <cpuid.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vb2_api.h>
+#include <vb2_sha.h>
+#include <arch/sha256_ni.h>
+
+#define DEFAULT_SIZE_KIB	(8 * 1024)
+/* Like tpm_measure_region() and hash_body(), hash in small chunks. */
+#define DEFAULT_CHUNK_SIZE	1024
+
+static int sha_ni_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return 0;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+
+	return !!(ebx & bit_SHA);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void hash_ref(const uint8_t *buf, size_t size, size_t chunk,
+		     uint8_t *digest)
+{
+	struct vb2_digest_context ctx;
+	size_t offset, len;
+
+	vb2_digest_init(&ctx, VB2_HASH_SHA256);
+	for (offset = 0; offset < size; offset += len) {
+		len = size - offset < chunk ? size - offset : chunk;
+		vb2_digest_extend(&ctx, buf + offset, len);
+	}
+	vb2_digest_finalize(&ctx, digest, SHA256_NI_DIGEST_SIZE);
+}
+
+static void hash_ni(const uint8_t *buf, size_t size, size_t chunk,
+		    uint8_t *digest)
+{
+	struct sha256_ni_ctx ctx;
+	size_t offset, len;
+
+	sha256_ni_init(&ctx);
+	for (offset = 0; offset < size; offset += len) {
+		len = size - offset < chunk ? size - offset : chunk;
+		sha256_ni_update(&ctx, buf + offset, len);
+	}
+	sha256_ni_final(&ctx, digest);
+}
+
+/* Digests of all sizes up to a few blocks, in odd sized chunks. */
+static int check(const uint8_t *buf)
+{
+	uint8_t ref[SHA256_NI_DIGEST_SIZE], ni[SHA256_NI_DIGEST_SIZE];
+	size_t size;
+
+	for (size = 0; size <= 4 * SHA256_NI_BLOCK_SIZE; size++) {
+		hash_ref(buf, size, 7, ref);
+		hash_ni(buf, size, 7, ni);
+		if (memcmp(ref, ni, sizeof(ref))) {
+			fprintf(stderr, "Digest mismatch for %zu bytes\n",
+				size);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static double bench(void (*hash)(const uint8_t *, size_t, size_t, uint8_t *),
+		    const uint8_t *buf, size_t size, size_t chunk,
+		    uint8_t *digest)
+{
+	double start = now();
+
+	hash(buf, size, chunk, digest);
+	return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t ref[SHA256_NI_DIGEST_SIZE], ni[SHA256_NI_DIGEST_SIZE];
+	size_t size = DEFAULT_SIZE_KIB * 1024;
+	size_t chunk = DEFAULT_CHUNK_SIZE;
+	double t_ref, t_ni;
+	uint8_t *buf;
+	size_t i;
+
+	if (argc > 3) {
+		fprintf(stderr, "usage: %s [size in KiB] [chunk size]\n",
+			argv[0]);
+		return 1;
+	}
+	if (argc > 1)
+		size = strtoul(argv[1], NULL, 0) * 1024;
+	if (argc > 2)
+		chunk = strtoul(argv[2], NULL, 0);
+	if (size < 4 * SHA256_NI_BLOCK_SIZE || !chunk) {
+		fprintf(stderr, "Invalid size\n");
+		return 1;
+	}
+
+	if (!sha_ni_supported()) {
+		printf("This CPU doesn't support the SHA extensions\n");
+		return 0;
+	}
+
+	buf = malloc(size);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+	srand(size);
+	for (i = 0; i < size; i++)
+		buf[i] = rand();
+
+	if (check(buf)) {
+		free(buf);
+		return 1;
+	}
+
+	t_ref = bench(hash_ref, buf, size, chunk, ref);
+	t_ni = bench(hash_ni, buf, size, chunk, ni);
+	free(buf);
+
+	if (memcmp(ref, ni, sizeof(ref))) {
+		fprintf(stderr, "Digest mismatch for %zu bytes\n", size);
+		return 1;
+	}
+
+	printf("SHA-256 of %zu KiB in %zu byte chunks:\n", size / 1024, chunk);
+	printf("  vboot C:        %8.1f MiB/s\n", size / t_ref / (1 << 20));
+	printf("  SHA extensions: %8.1f MiB/s (%.1fx)\n",
+	       size / t_ni / (1 << 20), t_ref / t_ni);
+
+	return 0;
+}